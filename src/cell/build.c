@@ -34,6 +34,7 @@
 #include "build.h"
 
 #include "api.h"
+#include "cache.h"
 #include "compress.h"
 #include "encoding.h"
 #include "fs.h"
@@ -66,7 +67,9 @@ struct build
 	fs_t*     fs;
 	js_ref_t* install_tool;
 	js_ref_t* manifest;
+	int       num_jobs;
 	vector_t* old_artifacts;
+	char*     script_hash;
 	vector_t* sources;
 	vector_t* source_maps;
 	vector_t* targets;
@@ -160,7 +163,7 @@ static void js_Tool_finalize            (void* host_ptr);
 
 static void    cache_value_to_this  (const char* key);
 static void    clean_old_artifacts  (build_t* build, bool keep_targets);
-static bool    install_target       (int num_args, bool is_ctor, intptr_t magic);
+static bool    install_target       (visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths);
 static void    make_file_targets    (fs_t* fs, const char* wildcard, const path_t* path, const path_t* subdir, vector_t* targets, bool recursive, time_t timestamp);
 static bool    package_dir          (build_t* build, spk_writer_t* spk, const char* from_dirname, const char* to_dirname, bool recursive);
 static int     sort_targets_by_path (const void* p_a, const void* p_b);
@@ -169,7 +172,7 @@ static bool    write_manifests      (build_t* build);
 static build_t* s_build;
 
 build_t*
-build_new(const path_t* source_path, const path_t* out_path, bool debuggable)
+build_new(const path_t* source_path, const path_t* out_path, bool debuggable, int num_jobs)
 {
 	vector_t* artifacts;
 	build_t*  build;
@@ -270,9 +273,9 @@ build_new(const path_t* source_path, const path_t* out_path, bool debuggable)
 	source_maps = vector_new(sizeof(struct source_map));
 	sources = vector_new(sizeof(struct source));
 
-	// create a Tool for the install() function to use
-	jsal_push_new_function(install_target, "doInstall", 0, false, 0);
-	jsal_push_class_obj(CELL_TOOL, tool_new("installing"), false);
+	// create a Tool for the install() function to use.  this one is native so that
+	// files can be installed in parallel.
+	jsal_push_class_obj(CELL_TOOL, tool_new_native("installing", install_target), false);
 	build->install_tool = jsal_pop_ref();
 
 	// load artifacts from previous build
@@ -306,6 +309,7 @@ build_new(const path_t* source_path, const path_t* out_path, bool debuggable)
 	build->source_maps = source_maps;
 	build->sources = sources;
 	build->debuggable = debuggable;
+	build->num_jobs = num_jobs;
 	return build;
 }
 
@@ -330,8 +334,10 @@ build_free(build_t* build)
 	while (iter_next(&iter))
 		target_free(*(target_t**)iter.ptr);
 
+	modules_uninit();
 	fs_free(build->fs);
 	visor_free(build->visor);
+	free(build->script_hash);
 	free(build);
 }
 
@@ -343,6 +349,8 @@ build_eval(build_t* build, const char* filename)
 	char*       error_stack = NULL;
 	char*       error_url = NULL;
 	bool        is_ok = true;
+	char*       script;
+	size_t      script_size;
 	struct stat stats;
 
 	if (fs_stat(build->fs, filename, &stats) != 0)
@@ -350,6 +358,11 @@ build_eval(build_t* build, const char* filename)
 
 	visor_begin_op(build->visor, "evaluating '%s'", filename);
 	build->timestamp = stats.st_mtime;
+	if ((script = fs_fslurp(build->fs, filename, &script_size))) {
+		free(build->script_hash);
+		build->script_hash = strdup(md5sum(script, script_size));
+		free(script);
+	}
 	if (!module_eval(filename, false)) {
 		build->crashed = true;
 		is_ok = false;
@@ -390,6 +403,7 @@ build_clean(build_t* build)
 {
 	clean_old_artifacts(build, false);
 	fs_unlink(build->fs, "@/artifacts.json");
+	fs_unlink(build->fs, "@/buildcache.json");
 	return true;
 }
 
@@ -511,7 +525,11 @@ build_package(build_t* build, const char* filename, bool rebuilding)
 		return false;
 
 	visor_begin_op(build->visor, "packaging game to '%s'", filename);
-	spk = spk_create(filename);
+	if (!(spk = spk_create(filename, build->num_jobs))) {
+		visor_error(build->visor, "couldn't create SPK file '%s'", filename);
+		visor_end_op(build->visor);
+		return false;
+	}
 	spk_add_file(spk, build->fs, "@/game.json", "game.json");
 	spk_add_file(spk, build->fs, "@/game.sgm", "game.sgm");
 	package_dir(build, spk, "#/game_modules", "#/game_modules", true);
@@ -536,7 +554,11 @@ build_package(build_t* build, const char* filename, bool rebuilding)
 	}
 	if (build->debuggable)
 		spk_add_file(spk, build->fs, "@/artifacts.json", "artifacts.json");
-	spk_close(spk);
+	if (!spk_close(spk)) {
+		visor_error(build->visor, "couldn't write one or more files to '%s'", filename);
+		visor_end_op(build->visor);
+		return false;
+	}
 	visor_end_op(build->visor);
 	return true;
 }
@@ -544,13 +566,18 @@ build_package(build_t* build, const char* filename, bool rebuilding)
 bool
 build_run(build_t* build, bool rebuilding)
 {
+	cache_t*           cache;
+	char*              cache_salt;
 	const char*        filename;
 	vector_t*          filenames;
 	const char*        json;
 	size_t             json_size;
 	const char*        last_filename = "";
+	char*              modules_hash;
 	int                num_matches = 1;
+	int                num_skipped = 0;
 	const path_t*      path;
+	vector_t*          primary_targets;
 	struct source*     source;
 	struct source_map* source_map;
 	const path_t*      source_path;
@@ -586,14 +613,35 @@ build_run(build_t* build, bool rebuilding)
 		goto finished;
 	}
 
-	// build all primary targets
+	// build all primary targets.  the build cache is tied to the Cellscript, the
+	// modules it loaded, the build mode and the version of Cell used, since a change
+	// to any of those can affect the output.
+	modules_hash = modules_digest();
+	cache_salt = strnewf("%s %s %s %s %s", SPHERE_COMPILER_NAME, SPHERE_VERSION,
+		build->debuggable ? "debug" : "release",
+		build->script_hash != NULL ? build->script_hash : "",
+		modules_hash != NULL ? modules_hash : "");
+	cache = cache_open(build->fs, "@/buildcache.json", cache_salt);
+	free(cache_salt);
+	free(modules_hash);
+	primary_targets = vector_new(sizeof(target_t*));
 	iter = vector_enum(build->targets);
 	while ((target_ptr = iter_next(&iter))) {
 		path = target_path(*target_ptr);
 		if (path_num_hops(path) == 0 || !path_hop_is(path, 0, "@"))
 			continue;
-		target_build(*target_ptr, build->visor, rebuilding);
+		vector_push(primary_targets, target_ptr);
+	}
+	target_build_all(primary_targets, build->visor, cache, rebuilding, build->num_jobs);
+	vector_free(primary_targets);
+	cache_close(cache);
+	iter = vector_enum(build->targets);
+	while ((target_ptr = iter_next(&iter))) {
+		if (target_skipped(*target_ptr))
+			++num_skipped;
 	}
+	if (num_skipped > 0)
+		visor_print(build->visor, "%d target(s) up to date, skipped", num_skipped);
 	visor_end_op(build->visor);
 
 	// only generate a game manifest if the build finished with no errors.
@@ -706,25 +754,28 @@ clean_old_artifacts(build_t* build, bool keep_targets)
 }
 
 static bool
-install_target(int num_args, bool is_ctor, intptr_t magic)
+install_target(visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths)
 {
 	// note: install targets never have more than one source because an individual
 	//       target is constructed for each file installed.
+	// note: this may be called on a worker thread, so don't touch the JS engine
+	//       or any other shared state in here!
 
 	int         result;
 	const char* source_path;
 	const char* target_path;
 
-	target_path = jsal_require_string(0);
-	jsal_get_prop_index(1, 0);
-	source_path = jsal_require_string(-1);
+	target_path = path_cstr(out_path);
+	source_path = path_cstr(*(path_t**)vector_get(in_paths, 0));
 
-	result = fs_fcopy(s_build->fs, target_path, source_path, true);
-	if (result == 0) {
-		// touch file to prevent "target file unchanged" warning
-		fs_utime(s_build->fs, target_path, NULL);
+	result = fs_fcopy(fs, target_path, source_path, true);
+	if (result != 0) {
+		visor_error(visor, "couldn't copy '%s' to '%s'", source_path, target_path);
+		return false;
 	}
-	jsal_push_boolean(result == 0);
+
+	// touch file to prevent "target file unchanged" warning
+	fs_utime(fs, target_path, NULL);
 	return true;
 }
 
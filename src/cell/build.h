@@ -47,7 +47,7 @@ enum cell_class
 
 typedef struct build build_t;
 
-build_t* build_new      (const path_t* source_path, const path_t* out_path, bool debuggable);
+build_t* build_new      (const path_t* source_path, const path_t* out_path, bool debuggable, int num_jobs);
 void     build_free     (build_t* build);
 bool     build_clean    (build_t* build);
 bool     build_eval     (build_t* build, const char* filename);
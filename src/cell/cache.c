@@ -0,0 +1,267 @@
+/**
+ *  Cell, the Sphere packaging compiler
+ *  Copyright (c) 2015-2020, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "cell.h"
+#include "cache.h"
+
+#include "fs.h"
+#include "jsal.h"
+#include "utility.h"
+
+// the build cache records, for each target built, the content hashes of its sources
+// and output file along with a signature for the tool that built it.  a target is up
+// to date if all of those still match, regardless of file timestamps.  this means
+// targets don't need to be rebuilt after e.g. a fresh checkout.
+
+struct cache
+{
+	char*     filename;
+	fs_t*     fs;
+	js_ref_t* hashes;
+	bool      is_dirty;
+	js_ref_t* records;
+	char*     salt;
+};
+
+static bool push_file_hash (cache_t* cache, const char* filename);
+
+cache_t*
+cache_open(fs_t* fs, const char* filename, const char* salt)
+{
+	cache_t* cache;
+	char*    json;
+	size_t   json_size;
+
+	if (!(cache = calloc(1, sizeof(cache_t))))
+		return NULL;
+	cache->fs = fs;
+	cache->filename = strdup(filename);
+	cache->salt = strdup(salt);
+
+	// note: the salt identifies the Cellscript and compiler which produced the
+	//       cache.  if either has changed, all bets are off and every target has to
+	//       be rebuilt, so we just start over with an empty cache.
+	jsal_push_new_object();
+	if ((json = fs_fslurp(fs, filename, &json_size))) {
+		jsal_push_lstring(json, json_size);
+		free(json);
+		if (jsal_try_parse(-1) && jsal_is_object(-1)) {
+			jsal_get_prop_string(-1, "salt");
+			jsal_get_prop_string(-2, "targets");
+			if (jsal_is_string(-2) && strcmp(jsal_get_string(-2), salt) == 0 && jsal_is_object(-1))
+				jsal_replace(-4);
+			else
+				jsal_pop(1);
+			jsal_pop(1);
+		}
+		jsal_pop(1);
+	}
+	cache->records = jsal_pop_ref();
+	jsal_push_new_object();
+	cache->hashes = jsal_pop_ref();
+	return cache;
+}
+
+void
+cache_close(cache_t* cache)
+{
+	const char* json;
+	size_t      json_size;
+
+	if (cache == NULL)
+		return;
+	if (cache->is_dirty) {
+		jsal_push_new_object();
+		jsal_push_string(cache->salt);
+		jsal_put_prop_string(-2, "salt");
+		jsal_push_ref_weak(cache->records);
+		jsal_put_prop_string(-2, "targets");
+		jsal_stringify(-1);
+		json = jsal_get_lstring(-1, &json_size);
+		fs_fspew(cache->fs, cache->filename, json, json_size);
+		jsal_pop(1);
+	}
+	jsal_unref(cache->hashes);
+	jsal_unref(cache->records);
+	free(cache->filename);
+	free(cache->salt);
+	free(cache);
+}
+
+bool
+cache_check(cache_t* cache, const path_t* out_path, const char* tool_sig, vector_t* in_paths)
+{
+	bool          is_match = false;
+	int           num_sources;
+	const path_t* path;
+	int           stack_top;
+
+	int i;
+
+	stack_top = jsal_get_top();
+	jsal_push_ref_weak(cache->records);
+	if (!jsal_get_prop_string(-1, path_cstr(out_path)))
+		goto finished;
+	jsal_get_prop_string(-1, "tool");
+	if (!jsal_is_string(-1) || strcmp(jsal_get_string(-1), tool_sig) != 0)
+		goto finished;
+	jsal_pop(1);
+
+	// the output file is checked too, in case it was modified by hand.  we don't want
+	// to consider a target up to date if it has been tampered with.
+	if (!push_file_hash(cache, path_cstr(out_path)))
+		goto finished;
+	jsal_get_prop_string(-2, "output");
+	if (!jsal_is_string(-1) || strcmp(jsal_get_string(-1), jsal_get_string(-2)) != 0)
+		goto finished;
+	jsal_pop(2);
+
+	// sources are compared in order, since a tool may well care about the order of
+	// its inputs.
+	jsal_get_prop_string(-1, "sources");
+	if (!jsal_is_array(-1))
+		goto finished;
+	num_sources = jsal_get_length(-1);
+	if (num_sources != vector_len(in_paths))
+		goto finished;
+	for (i = 0; i < num_sources; ++i) {
+		path = *(const path_t**)vector_get(in_paths, i);
+		jsal_get_prop_index(-1, i);
+		if (!jsal_is_array(-1))
+			goto finished;
+		jsal_get_prop_index(-1, 0);
+		jsal_get_prop_index(-2, 1);
+		if (!jsal_is_string(-2) || strcmp(jsal_get_string(-2), path_cstr(path)) != 0)
+			goto finished;
+		if (!push_file_hash(cache, path_cstr(path)))
+			goto finished;
+		if (!jsal_is_string(-2) || strcmp(jsal_get_string(-2), jsal_get_string(-1)) != 0)
+			goto finished;
+		jsal_pop(4);
+	}
+	is_match = true;
+
+finished:
+	jsal_set_top(stack_top);
+	return is_match;
+}
+
+void
+cache_forget(cache_t* cache, const path_t* out_path)
+{
+	jsal_push_ref_weak(cache->hashes);
+	jsal_del_prop_string(-1, path_cstr(out_path));
+	jsal_push_ref_weak(cache->records);
+	if (jsal_del_prop_string(-1, path_cstr(out_path)))
+		cache->is_dirty = true;
+	jsal_pop(2);
+}
+
+bool
+cache_has(cache_t* cache, const path_t* out_path)
+{
+	bool has_record;
+
+	jsal_push_ref_weak(cache->records);
+	has_record = jsal_has_prop_string(-1, path_cstr(out_path));
+	jsal_pop(1);
+	return has_record;
+}
+
+void
+cache_update(cache_t* cache, const path_t* out_path, const char* tool_sig, vector_t* in_paths)
+{
+	const path_t* path;
+	int           stack_top;
+
+	iter_t iter;
+
+	// the output file may have just been rebuilt, so make sure we rehash it.
+	cache_forget(cache, out_path);
+	stack_top = jsal_get_top();
+	jsal_push_ref_weak(cache->records);
+	jsal_push_new_object();
+	jsal_push_string(tool_sig);
+	jsal_put_prop_string(-2, "tool");
+	if (!push_file_hash(cache, path_cstr(out_path)))
+		goto on_error;
+	jsal_put_prop_string(-2, "output");
+	jsal_push_new_array();
+	iter = vector_enum(in_paths);
+	while (iter_next(&iter)) {
+		path = *(const path_t**)iter.ptr;
+		jsal_push_new_array();
+		jsal_push_string(path_cstr(path));
+		jsal_put_prop_index(-2, 0);
+		if (!push_file_hash(cache, path_cstr(path)))
+			goto on_error;
+		jsal_put_prop_index(-2, 1);
+		jsal_put_prop_index(-2, iter.index);
+	}
+	jsal_put_prop_string(-2, "sources");
+	jsal_put_prop_string(-2, path_cstr(out_path));
+	jsal_pop(1);
+	cache->is_dirty = true;
+	return;
+
+on_error:
+	// if any of the files can't be hashed, the target will just have to be checked
+	// the old-fashioned way next time.
+	jsal_set_top(stack_top);
+}
+
+static bool
+push_file_hash(cache_t* cache, const char* filename)
+{
+	// note: files often serve as sources for more than one target, so hashes are
+	//       remembered for the rest of the build.
+
+	void*  data;
+	size_t size;
+
+	jsal_push_ref_weak(cache->hashes);
+	if (jsal_get_prop_string(-1, filename)) {
+		jsal_remove(-2);
+		return true;
+	}
+	jsal_pop(1);
+	if (!(data = fs_fslurp(cache->fs, filename, &size))) {
+		jsal_pop(1);
+		return false;
+	}
+	jsal_push_string(md5sum(data, size));
+	free(data);
+	jsal_dup(-1);
+	jsal_put_prop_string(-3, filename);
+	jsal_remove(-2);
+	return true;
+}
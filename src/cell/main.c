@@ -37,6 +37,7 @@
 #include "build.h"
 #include "fs.h"
 #include "jsal.h"
+#include "thread.h"
 
 enum mode
 {
@@ -47,6 +48,7 @@ enum mode
 };
 
 static bool parse_command_line (int argc, char* argv[]);
+static bool parse_num_jobs     (const char* text);
 static void print_banner       (bool want_copyright, bool want_deps);
 static void print_cell_quote   (void);
 static void print_usage        (void);
@@ -62,6 +64,7 @@ const char* const CELLSCRIPT_NAMES[] =
 static bool      s_debug_build;
 static path_t*   s_in_path;
 static enum mode s_mode;
+static int       s_num_jobs;
 static path_t*   s_out_path;
 static path_t*   s_package_path;
 static path_t*   s_script_path;
@@ -83,7 +86,7 @@ main(int argc, char* argv[])
 	print_banner(true, false);
 	printf("\n");
 
-	build = build_new(s_in_path, s_out_path, s_debug_build);
+	build = build_new(s_in_path, s_out_path, s_debug_build, s_num_jobs);
 	if (s_script_path != NULL && !build_eval(build, path_cstr(s_script_path)))
 		goto shutdown;
 	switch (s_mode) {
@@ -133,6 +136,7 @@ parse_command_line(int argc, char* argv[])
 	s_script_path = NULL;
 	s_want_rebuild = false;
 	s_debug_build = false;
+	s_num_jobs = thread_cpu_count();
 
 	if (argc >= 2 && argv[1][0] != '-') {
 		args_index = 2;
@@ -197,6 +201,12 @@ parse_command_line(int argc, char* argv[])
 				path_free(s_out_path);
 				s_out_path = path_new_dir(argv[i]);
 			}
+			else if (strcmp(argv[i], "--jobs") == 0) {
+				if (++i >= argc)
+					goto missing_argument;
+				if (!parse_num_jobs(argv[i]))
+					return false;
+			}
 			else if (strcmp(argv[i], "--rebuild") == 0) {
 				s_want_rebuild = true;
 				have_in_dir = true;
@@ -242,6 +252,12 @@ parse_command_line(int argc, char* argv[])
 					s_out_path = path_new_dir(argv[i]);
 					have_in_dir = true;
 					break;
+				case 'j':
+					if (++i >= argc)
+						goto missing_argument;
+					if (!parse_num_jobs(argv[i]))
+						return false;
+					break;
 				case 'r':
 					s_want_rebuild = true;
 					have_in_dir = true;
@@ -329,6 +345,21 @@ missing_argument:
 	return false;
 }
 
+static bool
+parse_num_jobs(const char* text)
+{
+	char* p_end;
+	long  value;
+
+	value = strtol(text, &p_end, 10);
+	if (*p_end != '\0' || value < 1 || value > 256) {
+		printf("cell: '%s' is not a valid number of jobs\n", text);
+		return false;
+	}
+	s_num_jobs = (int)value;
+	return true;
+}
+
 static void
 print_cell_quote(void)
 {
@@ -393,6 +424,7 @@ print_usage(void)
 	printf("\n");
 	printf("   for build/pack:\n");
 	printf("   -r  --rebuild   Rebuild all targets, even those already up to date        \n");
+	printf("   -j  --jobs      Set the number of threads to use (default is one per CPU) \n");
 	printf("   -d  --debug     Include debugging information for use with SSj or SSj Blue\n");
 	printf("       --release   Build for distribution, without any debugging information \n");
 }
@@ -46,18 +46,21 @@ static bool js_require (int num_args, bool is_ctor, intptr_t magic);
 static void          do_resolve_import (void);
 static module_ref_t* find_module       (const char* specifier, const char* importer, const char* lib_dir_name, bool node_compatible);
 static module_ref_t* load_package_json (const char* filename);
+static void          note_source       (const char* pathname, const char* source, size_t size);
 static void          push_new_require  (const char* module_id);
 static module_type_t type_of_module    (const path_t* path, bool node_compatible);
 
-static fs_t* s_fs;
-static int   s_next_module_id = 1;
-static bool  s_strict_imports;
+static fs_t*     s_fs;
+static int       s_next_module_id = 1;
+static vector_t* s_source_hashes = NULL;
+static bool      s_strict_imports;
 
 void
 modules_init(fs_t* fs, bool strict_imports)
 {
 	s_fs = fs;
 	s_strict_imports = strict_imports;
+	s_source_hashes = vector_new(sizeof(char*));
 
 	jsal_on_import_module(do_resolve_import);
 
@@ -74,6 +77,51 @@ modules_init(fs_t* fs, bool strict_imports)
 	jsal_pop(1);
 }
 
+void
+modules_uninit(void)
+{
+	iter_t iter;
+
+	if (s_source_hashes == NULL)
+		return;
+	iter = vector_enum(s_source_hashes);
+	while (iter_next(&iter))
+		free(*(char**)iter.ptr);
+	vector_free(s_source_hashes);
+	s_source_hashes = NULL;
+}
+
+char*
+modules_digest(void)
+{
+	// note: this hashes the names and contents of every module loaded so far, in load
+	//       order.  it changes whenever any code the Cellscript depends on changes.
+
+	char*  digest;
+	char*  entry;
+	char*  p;
+	size_t size = 0;
+
+	iter_t iter;
+
+	iter = vector_enum(s_source_hashes);
+	while (iter_next(&iter))
+		size += strlen(*(char**)iter.ptr) + 1;
+	if (!(p = digest = malloc(size + 1)))
+		return NULL;
+	iter = vector_enum(s_source_hashes);
+	while (iter_next(&iter)) {
+		entry = *(char**)iter.ptr;
+		strcpy(p, entry);
+		p += strlen(entry);
+		*p++ = '\n';
+	}
+	*p = '\0';
+	p = strdup(md5sum(digest, size));
+	free(digest);
+	return p;
+}
+
 bool
 module_eval(const char* specifier, bool node_compatible)
 {
@@ -170,6 +218,7 @@ module_exec(module_ref_t* it)
 	// if loading as ESM, we can skip the whole CommonJS rigamarole.
 	if (it->type == MODULE_ESM) {
 		source = fs_fslurp(s_fs, pathname, &source_size);
+		note_source(pathname, source, source_size);
 		code_string = lstr_from_utf8(source, source_size, true);
 		free(source);
 		jsal_push_lstring_t(code_string);
@@ -193,6 +242,7 @@ module_exec(module_ref_t* it)
 	}
 
 	source = fs_fslurp(s_fs, pathname, &source_size);
+	note_source(pathname, source, source_size);
 	code_string = lstr_from_utf8(source, source_size, true);
 	free(source);
 
@@ -316,6 +366,7 @@ do_resolve_import(void)
 	}
 	else {
 		source = fs_fslurp(s_fs, pathname, &source_len);
+		note_source(pathname, source, source_len);
 		jsal_push_string(pathname);
 		jsal_dup(-1);
 		jsal_push_lstring(source, source_len);
@@ -462,6 +513,17 @@ on_error:
 	return NULL;
 }
 
+static void
+note_source(const char* pathname, const char* source, size_t size)
+{
+	char* entry;
+
+	if (s_source_hashes == NULL || source == NULL)
+		return;
+	entry = strnewf("%s %s", md5sum(source, size), pathname);
+	vector_push(s_source_hashes, &entry);
+}
+
 static void
 push_new_require(const char* module_id)
 {
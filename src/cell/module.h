@@ -46,6 +46,8 @@ enum module_type
 } module_type_t;
 
 void          modules_init    (fs_t* fs, bool strict_imports);
+void          modules_uninit  (void);
+char*         modules_digest  (void);
 bool          module_eval     (const char* specifier, bool node_compatible);
 module_ref_t* module_resolve  (const char* specifier, const char* importer, bool node_compatible);
 void          module_free     (module_ref_t* it);
@@ -35,8 +35,18 @@
 
 #include "compress.h"
 #include "fs.h"
+#include "thread.h"
 #include "vector.h"
 
+// files larger than this are stored in SPK v2 format as a series of independently
+// compressed chunks, so the engine can seek within them without unpacking the whole
+// file.  anything smaller is written as a plain v1 entry.
+#define CHUNK_SIZE 65536
+
+// when packaging in parallel, files are read in ahead of the compressors.  this
+// caps the amount of uncompressed data held in memory at any one time.
+#define MAX_BYTES_QUEUED (256 << 20)
+
 #pragma pack(push, 1)
 struct spk_header
 {
@@ -46,27 +56,80 @@ struct spk_header
 	uint32_t idx_offset;
 	uint8_t  reserved[2];
 };
+
+struct spk_chunk_hdr
+{
+	uint32_t pack_size;
+	uint8_t  method;
+	uint8_t  reserved[3];
+};
 #pragma pack(pop)
 
+enum spk_method
+{
+	SPK_METHOD_STORE,
+	SPK_METHOD_DEFLATE,
+};
+
 struct spk_entry
 {
 	char*    pathname;
+	uint32_t chunk_size;
 	uint32_t offset;
 	uint32_t file_size;
 	uint32_t pack_size;
+	uint16_t version;
+};
+
+struct spk_job
+{
+	uint32_t chunk_size;
+	void*    file_data;
+	size_t   file_size;
+	bool     is_done;
+	void*    pack_data;
+	size_t   pack_size;
+	char*    pathname;
+	uint16_t version;
 };
 
 struct spk_writer
 {
 	FILE*     file;
+	bool      has_error;
 	vector_t* index;
+
+	// only used when packaging in parallel.  jobs are compressed by a pool of
+	// worker threads in whatever order they finish, but written to the package by
+	// a single thread in the order they were added.  this keeps the output
+	// byte-for-byte identical to a serial build.
+	cond_t*   added_cond;
+	size_t    bytes_queued;
+	cond_t*   done_cond;
+	bool      is_closing;
+	vector_t* jobs;
+	mutex_t*  mutex;
+	int       next_job;
+	int       num_written;
+	cond_t*   written_cond;
+	vector_t* workers;
+	thread_t* write_thread;
 };
 
+static bool compress_job (struct spk_job* job);
+static void free_job     (struct spk_job* job);
+static void work_proc    (void* udata);
+static void write_job    (spk_writer_t* writer, struct spk_job* job);
+static void write_proc   (void* udata);
+
 spk_writer_t*
-spk_create(const char* filename)
+spk_create(const char* filename, int num_jobs)
 {
+	thread_t*     thread;
 	spk_writer_t* writer;
 
+	int i;
+
 	if (!(writer = calloc(1, sizeof(spk_writer_t))))
 		goto on_error;
 	if (!(writer->file = fopen(filename, "wb")))
@@ -74,27 +137,89 @@ spk_create(const char* filename)
 	fseek(writer->file, sizeof(struct spk_header), SEEK_SET);
 
 	writer->index = vector_new(sizeof(struct spk_entry));
+	if (num_jobs > 1) {
+		writer->added_cond = cond_new();
+		writer->done_cond = cond_new();
+		writer->written_cond = cond_new();
+		writer->mutex = mutex_new();
+		writer->jobs = vector_new(sizeof(struct spk_job*));
+		writer->workers = vector_new(sizeof(thread_t*));
+		if (writer->added_cond == NULL || writer->done_cond == NULL || writer->written_cond == NULL
+			|| writer->mutex == NULL)
+		{
+			goto on_error;
+		}
+		if (!(writer->write_thread = thread_new(write_proc, writer)))
+			goto on_error;
+		for (i = 0; i < num_jobs; ++i) {
+			if (!(thread = thread_new(work_proc, writer)))
+				break;  // we can make do with fewer workers
+			vector_push(writer->workers, &thread);
+		}
+		if (vector_len(writer->workers) == 0) {
+			// all the workers failed to start, so nobody would ever compress anything.
+			// shut down the write thread and bail out.
+			mutex_lock(writer->mutex);
+			writer->is_closing = true;
+			cond_broadcast(writer->done_cond);
+			mutex_unlock(writer->mutex);
+			thread_join(writer->write_thread);
+			writer->write_thread = NULL;
+			goto on_error;
+		}
+	}
 	return writer;
 
 on_error:
+	if (writer != NULL) {
+		if (writer->file != NULL)
+			fclose(writer->file);
+		vector_free(writer->index);
+		vector_free(writer->jobs);
+		vector_free(writer->workers);
+		cond_free(writer->added_cond);
+		cond_free(writer->done_cond);
+		cond_free(writer->written_cond);
+		mutex_free(writer->mutex);
+	}
 	free(writer);
 	return NULL;
 }
 
-void
+bool
 spk_close(spk_writer_t* writer)
 {
-	const uint16_t VERSION = 1;
-
 	struct spk_entry* file_info;
+	bool              has_error;
 	struct spk_header hdr;
 	uint32_t          idx_offset;
 	uint16_t          path_size;
+	uint16_t          version = 1;
 
 	iter_t iter;
 
 	if (writer == NULL)
-		return;
+		return true;
+
+	if (writer->jobs != NULL) {
+		// let the workers finish up whatever is still in the queue, then wait for
+		// everything to be written out before writing the index.
+		mutex_lock(writer->mutex);
+		writer->is_closing = true;
+		cond_broadcast(writer->added_cond);
+		cond_broadcast(writer->done_cond);
+		mutex_unlock(writer->mutex);
+		iter = vector_enum(writer->workers);
+		while (iter_next(&iter))
+			thread_join(*(thread_t**)iter.ptr);
+		thread_join(writer->write_thread);
+		vector_free(writer->jobs);
+		vector_free(writer->workers);
+		cond_free(writer->added_cond);
+		cond_free(writer->done_cond);
+		cond_free(writer->written_cond);
+		mutex_free(writer->mutex);
+	}
 
 	// write package index
 	idx_offset = ftell(writer->file);
@@ -105,65 +230,247 @@ spk_close(spk_writer_t* writer)
 		// field in the header...
 		path_size = (uint16_t)strlen(file_info->pathname) + 1;
 
-		fwrite(&VERSION, sizeof(uint16_t), 1, writer->file);
+		fwrite(&file_info->version, sizeof(uint16_t), 1, writer->file);
 		fwrite(&path_size, sizeof(uint16_t), 1, writer->file);
 		fwrite(&file_info->offset, sizeof(uint32_t), 1, writer->file);
 		fwrite(&file_info->file_size, sizeof(uint32_t), 1, writer->file);
 		fwrite(&file_info->pack_size, sizeof(uint32_t), 1, writer->file);
+		if (file_info->version >= 2)
+			fwrite(&file_info->chunk_size, sizeof(uint32_t), 1, writer->file);
 		fwrite(file_info->pathname, 1, path_size, writer->file);
+		if (file_info->version > version)
+			version = file_info->version;
 
 		// free the pathname buffer now, we no longer need it and
 		// it saves us a few lines of code later.
 		free(file_info->pathname);
 	}
 
-	// write the SPK header
+	// write the SPK header.  the package is only marked as v2 if it actually contains
+	// chunked files; that way packages made up of small files remain readable by
+	// Sphere 1.x.
 	fseek(writer->file, 0, SEEK_SET);
 	memset(&hdr, 0, sizeof(struct spk_header));
 	memcpy(hdr.magic, ".spk", 4);
-	hdr.version = 1;
+	hdr.version = version;
 	hdr.num_files = (uint32_t)vector_len(writer->index);
 	hdr.idx_offset = idx_offset;
 	fwrite(&hdr, sizeof(struct spk_header), 1, writer->file);
 
-	// finally, close the file
+	// finally, close the file.  if any file failed to compress, the package is still
+	// written out so that it's well-formed, but the caller needs to know it's incomplete.
 	fclose(writer->file);
+	has_error = writer->has_error;
 	vector_free(writer->index);
 	free(writer);
+	return !has_error;
 }
 
 bool
 spk_add_file(spk_writer_t* writer, fs_t* fs, const char* filename, const char* spk_pathname)
 {
-	struct spk_entry idx_entry;
-	void*            file_data = NULL;
-	size_t           file_size;
-	long             offset;
-	void*            pack_data = NULL;
-	size_t           pack_size;
+	struct spk_job* job;
 
-	if (!(file_data = fs_fslurp(fs, filename, &file_size)))
-		goto on_error;
-	if (file_size > UINT32_MAX)
+	// note: files are always read in on the calling thread, since the filesystem
+	//       layer isn't thread-safe.  only compression is farmed out.
+	// note: a file that can't be read is simply left out of the package, since callers
+	//       add optional files like game.sgm unconditionally.  anything else going
+	//       wrong means the package is incomplete, and is reported by spk_close().
+
+	if (!(job = calloc(1, sizeof(struct spk_job))))
 		goto on_error;
-	if (!(pack_data = z_deflate(file_data, file_size, 9, &pack_size)))
+	if (!(job->file_data = fs_fslurp(fs, filename, &job->file_size))) {
+		free_job(job);
+		return false;
+	}
+	if (job->file_size > UINT32_MAX)
 		goto on_error;
-	if (pack_size > UINT32_MAX)
+	if (!(job->pathname = strdup(spk_pathname)))
 		goto on_error;
-	offset = ftell(writer->file);
-	fwrite(pack_data, pack_size, 1, writer->file);
-	free(pack_data);
-	free(file_data);
 
-	idx_entry.pathname = strdup(spk_pathname);
-	idx_entry.file_size = (uint32_t)file_size;
-	idx_entry.pack_size = (uint32_t)pack_size;
-	idx_entry.offset = offset;
-	vector_push(writer->index, &idx_entry);
+	if (writer->jobs == NULL) {
+		if (!compress_job(job))
+			goto on_error;
+		write_job(writer, job);
+		free_job(job);
+	}
+	else {
+		mutex_lock(writer->mutex);
+		while (writer->bytes_queued > 0 && writer->bytes_queued + job->file_size > MAX_BYTES_QUEUED)
+			cond_wait(writer->written_cond, writer->mutex);
+		vector_push(writer->jobs, &job);
+		writer->bytes_queued += job->file_size;
+		cond_signal(writer->added_cond);
+		mutex_unlock(writer->mutex);
+	}
 	return true;
 
 on_error:
-	free(pack_data);
-	free(file_data);
+	if (writer->mutex != NULL)
+		mutex_lock(writer->mutex);
+	writer->has_error = true;
+	if (writer->mutex != NULL)
+		mutex_unlock(writer->mutex);
+	free_job(job);
 	return false;
 }
+
+static bool
+compress_job(struct spk_job* job)
+{
+	// note: a v2 entry begins with a table giving the packed size and compression
+	//       method of each chunk, immediately followed by the chunk data.  chunks which
+	//       don't shrink when deflated are stored as-is.
+
+	struct spk_chunk_hdr* chunk_hdrs;
+	size_t                chunk_size;
+	const uint8_t*        data;
+	int                   num_chunks;
+	uint8_t*              p_out;
+	void*                 pack_data;
+	size_t                pack_size;
+	size_t                table_size;
+
+	int i;
+
+	if (job->file_size <= CHUNK_SIZE) {
+		if (!(job->pack_data = z_deflate(job->file_data, job->file_size, 9, &job->pack_size)))
+			return false;
+		job->version = 1;
+		job->chunk_size = 0;
+		return job->pack_size <= UINT32_MAX;
+	}
+
+	// the output can't be bigger than the table plus the file itself, since chunks
+	// that don't compress are stored.
+	data = job->file_data;
+	num_chunks = (int)((job->file_size + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	table_size = num_chunks * sizeof(struct spk_chunk_hdr);
+	if (!(job->pack_data = malloc(table_size + job->file_size)))
+		return false;
+	chunk_hdrs = job->pack_data;
+	memset(chunk_hdrs, 0, table_size);
+	p_out = (uint8_t*)job->pack_data + table_size;
+	for (i = 0; i < num_chunks; ++i) {
+		chunk_size = job->file_size - (size_t)i * CHUNK_SIZE;
+		if (chunk_size > CHUNK_SIZE)
+			chunk_size = CHUNK_SIZE;
+		if (!(pack_data = z_deflate(data + (size_t)i * CHUNK_SIZE, chunk_size, 9, &pack_size)))
+			return false;
+		if (pack_size < chunk_size) {
+			memcpy(p_out, pack_data, pack_size);
+			chunk_hdrs[i].method = SPK_METHOD_DEFLATE;
+			chunk_hdrs[i].pack_size = (uint32_t)pack_size;
+		}
+		else {
+			memcpy(p_out, data + (size_t)i * CHUNK_SIZE, chunk_size);
+			chunk_hdrs[i].method = SPK_METHOD_STORE;
+			chunk_hdrs[i].pack_size = (uint32_t)chunk_size;
+		}
+		p_out += chunk_hdrs[i].pack_size;
+		free(pack_data);
+	}
+	job->pack_size = p_out - (uint8_t*)job->pack_data;
+	job->version = 2;
+	job->chunk_size = CHUNK_SIZE;
+	return job->pack_size <= UINT32_MAX;
+}
+
+static void
+free_job(struct spk_job* job)
+{
+	if (job == NULL)
+		return;
+	free(job->file_data);
+	free(job->pack_data);
+	free(job->pathname);
+	free(job);
+}
+
+static void
+work_proc(void* udata)
+{
+	struct spk_job* job;
+	spk_writer_t*   writer;
+
+	writer = udata;
+	mutex_lock(writer->mutex);
+	while (true) {
+		while (writer->next_job >= vector_len(writer->jobs) && !writer->is_closing)
+			cond_wait(writer->added_cond, writer->mutex);
+		if (writer->next_job >= vector_len(writer->jobs))
+			break;  // queue is empty and no more jobs are coming
+		job = *(struct spk_job**)vector_get(writer->jobs, writer->next_job++);
+		mutex_unlock(writer->mutex);
+		if (!compress_job(job)) {
+			// the write thread skips jobs with no packed data; spk_close() will report
+			// the package as incomplete.
+			free(job->pack_data);
+			job->pack_data = NULL;
+		}
+		mutex_lock(writer->mutex);
+		if (job->pack_data == NULL)
+			writer->has_error = true;
+		job->is_done = true;
+		cond_broadcast(writer->done_cond);
+	}
+	mutex_unlock(writer->mutex);
+}
+
+static void
+write_job(spk_writer_t* writer, struct spk_job* job)
+{
+	struct spk_entry idx_entry;
+	long             offset;
+
+	offset = ftell(writer->file);
+	fwrite(job->pack_data, job->pack_size, 1, writer->file);
+
+	idx_entry.pathname = job->pathname;
+	idx_entry.version = job->version;
+	idx_entry.chunk_size = job->chunk_size;
+	idx_entry.file_size = (uint32_t)job->file_size;
+	idx_entry.pack_size = (uint32_t)job->pack_size;
+	idx_entry.offset = offset;
+	vector_push(writer->index, &idx_entry);
+	job->pathname = NULL;  // the index owns it now
+}
+
+static void
+write_proc(void* udata)
+{
+	size_t           file_size;
+	struct spk_job** job_ptr;
+	struct spk_job*  job;
+	spk_writer_t*    writer;
+
+	writer = udata;
+	mutex_lock(writer->mutex);
+	while (true) {
+		while (true) {
+			if (writer->num_written < vector_len(writer->jobs)) {
+				job_ptr = vector_get(writer->jobs, writer->num_written);
+				if ((*job_ptr)->is_done)
+					break;
+			}
+			else if (writer->is_closing) {
+				break;
+			}
+			cond_wait(writer->done_cond, writer->mutex);
+		}
+		if (writer->num_written >= vector_len(writer->jobs))
+			break;  // all done!
+		job = *job_ptr;
+		*job_ptr = NULL;
+		mutex_unlock(writer->mutex);
+		if (job->pack_data != NULL)
+			write_job(writer, job);
+		file_size = job->file_size;
+		free_job(job);
+		mutex_lock(writer->mutex);
+		writer->bytes_queued -= file_size;
+		++writer->num_written;
+		cond_broadcast(writer->written_cond);
+	}
+	mutex_unlock(writer->mutex);
+}
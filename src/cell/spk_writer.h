@@ -37,8 +37,8 @@
 
 typedef struct spk_writer spk_writer_t;
 
-spk_writer_t* spk_create   (const char* filename);
-void          spk_close    (spk_writer_t* writer);
+spk_writer_t* spk_create   (const char* filename, int num_jobs);
+bool          spk_close    (spk_writer_t* writer);
 bool          spk_add_file (spk_writer_t* writer, fs_t* fs, const char* filename, const char* spk_pathname);
 
 #endif // SPHERE__SPK_WRITER_H__INCLUDED
@@ -33,22 +33,63 @@
 #include "cell.h"
 #include "target.h"
 
+#include "cache.h"
 #include "fs.h"
+#include "thread.h"
 #include "tool.h"
 #include "visor.h"
 
+enum target_state
+{
+	TARGET_IDLE,
+	TARGET_WAITING,
+	TARGET_RUNNING,
+	TARGET_DONE,
+};
+
 struct target
 {
-	unsigned int refcount;
-	path_t*      name;
-	fs_t*        fs;
-	path_t*      path;
-	vector_t*    sources;
-	time_t       timestamp;
-	tool_t*      tool;
-	bool         tracked;
+	unsigned int      refcount;
+	bool              build_ok;
+	vector_t*         dependents;
+	path_t*           name;
+	fs_t*             fs;
+	vector_t*         in_paths;
+	visor_t*          job_visor;
+	int               num_waiting;
+	path_t*           path;
+	bool              skipped;
+	vector_t*         sources;
+	enum target_state state;
+	time_t            timestamp;
+	tool_t*           tool;
+	bool              tracked;
 };
 
+struct builder
+{
+	cache_t*  cache;
+	vector_t* done_jobs;
+	cond_t*   done_cond;
+	bool      force_build;
+	bool      is_closing;
+	cond_t*   job_cond;
+	vector_t* jobs;
+	mutex_t*  mutex;
+	int       next_job;
+	int       next_ready;
+	int       num_running;
+	vector_t* ready;
+	visor_t*  visor;
+	vector_t* workers;
+};
+
+static void add_to_graph    (struct builder* builder, target_t* target);
+static void complete_target (struct builder* builder, target_t* target);
+static void finish_target   (struct builder* builder, target_t* target, bool status, bool is_outdated);
+static void start_target    (struct builder* builder, target_t* target);
+static void work_proc       (void* udata);
+
 target_t*
 target_new(const path_t* name, fs_t* fs, const path_t* path, tool_t* tool, time_t timestamp, bool tracked)
 {
@@ -87,6 +128,8 @@ target_free(target_t* target)
 	while ((p = iter_next(&iter)))
 		target_free(*p);
 	vector_free(target->sources);
+	vector_free(target->dependents);
+	visor_free(target->job_visor);
 	tool_unref(target->tool);
 	path_free(target->name);
 	free(target);
@@ -117,6 +160,12 @@ target_source_path(const target_t* target)
 	return target_path(source);
 }
 
+bool
+target_skipped(const target_t* target)
+{
+	return target->skipped;
+}
+
 void
 target_add_source(target_t* target, target_t* source)
 {
@@ -125,46 +174,215 @@ target_add_source(target_t* target, target_t* source)
 }
 
 bool
-target_build(target_t* target, visor_t* visor, bool force_build)
+target_build_all(vector_t* targets, visor_t* visor, cache_t* cache, bool force_build, int num_jobs)
+{
+	// note: targets are built in dependency order, but otherwise no particular order
+	//       is guaranteed.  tools which call into JavaScript always run on the main
+	//       thread; native tools (e.g. the one used by install()) are farmed out to
+	//       a pool of worker threads if more than one job is allowed.
+
+	struct builder builder;
+	vector_t*      done_jobs;
+	bool           is_ok = true;
+	target_t*      target;
+	thread_t*      thread;
+
+	iter_t iter;
+	int    i;
+
+	memset(&builder, 0, sizeof(struct builder));
+	builder.visor = visor;
+	builder.cache = cache;
+	builder.force_build = force_build;
+	builder.ready = vector_new(sizeof(target_t*));
+	if (num_jobs > 1) {
+		builder.mutex = mutex_new();
+		builder.job_cond = cond_new();
+		builder.done_cond = cond_new();
+		builder.jobs = vector_new(sizeof(target_t*));
+		builder.done_jobs = vector_new(sizeof(target_t*));
+		builder.workers = vector_new(sizeof(thread_t*));
+		for (i = 0; i < num_jobs; ++i) {
+			if (!(thread = thread_new(work_proc, &builder)))
+				break;  // we can make do with fewer workers
+			vector_push(builder.workers, &thread);
+		}
+	}
+
+	// figure out which targets depend on which.  anything with no outstanding
+	// dependencies is ready to go right away.
+	iter = vector_enum(targets);
+	while (iter_next(&iter))
+		add_to_graph(&builder, *(target_t**)iter.ptr);
+
+	while (true) {
+		while (builder.next_ready < vector_len(builder.ready)) {
+			target = *(target_t**)vector_get(builder.ready, builder.next_ready++);
+			start_target(&builder, target);
+		}
+		if (builder.num_running == 0)
+			break;
+
+		// wait for at least one of the workers to finish a job.  each target's output
+		// is printed all at once when it finishes so that it's not interleaved with
+		// anything else.
+		mutex_lock(builder.mutex);
+		while (vector_len(builder.done_jobs) == 0)
+			cond_wait(builder.done_cond, builder.mutex);
+		done_jobs = builder.done_jobs;
+		builder.done_jobs = vector_new(sizeof(target_t*));
+		mutex_unlock(builder.mutex);
+		iter = vector_enum(done_jobs);
+		while (iter_next(&iter)) {
+			target = *(target_t**)iter.ptr;
+			visor_join(visor, target->job_visor);
+			target->job_visor = NULL;
+			--builder.num_running;
+			finish_target(&builder, target, target->build_ok, true);
+		}
+		vector_free(done_jobs);
+	}
+
+	if (builder.workers != NULL) {
+		mutex_lock(builder.mutex);
+		builder.is_closing = true;
+		cond_broadcast(builder.job_cond);
+		mutex_unlock(builder.mutex);
+		iter = vector_enum(builder.workers);
+		while (iter_next(&iter))
+			thread_join(*(thread_t**)iter.ptr);
+		vector_free(builder.workers);
+		vector_free(builder.jobs);
+		vector_free(builder.done_jobs);
+		cond_free(builder.job_cond);
+		cond_free(builder.done_cond);
+		mutex_free(builder.mutex);
+	}
+	vector_free(builder.ready);
+
+	iter = vector_enum(targets);
+	while (iter_next(&iter)) {
+		target = *(target_t**)iter.ptr;
+		if (!target->build_ok)
+			is_ok = false;
+	}
+	return is_ok;
+}
+
+static void
+add_to_graph(struct builder* builder, target_t* target)
+{
+	target_t* source;
+
+	iter_t iter;
+
+	if (target->state != TARGET_IDLE)
+		return;  // already visited
+	target->state = TARGET_WAITING;
+	target->num_waiting = 0;
+	target->dependents = vector_new(sizeof(target_t*));
+	iter = vector_enum(target->sources);
+	while (iter_next(&iter)) {
+		source = *(target_t**)iter.ptr;
+		add_to_graph(builder, source);
+		if (source->state != TARGET_DONE) {
+			vector_push(source->dependents, &target);
+			++target->num_waiting;
+		}
+	}
+	if (target->num_waiting == 0)
+		vector_push(builder->ready, &target);
+}
+
+static void
+complete_target(struct builder* builder, target_t* target)
 {
-	vector_t*   in_paths = NULL;
+	target_t* dependent;
+
+	iter_t iter;
+
+	target->state = TARGET_DONE;
+	if (target->in_paths != NULL) {
+		iter = vector_enum(target->in_paths);
+		while (iter_next(&iter))
+			path_free(*(path_t**)iter.ptr);
+		vector_free(target->in_paths);
+		target->in_paths = NULL;
+	}
+	iter = vector_enum(target->dependents);
+	while (iter_next(&iter)) {
+		dependent = *(target_t**)iter.ptr;
+		if (--dependent->num_waiting == 0)
+			vector_push(builder->ready, &dependent);
+	}
+	vector_free(target->dependents);
+	target->dependents = NULL;
+}
+
+static void
+finish_target(struct builder* builder, target_t* target, bool status, bool is_outdated)
+{
+	if (target->tool != NULL) {
+		if (status && (is_outdated || !cache_has(builder->cache, target->path)))
+			cache_update(builder->cache, target->path, tool_signature(target->tool), target->in_paths);
+		else if (!status)
+			cache_forget(builder->cache, target->path);
+		target->skipped = !is_outdated;
+	}
+	target->build_ok = status;
+	complete_target(builder, target);
+}
+
+static void
+start_target(struct builder* builder, target_t* target)
+{
+	bool        is_dir = false;
 	bool        is_outdated = false;
 	time_t      last_time = 0;
 	path_t*     path;
 	path_t**    path_ptr;
-	bool        status;
 	struct stat sb;
 	target_t**  target_ptr;
 
 	iter_t iter;
 
-	// build dependencies and add them to the source list
-	in_paths = vector_new(sizeof(path_t*));
+	// all of the target's dependencies have been built at this point, so we can
+	// collect their paths to pass to the tool.
+	target->in_paths = vector_new(sizeof(path_t*));
 	iter = vector_enum(target->sources);
 	while ((target_ptr = iter_next(&iter))) {
-		target_build(*target_ptr, visor, force_build);
 		path = path_dup(target_path(*target_ptr));
-		vector_push(in_paths, &path);
+		vector_push(target->in_paths, &path);
 	}
 
 	if (target->tracked)
-		visor_add_file(visor, path_cstr(target->path));
+		visor_add_file(builder->visor, path_cstr(target->path));
 
 	if (target->tracked && vector_len(target->sources) == 0) {
-		visor_warn(visor, "always up-to-date: '%s' (no sources)", path_cstr(target->path));
-		return true;
+		visor_warn(builder->visor, "always up-to-date: '%s' (no sources)", path_cstr(target->path));
+		target->build_ok = true;
+		complete_target(builder, target);
+		return;
 	}
 
-	// check whether the output file is out of date with respect to its sources.
-	// this is a simple timestamp comparison for now; it might be good to eventually
-	// switch to a hash-based solution like in SCons.
-	if (fs_stat(target->fs, path_cstr(target->path), &sb) == 0)
+	// check whether the output file is out of date with respect to its sources.  if
+	// the build cache knows about the target, its content hashes are authoritative.
+	// otherwise fall back on comparing timestamps.
+	if (fs_stat(target->fs, path_cstr(target->path), &sb) == 0) {
 		last_time = sb.st_mtime;
-	if (force_build || (sb.st_mode & S_IFDIR) == S_IFDIR || target->timestamp > last_time) {
+		is_dir = (sb.st_mode & S_IFDIR) == S_IFDIR;
+	}
+	if (builder->force_build || last_time == 0 || is_dir) {
+		is_outdated = true;
+	}
+	else if (target->tool != NULL && cache_has(builder->cache, target->path)) {
+		is_outdated = !cache_check(builder->cache, target->path, tool_signature(target->tool), target->in_paths);
+	}
+	else if (target->timestamp > last_time) {
 		is_outdated = true;
 	}
 	else {
-		iter = vector_enum(in_paths);
+		iter = vector_enum(target->in_paths);
 		while ((path_ptr = iter_next(&iter))) {
 			fs_stat(target->fs, path_cstr(*path_ptr), &sb);
 			if ((is_outdated = sb.st_mtime > last_time))
@@ -173,12 +391,46 @@ target_build(target_t* target, visor_t* visor, bool force_build)
 	}
 
 	// build the target if it's out of date
-	status = is_outdated
-		? tool_run(target->tool, visor, target->fs, target->path, in_paths)
-		: true;
-	iter = vector_enum(in_paths);
-	while ((path_ptr = iter_next(&iter)))
-		path_free(*path_ptr);
-	vector_free(in_paths);
-	return status;
+	if (!is_outdated) {
+		finish_target(builder, target, true, false);
+	}
+	else if (builder->workers != NULL && vector_len(builder->workers) > 0 && tool_is_native(target->tool)) {
+		target->state = TARGET_RUNNING;
+		target->job_visor = visor_fork();
+		++builder->num_running;
+		mutex_lock(builder->mutex);
+		vector_push(builder->jobs, &target);
+		cond_signal(builder->job_cond);
+		mutex_unlock(builder->mutex);
+	}
+	else {
+		finish_target(builder, target,
+			tool_run(target->tool, builder->visor, target->fs, target->path, target->in_paths),
+			true);
+	}
+}
+
+static void
+work_proc(void* udata)
+{
+	struct builder* builder;
+	bool            status;
+	target_t*       target;
+
+	builder = udata;
+	mutex_lock(builder->mutex);
+	while (true) {
+		while (builder->next_job >= vector_len(builder->jobs) && !builder->is_closing)
+			cond_wait(builder->job_cond, builder->mutex);
+		if (builder->next_job >= vector_len(builder->jobs))
+			break;
+		target = *(target_t**)vector_get(builder->jobs, builder->next_job++);
+		mutex_unlock(builder->mutex);
+		status = tool_run(target->tool, target->job_visor, target->fs, target->path, target->in_paths);
+		mutex_lock(builder->mutex);
+		target->build_ok = status;
+		vector_push(builder->done_jobs, &target);
+		cond_signal(builder->done_cond);
+	}
+	mutex_unlock(builder->mutex);
 }
@@ -0,0 +1,264 @@
+/**
+ *  Cell, the Sphere packaging compiler
+ *  Copyright (c) 2015-2020, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#include "cell.h"
+#include "thread.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define _WIN32_WINNT 0x0600
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+struct cond
+{
+#if defined(_WIN32)
+	CONDITION_VARIABLE handle;
+#else
+	pthread_cond_t     handle;
+#endif
+};
+
+struct mutex
+{
+#if defined(_WIN32)
+	CRITICAL_SECTION handle;
+#else
+	pthread_mutex_t  handle;
+#endif
+};
+
+struct thread
+{
+#if defined(_WIN32)
+	HANDLE        handle;
+#else
+	pthread_t     handle;
+#endif
+	thread_proc_t proc;
+	void*         udata;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_main (void* udata);
+#else
+static void*        thread_main (void* udata);
+#endif
+
+int
+thread_cpu_count(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long num_cpus;
+
+	num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return num_cpus > 0 ? (int)num_cpus : 1;
+#endif
+}
+
+thread_t*
+thread_new(thread_proc_t proc, void* udata)
+{
+	thread_t* thread;
+
+	if (!(thread = calloc(1, sizeof(thread_t))))
+		return NULL;
+	thread->proc = proc;
+	thread->udata = udata;
+#if defined(_WIN32)
+	if (!(thread->handle = CreateThread(NULL, 0, thread_main, thread, 0, NULL)))
+		goto on_error;
+#else
+	if (pthread_create(&thread->handle, NULL, thread_main, thread) != 0)
+		goto on_error;
+#endif
+	return thread;
+
+on_error:
+	free(thread);
+	return NULL;
+}
+
+void
+thread_join(thread_t* thread)
+{
+	// note: this also frees the thread object.
+
+	if (thread == NULL)
+		return;
+#if defined(_WIN32)
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+	free(thread);
+}
+
+cond_t*
+cond_new(void)
+{
+	cond_t* cond;
+
+	if (!(cond = calloc(1, sizeof(cond_t))))
+		return NULL;
+#if defined(_WIN32)
+	InitializeConditionVariable(&cond->handle);
+#else
+	if (pthread_cond_init(&cond->handle, NULL) != 0) {
+		free(cond);
+		return NULL;
+	}
+#endif
+	return cond;
+}
+
+void
+cond_free(cond_t* cond)
+{
+	if (cond == NULL)
+		return;
+#if !defined(_WIN32)
+	pthread_cond_destroy(&cond->handle);
+#endif
+	free(cond);
+}
+
+void
+cond_broadcast(cond_t* cond)
+{
+#if defined(_WIN32)
+	WakeAllConditionVariable(&cond->handle);
+#else
+	pthread_cond_broadcast(&cond->handle);
+#endif
+}
+
+void
+cond_signal(cond_t* cond)
+{
+#if defined(_WIN32)
+	WakeConditionVariable(&cond->handle);
+#else
+	pthread_cond_signal(&cond->handle);
+#endif
+}
+
+void
+cond_wait(cond_t* cond, mutex_t* mutex)
+{
+	// note: as with pthreads, spurious wakeups are possible, so the caller should
+	//       always check its condition in a loop.
+
+#if defined(_WIN32)
+	SleepConditionVariableCS(&cond->handle, &mutex->handle, INFINITE);
+#else
+	pthread_cond_wait(&cond->handle, &mutex->handle);
+#endif
+}
+
+mutex_t*
+mutex_new(void)
+{
+	mutex_t* mutex;
+
+	if (!(mutex = calloc(1, sizeof(mutex_t))))
+		return NULL;
+#if defined(_WIN32)
+	InitializeCriticalSection(&mutex->handle);
+#else
+	if (pthread_mutex_init(&mutex->handle, NULL) != 0) {
+		free(mutex);
+		return NULL;
+	}
+#endif
+	return mutex;
+}
+
+void
+mutex_free(mutex_t* mutex)
+{
+	if (mutex == NULL)
+		return;
+#if defined(_WIN32)
+	DeleteCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_destroy(&mutex->handle);
+#endif
+	free(mutex);
+}
+
+void
+mutex_lock(mutex_t* mutex)
+{
+#if defined(_WIN32)
+	EnterCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_lock(&mutex->handle);
+#endif
+}
+
+void
+mutex_unlock(mutex_t* mutex)
+{
+#if defined(_WIN32)
+	LeaveCriticalSection(&mutex->handle);
+#else
+	pthread_mutex_unlock(&mutex->handle);
+#endif
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI
+#else
+static void*
+#endif
+thread_main(void* udata)
+{
+	thread_t* thread;
+
+	thread = udata;
+	thread->proc(thread->udata);
+#if defined(_WIN32)
+	return 0;
+#else
+	return NULL;
+#endif
+}
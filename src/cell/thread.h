@@ -0,0 +1,55 @@
+/**
+ *  Cell, the Sphere packaging compiler
+ *  Copyright (c) 2015-2020, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__THREAD_H__INCLUDED
+#define SPHERE__THREAD_H__INCLUDED
+
+typedef struct cond   cond_t;
+typedef struct mutex  mutex_t;
+typedef struct thread thread_t;
+
+typedef void (* thread_proc_t)(void* udata);
+
+int       thread_cpu_count (void);
+thread_t* thread_new       (thread_proc_t proc, void* udata);
+void      thread_join      (thread_t* thread);
+cond_t*   cond_new         (void);
+void      cond_free        (cond_t* cond);
+void      cond_broadcast   (cond_t* cond);
+void      cond_signal      (cond_t* cond);
+void      cond_wait        (cond_t* cond, mutex_t* mutex);
+mutex_t*  mutex_new        (void);
+void      mutex_free       (mutex_t* mutex);
+void      mutex_lock       (mutex_t* mutex);
+void      mutex_unlock     (mutex_t* mutex);
+
+#endif // SPHERE__THREAD_H__INCLUDED
@@ -35,12 +35,15 @@
 
 #include "fs.h"
 #include "jsal.h"
+#include "utility.h"
 #include "visor.h"
 
 struct tool
 {
 	unsigned int refcount;
 	js_ref_t*    callback_ref;
+	tool_proc_t  proc;
+	char*        signature;
 	char*        verb;
 };
 
@@ -59,6 +62,21 @@ tool_new(const char* verb)
 	return tool_ref(tool);
 }
 
+tool_t*
+tool_new_native(const char* verb, tool_proc_t proc)
+{
+	// note: native tools don't call into JavaScript, so unlike regular tools, they
+	//       can be run on any thread.
+
+	tool_t* tool;
+
+	if (!(tool = calloc(1, sizeof(tool_t))))
+		return NULL;
+	tool->verb = strdup(verb);
+	tool->proc = proc;
+	return tool_ref(tool);
+}
+
 tool_t*
 tool_ref(tool_t* tool)
 {
@@ -74,11 +92,46 @@ tool_unref(tool_t* tool)
 	if (tool == NULL || --tool->refcount > 0)
 		return;
 
-	jsal_unref(tool->callback_ref);
+	if (tool->callback_ref != NULL)
+		jsal_unref(tool->callback_ref);
+	free(tool->signature);
 	free(tool->verb);
 	free(tool);
 }
 
+bool
+tool_is_native(const tool_t* tool)
+{
+	return tool != NULL && tool->proc != NULL;
+}
+
+const char*
+tool_signature(tool_t* tool)
+{
+	// note: the signature is a hash of the tool's verb and the source code of its
+	//       callback, so that changing how a tool works invalidates the targets it
+	//       built previously.
+
+	char* text;
+
+	if (tool == NULL)
+		return "";
+	if (tool->signature != NULL)
+		return tool->signature;
+	if (tool->proc != NULL) {
+		// native tools can only change along with Cell itself, which the build
+		// cache already accounts for.
+		tool->signature = strnewf("native:%s", tool->verb);
+		return tool->signature;
+	}
+	jsal_push_ref_weak(tool->callback_ref);
+	text = strnewf("%s\n%s", tool->verb, jsal_to_string(-1));
+	tool->signature = strdup(md5sum(text, strlen(text)));
+	free(text);
+	jsal_pop(1);
+	return tool->signature;
+}
+
 bool
 tool_run(tool_t* tool, visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths)
 {
@@ -106,29 +159,34 @@ tool_run(tool_t* tool, visor_t* visor, const fs_t* fs, const path_t* out_path, v
 
 	if (fs_stat(fs, path_cstr(out_path), &stats) == 0)
 		last_mtime = stats.st_mtime;
-	jsal_push_ref_weak(tool->callback_ref);
-	jsal_push_string(path_cstr(out_path));
-	jsal_push_new_array();
-	iter = vector_enum(in_paths);
-	while ((path_ptr = iter_next(&iter))) {
-		array_index = jsal_get_length(-1);
-		jsal_push_string(path_cstr(*path_ptr));
-		jsal_put_prop_index(-2, array_index);
-	}
 	num_errors = visor_num_errors(visor);
-	if (!jsal_try_call(2)) {
-		jsal_get_prop_string(-1, "fileName");
-		filename = jsal_to_string(-1);
-		jsal_get_prop_string(-2, "lineNumber");
-		line_number = jsal_get_int(-1);
-		jsal_dup(-3);
-		jsal_to_string(-1);
-		visor_error(visor, "%s", jsal_get_string(-1));
-		visor_print(visor, "@ [%s:%d]", filename, line_number);
-		jsal_pop(3);
-		result_ok = false;
+	if (tool->proc != NULL) {
+		result_ok = tool->proc(visor, fs, out_path, in_paths);
+	}
+	else {
+		jsal_push_ref_weak(tool->callback_ref);
+		jsal_push_string(path_cstr(out_path));
+		jsal_push_new_array();
+		iter = vector_enum(in_paths);
+		while ((path_ptr = iter_next(&iter))) {
+			array_index = jsal_get_length(-1);
+			jsal_push_string(path_cstr(*path_ptr));
+			jsal_put_prop_index(-2, array_index);
+		}
+		if (!jsal_try_call(2)) {
+			jsal_get_prop_string(-1, "fileName");
+			filename = jsal_to_string(-1);
+			jsal_get_prop_string(-2, "lineNumber");
+			line_number = jsal_get_int(-1);
+			jsal_dup(-3);
+			jsal_to_string(-1);
+			visor_error(visor, "%s", jsal_get_string(-1));
+			visor_print(visor, "@ [%s:%d]", filename, line_number);
+			jsal_pop(3);
+			result_ok = false;
+		}
+		jsal_pop(1);
 	}
-	jsal_pop(1);
 	if (visor_num_errors(visor) > num_errors)
 		result_ok = false;
 
@@ -38,9 +38,14 @@
 
 typedef struct tool tool_t;
 
-tool_t* tool_new   (const char* verb);
-tool_t* tool_ref   (tool_t* tool);
-void    tool_unref (tool_t* tool);
-bool    tool_run   (tool_t* tool, visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths);
+typedef bool (* tool_proc_t)(visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths);
+
+tool_t*     tool_new        (const char* verb);
+tool_t*     tool_new_native (const char* verb, tool_proc_t proc);
+tool_t*     tool_ref        (tool_t* tool);
+void        tool_unref      (tool_t* tool);
+bool        tool_is_native  (const tool_t* tool);
+const char* tool_signature  (tool_t* tool);
+bool        tool_run       (tool_t* tool, visor_t* visor, const fs_t* fs, const path_t* out_path, vector_t* in_paths);
 
 #endif // SPHERE__TOOL_H__INCLUDED
@@ -40,6 +40,7 @@
 #endif
 #include "api.h"
 #include "fs.h"
+#include "md5.h"
 
 void
 jsal_push_lstring_t(const lstring_t* string)
@@ -171,6 +172,31 @@ fspew(const void* buffer, size_t size, const char* filename)
 	return true;
 }
 
+const char*
+md5sum(const void* data, size_t size)
+{
+	// note: a static buffer is used here to store the last generated hash, so
+	//       only one output can be used at a time.  be careful.
+
+	static char output[33];
+
+	MD5_CTX ctx;
+	uint8_t hash_bytes[16];
+	char    *p;
+
+	int i;
+
+	MD5_Init(&ctx);
+	MD5_Update(&ctx, data, (unsigned long)size);
+	MD5_Final(hash_bytes, &ctx);
+	p = &output[0];
+	for (i = 0; i < 16; ++i) {
+		sprintf(p, "%.2x", (int)hash_bytes[i]);
+		p += 2;
+	}
+	return output;
+}
+
 char*
 strescq(const char* input, char quote_char)
 {
@@ -43,6 +43,7 @@ int         fcopy                  (const char* src_filename, const char* dst_fi
 bool        fexist                 (const char* filename);
 void*       fslurp                 (const char* filename, size_t *out_size);
 bool        fspew                  (const void* buffer, size_t size, const char* filename);
+const char* md5sum                 (const void* data, size_t size);
 char*       strescq                (const char* input, char quote_char);
 char*       strfmt                 (const char* format, ...);
 char*       strnewf                (const char* fmt, ...);
@@ -33,16 +33,34 @@
 #include "cell.h"
 #include "visor.h"
 
-static void print_indent (int level);
+enum message_type
+{
+	MESSAGE_BEGIN_OP,
+	MESSAGE_END_OP,
+	MESSAGE_ERROR,
+	MESSAGE_INFO,
+	MESSAGE_WARN,
+};
+
+struct message
+{
+	enum message_type type;
+	char*             text;
+};
 
 struct visor
 {
 	vector_t* filenames;
 	int       indent_level;
+	vector_t* messages;
 	int       num_errors;
 	int       num_warns;
 };
 
+static void print_indent  (int level);
+static void print_message (visor_t* visor, enum message_type type, const char* text);
+static void queue_message (visor_t* visor, enum message_type type, const char* fmt, va_list ap);
+
 visor_t*
 visor_new(void)
 {
@@ -54,17 +72,62 @@ visor_new(void)
 	return visor;
 }
 
+visor_t*
+visor_fork(void)
+{
+	// note: a forked visor doesn't print anything itself, but saves its output to
+	//       be printed later by visor_join().  this allows work done on another
+	//       thread to report its progress without its output getting mixed up with
+	//       everything else.
+
+	visor_t* visor;
+
+	if (!(visor = visor_new()))
+		return NULL;
+	visor->messages = vector_new(sizeof(struct message));
+	return visor;
+}
+
 void
 visor_free(visor_t* visor)
 {
+	struct message* message;
+
 	int i;
 
+	if (visor == NULL)
+		return;
 	for (i = 0; i < vector_len(visor->filenames); ++i)
 		free(*(char**)vector_get(visor->filenames, i));
 	vector_free(visor->filenames);
+	if (visor->messages != NULL) {
+		for (i = 0; i < vector_len(visor->messages); ++i) {
+			message = vector_get(visor->messages, i);
+			free(message->text);
+		}
+		vector_free(visor->messages);
+	}
 	free(visor);
 }
 
+void
+visor_join(visor_t* visor, visor_t* fork)
+{
+	// note: this also frees the forked visor.
+
+	struct message* message;
+
+	int i;
+
+	for (i = 0; i < vector_len(fork->filenames); ++i)
+		visor_add_file(visor, *(char**)vector_get(fork->filenames, i));
+	for (i = 0; i < vector_len(fork->messages); ++i) {
+		message = vector_get(fork->messages, i);
+		print_message(visor, message->type, message->text);
+	}
+	visor_free(fork);
+}
+
 vector_t*
 visor_filenames(const visor_t* visor)
 {
@@ -98,19 +161,23 @@ visor_begin_op(visor_t* visor, const char* fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	print_indent(visor->indent_level);
-	vprintf(fmt, ap);
-	printf("...\n");
-	fflush(stdout);
+	queue_message(visor, MESSAGE_BEGIN_OP, fmt, ap);
 	va_end(ap);
-
-	++visor->indent_level;
 }
 
 void
 visor_end_op(visor_t* visor)
 {
-	--visor->indent_level;
+	struct message message;
+
+	if (visor->messages != NULL) {
+		message.type = MESSAGE_END_OP;
+		message.text = NULL;
+		vector_push(visor->messages, &message);
+	}
+	else {
+		print_message(visor, MESSAGE_END_OP, NULL);
+	}
 }
 
 void
@@ -119,14 +186,8 @@ visor_error(visor_t* visor, const char* fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	print_indent(visor->indent_level);
-	printf("E: ");
-	vprintf(fmt, ap);
-	printf("\n");
-	fflush(stdout);
+	queue_message(visor, MESSAGE_ERROR, fmt, ap);
 	va_end(ap);
-
-	++visor->num_errors;
 }
 
 void
@@ -135,11 +196,7 @@ visor_print(visor_t* visor, const char* fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	print_indent(visor->indent_level);
-	printf("i: ");
-	vprintf(fmt, ap);
-	printf("\n");
-	fflush(stdout);
+	queue_message(visor, MESSAGE_INFO, fmt, ap);
 	va_end(ap);
 }
 
@@ -168,17 +225,11 @@ visor_warn(visor_t* visor, const char* fmt, ...)
 	va_list ap;
 
 	va_start(ap, fmt);
-	print_indent(visor->indent_level);
-	printf("W: ");
-	vprintf(fmt, ap);
-	printf("\n");
-	fflush(stdout);
+	queue_message(visor, MESSAGE_WARN, fmt, ap);
 	va_end(ap);
-
-	++visor->num_warns;
 }
 
-void
+static void
 print_indent(int level)
 {
 	int i;
@@ -186,3 +237,64 @@ print_indent(int level)
 	for (i = 0; i < level; ++i)
 		printf("   ");
 }
+
+static void
+print_message(visor_t* visor, enum message_type type, const char* text)
+{
+	if (type == MESSAGE_END_OP) {
+		--visor->indent_level;
+		return;
+	}
+	print_indent(visor->indent_level);
+	switch (type) {
+	case MESSAGE_BEGIN_OP:
+		printf("%s...\n", text);
+		++visor->indent_level;
+		break;
+	case MESSAGE_ERROR:
+		printf("E: %s\n", text);
+		++visor->num_errors;
+		break;
+	case MESSAGE_INFO:
+		printf("i: %s\n", text);
+		break;
+	case MESSAGE_WARN:
+		printf("W: %s\n", text);
+		++visor->num_warns;
+		break;
+	default:
+		break;
+	}
+	fflush(stdout);
+}
+
+static void
+queue_message(visor_t* visor, enum message_type type, const char* fmt, va_list ap)
+{
+	struct message message;
+	va_list        ap_copy;
+	char*          text;
+	int            text_len;
+
+	va_copy(ap_copy, ap);
+	text_len = vsnprintf(NULL, 0, fmt, ap_copy);
+	va_end(ap_copy);
+	if (!(text = malloc(text_len + 1)))
+		return;
+	vsnprintf(text, text_len + 1, fmt, ap);
+	if (visor->messages != NULL) {
+		// forked visor: keep track of errors and warnings so callers can still check
+		// for them, but hold off on printing until the fork is joined.
+		if (type == MESSAGE_ERROR)
+			++visor->num_errors;
+		else if (type == MESSAGE_WARN)
+			++visor->num_warns;
+		message.type = type;
+		message.text = text;
+		vector_push(visor->messages, &message);
+	}
+	else {
+		print_message(visor, type, text);
+		free(text);
+	}
+}
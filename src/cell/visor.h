@@ -36,7 +36,9 @@
 typedef struct visor visor_t;
 
 visor_t*  visor_new        (void);
+visor_t*  visor_fork       (void);
 void      visor_free       (visor_t* visor);
+void      visor_join       (visor_t* visor, visor_t* fork);
 vector_t* visor_filenames  (const visor_t* visor);
 int       visor_num_errors (const visor_t* visor);
 int       visor_num_warns  (const visor_t* visor);
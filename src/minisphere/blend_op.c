@@ -33,6 +33,9 @@
 #include "minisphere.h"
 #include "blend_op.h"
 
+#include "galileo.h"
+#include "image.h"
+
 struct blend_op
 {
 	unsigned int  refcount;
@@ -45,8 +48,18 @@ struct blend_op
 	ALLEGRO_COLOR color;
 };
 
-static int get_allegro_blend_factor (blend_factor_t factor);
-static int get_allegro_blend_op     (blend_type_t type);
+static int  get_allegro_blend_factor (blend_factor_t factor);
+static int  get_allegro_blend_op     (blend_type_t type);
+static bool uses_const_color         (const blend_op_t* op);
+
+static const
+blend_op_t
+DEFAULT_BLEND_OP =
+{
+	0,
+	ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA,
+	ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA,
+};
 
 blend_op_t*
 blend_op_new_asym(blend_type_t color_op, blend_factor_t sfc, blend_factor_t tfc, blend_type_t alpha_op, blend_factor_t sfa, blend_factor_t tfa)
@@ -98,9 +111,36 @@ blend_op_unref(blend_op_t* it)
 	free(it);
 }
 
+bool
+blend_op_equal(const blend_op_t* it, const blend_op_t* other)
+{
+	// note: a NULL blend op means the default alpha blend, see blend_op_apply() below.
+	if (it == NULL)
+		it = &DEFAULT_BLEND_OP;
+	if (other == NULL)
+		other = &DEFAULT_BLEND_OP;
+	if (it == other)
+		return true;
+	if (it->color_op != other->color_op
+		|| it->color_s_factor != other->color_s_factor
+		|| it->color_t_factor != other->color_t_factor
+		|| it->alpha_op != other->alpha_op
+		|| it->alpha_s_factor != other->alpha_s_factor
+		|| it->alpha_t_factor != other->alpha_t_factor)
+	{
+		return false;
+	}
+	if (uses_const_color(it)) {
+		return it->color.r == other->color.r && it->color.g == other->color.g
+			&& it->color.b == other->color.b && it->color.a == other->color.a;
+	}
+	return true;
+}
+
 void
 blend_op_set_const(blend_op_t* it, float r, float g, float b, float a)
 {
+	galileo_flush();
 	it->color = al_map_rgba_f(r, g, b, a);
 }
 
@@ -141,3 +181,12 @@ get_allegro_blend_op(blend_type_t type)
 		: type == BLEND_OP_SUB ? ALLEGRO_DEST_MINUS_SRC
 		: ALLEGRO_ADD;
 }
+
+static bool
+uses_const_color(const blend_op_t* op)
+{
+	return op->color_s_factor == ALLEGRO_CONST_COLOR || op->color_s_factor == ALLEGRO_INVERSE_CONST_COLOR
+		|| op->color_t_factor == ALLEGRO_CONST_COLOR || op->color_t_factor == ALLEGRO_INVERSE_CONST_COLOR
+		|| op->alpha_s_factor == ALLEGRO_CONST_COLOR || op->alpha_s_factor == ALLEGRO_INVERSE_CONST_COLOR
+		|| op->alpha_t_factor == ALLEGRO_CONST_COLOR || op->alpha_t_factor == ALLEGRO_INVERSE_CONST_COLOR;
+}
@@ -64,6 +64,7 @@ blend_op_t* blend_op_new_asym  (blend_type_t color_op, blend_factor_t sfc, blend
 blend_op_t* blend_op_new_sym   (blend_type_t op_type, blend_factor_t sf, blend_factor_t tf);
 blend_op_t* blend_op_ref       (blend_op_t* it);
 void        blend_op_unref     (blend_op_t* it);
+bool        blend_op_equal     (const blend_op_t* it, const blend_op_t* other);
 void        blend_op_set_const (blend_op_t* it, float r, float g, float b, float a);
 void        blend_op_apply     (const blend_op_t* it);
 
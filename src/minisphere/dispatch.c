@@ -33,65 +33,125 @@
 #include "minisphere.h"
 #include "dispatch.h"
 
+#include "hashmap.h"
 #include "script.h"
 #include "vector.h"
 
+enum job_state
+{
+	JOB_QUEUED,
+	JOB_WAITING,
+	JOB_PAUSED,
+	JOB_RUNNING,
+	JOB_RECURRING,
+};
+
 struct job
 {
-	bool       background;
-	bool       critical;
-	bool       finished;
-	job_type_t hint;
-	double     priority;
-	bool       paused;
-	int        timer;
-	int64_t    token;
-	script_t*  script;
+	bool           background;
+	bool           critical;
+	int64_t        due_tick;
+	bool           finished;
+	int            heap_index;
+	job_type_t     hint;
+	double         priority;
+	bool           paused;
+	enum job_state state;
+	int            timer;
+	int64_t        token;
+	script_t*      script;
 };
 
-static struct job* job_from_token    (int64_t token);
-static void        recheck_busy_flag (void);
-static int         sort_jobs         (const void* in_a, const void* in_b);
+struct queue
+{
+	bool      need_sort;
+	int       next_ready;
+	int       num_active;
+	vector_t* ready;
+	vector_t* recurring;
+	int64_t   run_token;
+	int64_t   tick;
+	vector_t* timers;
+};
 
-static vector_t* s_exit_jobs;
-static bool      s_is_busy = false;
-static bool      s_need_sort = false;
-static int64_t   s_next_token = 1;
-static vector_t* s_onetime_jobs;
-static vector_t* s_recurring_jobs;
+static bool        add_job        (struct job* job);
+static void        free_job       (struct job* job);
+static struct job* job_from_token (int64_t token);
+static int64_t     next_tick      (const struct queue* queue, int64_t token);
+static struct job* pop_timer      (struct queue* queue);
+static void        push_timer     (struct queue* queue, struct job* job);
+static void        remove_timer   (struct queue* queue, struct job* job);
+static void        schedule_job   (struct queue* queue, struct job* job, int timeout);
+static void        sift_down      (struct queue* queue, int index);
+static void        sift_up        (struct queue* queue, int index);
+static int         sort_by_token  (const void* in_a, const void* in_b);
+static int         sort_jobs      (const void* in_a, const void* in_b);
+static bool        timer_before   (const struct job* job_a, const struct job* job_b);
+
+static hashmap_t*   s_jobs = NULL;
+static int64_t      s_next_token = 1;
+static int          s_num_busy_jobs = 0;
+static int          s_num_exit_jobs = 0;
+static int          s_num_onetime_jobs = 0;
+static struct queue s_queues[JOB_TYPE_MAX];
 
 void
 dispatch_init(void)
 {
+	int i;
+
 	console_log(1, "initializing dispatch manager");
-	s_onetime_jobs = vector_new(sizeof(struct job));
-	s_recurring_jobs = vector_new(sizeof(struct job));
-	s_exit_jobs = vector_new(sizeof(struct job));
 
-	// reserve extra slots for one-time jobs.  realloc() is fairly expensive
-	// and the one-time queue gets very heavy traffic.
-	vector_reserve(s_onetime_jobs, 32);
+	// note: each job type gets its own queues so that dispatch_run() never has to
+	//       look at jobs of a different type.  one-time jobs go into a FIFO when
+	//       they're ready to run; jobs with a delay wait in a min-heap ordered by
+	//       the tick they're due on.
+	memset(s_queues, 0, sizeof s_queues);
+	for (i = 0; i < JOB_TYPE_MAX; ++i) {
+		s_queues[i].ready = vector_new(sizeof(struct job*));
+		s_queues[i].recurring = vector_new(sizeof(struct job*));
+		s_queues[i].timers = vector_new(sizeof(struct job*));
+
+		// reserve extra slots for one-time jobs.  realloc() is fairly expensive
+		// and the one-time queues get very heavy traffic.
+		vector_reserve(s_queues[i].ready, 32);
+	}
+	s_jobs = hashmap_new(sizeof(struct job*));
 }
 
 void
 dispatch_uninit(void)
 {
+	iter_t iter;
+	int    i;
+
 	console_log(1, "shutting down dispatch manager");
-	vector_free(s_onetime_jobs);
-	vector_free(s_recurring_jobs);
-	vector_free(s_exit_jobs);
+
+	// note: by this point the JavaScript engine has already been shut down, so we
+	//       can't release the jobs' scripts.
+	iter = hashmap_enum(s_jobs);
+	while (iter_next(&iter))
+		free(*(struct job**)iter.ptr);
+	hashmap_free(s_jobs);
+	s_jobs = NULL;
+	for (i = 0; i < JOB_TYPE_MAX; ++i) {
+		vector_free(s_queues[i].ready);
+		vector_free(s_queues[i].recurring);
+		vector_free(s_queues[i].timers);
+	}
+	memset(s_queues, 0, sizeof s_queues);
 }
 
 bool
 dispatch_busy(void)
 {
-	return s_is_busy || vector_len(s_onetime_jobs) > 0;
+	return s_num_busy_jobs > 0 || s_num_onetime_jobs > 0;
 }
 
 bool
 dispatch_can_exit(void)
 {
-	return !dispatch_busy() && vector_len(s_exit_jobs) == 0;
+	return !dispatch_busy() && s_num_exit_jobs == 0;
 }
 
 void
@@ -101,10 +161,25 @@ dispatch_cancel(int64_t token)
 
 	if (!(job = job_from_token(token)))
 		return;
-	job->finished = true;
-
-	recheck_busy_flag();
-	s_need_sort = true;
+	switch (job->state) {
+	case JOB_RECURRING:
+		if (!job->finished && !job->background)
+			--s_num_busy_jobs;
+		job->finished = true;
+		break;
+	case JOB_WAITING:
+		remove_timer(&s_queues[job->hint], job);
+		free_job(job);
+		break;
+	case JOB_PAUSED:
+		free_job(job);
+		break;
+	default:
+		// job is in a ready queue or currently running; it will be freed when
+		// dispatch_run() gets to it.
+		job->finished = true;
+		break;
+	}
 }
 
 void
@@ -115,86 +190,129 @@ dispatch_cancel_all(bool recurring, bool also_critical)
 	//       which is probably not what you want to do.
 
 	struct job* job;
+	vector_t*   orphans;
 
 	iter_t iter;
 
-	iter = vector_enum(s_onetime_jobs);
-	while ((job = iter_next(&iter))) {
-		if (!job->critical || also_critical)
-			job->finished = true;
+	// jobs that aren't in a ready queue can be freed right away, but we can't do
+	// that while walking the token table since removing an entry may move others.
+	orphans = vector_new(sizeof(struct job*));
+	iter = hashmap_enum(s_jobs);
+	while (iter_next(&iter)) {
+		job = *(struct job**)iter.ptr;
+		if (job->state == JOB_RECURRING) {
+			if (recurring)
+				job->finished = true;
+		}
+		else if (!job->critical || also_critical) {
+			if (job->state == JOB_WAITING || job->state == JOB_PAUSED)
+				vector_push(orphans, &job);
+			else
+				job->finished = true;
+		}
 	}
-
-	iter = vector_enum(s_exit_jobs);
-	while ((job = iter_next(&iter))) {
-		if (!job->critical || also_critical)
-			job->finished = true;
+	iter = vector_enum(orphans);
+	while (iter_next(&iter)) {
+		job = *(struct job**)iter.ptr;
+		if (job->state == JOB_WAITING)
+			remove_timer(&s_queues[job->hint], job);
+		free_job(job);
 	}
+	vector_free(orphans);
 
-	if (recurring) {
-		iter = vector_enum(s_recurring_jobs);
-		while ((job = iter_next(&iter)))
-			job->finished = true;
-		s_need_sort = true;
-		s_is_busy = false;
-	}
+	// promise continuations live in JSAL's job queue rather than in the dispatch
+	// queues, so they need to be canceled separately.
+	if (also_critical)
+		jsal_cancel_jobs();
+
+	if (recurring)
+		s_num_busy_jobs = 0;
 }
 
 int64_t
 dispatch_defer(script_t* script, int timeout, job_type_t hint, bool critical)
 {
-	struct job job;
-	vector_t*  queue;
+	struct job* job;
 
-	if (s_onetime_jobs == NULL)
+	if (s_jobs == NULL)
+		return 0;
+	if (!(job = calloc(1, sizeof(struct job))))
 		return 0;
-	job.critical = critical;
-	job.finished = false;
-	job.hint = hint;
-	job.script = script;
-	job.paused = false;
-	job.timer = timeout;
-	job.token = s_next_token++;
-	queue = hint == JOB_ON_EXIT ? s_exit_jobs
-		: s_onetime_jobs;
-	vector_push(queue, &job);
-	return job.token;
+	job->critical = critical;
+	job->hint = hint;
+	job->script = script;
+	job->token = s_next_token++;
+	if (!add_job(job)) {
+		free(job);
+		return 0;
+	}
+
+	// note: a job's timer counts down once per dispatch_run() call for its type,
+	//       including the call in progress, if any.
+	schedule_job(&s_queues[hint], job, timeout);
+	if (hint == JOB_ON_EXIT)
+		++s_num_exit_jobs;
+	else
+		++s_num_onetime_jobs;
+	return job->token;
 }
 
 void
 dispatch_pause(int64_t token, bool paused)
 {
-	struct job* job;
+	struct job*   job;
+	struct queue* queue;
 
 	if (!(job = job_from_token(token)))
 		return;
+	if (job->state == JOB_RECURRING) {
+		job->paused = paused;
+		return;
+	}
+
+	// a paused job's timer doesn't run, so one-time jobs are taken out of the
+	// timer heap while paused and put back with whatever time they had left.
+	queue = &s_queues[job->hint];
 	job->paused = paused;
+	if (paused && job->state == JOB_WAITING) {
+		remove_timer(queue, job);
+		job->timer = (int)(job->due_tick - next_tick(queue, job->token));
+		job->state = JOB_PAUSED;
+	}
+	else if (!paused && job->state == JOB_PAUSED) {
+		schedule_job(queue, job, job->timer);
+	}
 }
 
 int64_t
 dispatch_recur(script_t* script, double priority, bool background, job_type_t hint)
 {
-	struct job job;
+	struct job* job;
 
-	if (s_recurring_jobs == NULL)
+	if (s_jobs == NULL)
 		return 0;
 	if (hint == JOB_ON_RENDER) {
 		// invert priority for render jobs.  this ensures higher priority jobs
 		// get rendered later in a frame, i.e. closer to the screen.
 		priority = -priority;
 	}
-	job.background = background;
-	job.finished = false;
-	job.hint = hint;
-	job.priority = priority;
-	job.script = script;
-	job.paused = false;
-	job.token = s_next_token++;
-	vector_push(s_recurring_jobs, &job);
-
-	recheck_busy_flag();
-	s_need_sort = true;
-
-	return job.token;
+	if (!(job = calloc(1, sizeof(struct job))))
+		return 0;
+	job->background = background;
+	job->hint = hint;
+	job->priority = priority;
+	job->script = script;
+	job->state = JOB_RECURRING;
+	job->token = s_next_token++;
+	if (!add_job(job)) {
+		free(job);
+		return 0;
+	}
+	vector_push(s_queues[hint].recurring, &job);
+	s_queues[hint].need_sort = true;
+	if (!background)
+		++s_num_busy_jobs;
+	return job->token;
 }
 
 bool
@@ -202,106 +320,287 @@ dispatch_run(job_type_t hint)
 {
 	static unsigned int last_call_id = 0;
 
-	unsigned int call_id;
-	struct job*  job;
-	vector_t*    queue;
+	unsigned int  call_id;
+	struct job*   job;
+	int           num_left;
+	struct queue* queue;
 
-	int i;
+	int i, j;
 
 	// each call to `dispatch_run` gets a unique call ID.  this is used to detect
 	// reentrancy: if at any time `call_id` differs from `last_call_id`, that means another
 	// call to `dispatch_run` happened before this one returned.
 	call_id = ++last_call_id;
 
-	if (s_need_sort) {
-		vector_sort(s_recurring_jobs, sort_jobs);
-		s_need_sort = false;
+	queue = &s_queues[hint];
+	++queue->tick;
+	++queue->num_active;
+	queue->run_token = 0;
+
+	if (queue->need_sort) {
+		vector_sort(queue->recurring, sort_jobs);
+		queue->need_sort = false;
 	}
 
 	// process recurring jobs
-	for (i = 0; i < vector_len(s_recurring_jobs); ++i) {
-		job = (struct job*)vector_get(s_recurring_jobs, i);
-		if (job->hint != hint)
-			continue;
+	for (i = 0; i < vector_len(queue->recurring); ++i) {
+		job = *(struct job**)vector_get(queue->recurring, i);
 		if (!job->paused && !job->finished)
-			script_run(job->script, false);  // invalidates job pointer
-		if (last_call_id == call_id) {
-			job = (struct job*)vector_get(s_recurring_jobs, i);
-			if (job->finished) {
-				script_unref(job->script);
-				vector_remove(s_recurring_jobs, i--);
-			}
-		}
-		else {
+			script_run(job->script, false);
+		if (last_call_id != call_id) {
 			// reentrancy detected; bail out since it's unsafe to continue
-			return false;
+			goto reentered;
 		}
 	}
+	for (i = 0, j = 0; i < vector_len(queue->recurring); ++i) {
+		job = *(struct job**)vector_get(queue->recurring, i);
+		if (job->finished)
+			free_job(job);
+		else
+			vector_put(queue->recurring, j++, &job);
+	}
+	vector_resize(queue->recurring, j);
+
+	// promise continuations are run as part of the tick queue, after recurring jobs
+	// and before one-time jobs.  any continuations queued by a one-time job are run
+	// before moving on to the next one.
+	if (hint == JOB_ON_TICK) {
+		jsal_run_jobs();
+		if (last_call_id != call_id)
+			goto reentered;
+	}
+
+	// move any delayed jobs which have come due into the ready queue.  the ready
+	// queue is kept in token order so that jobs still run first-in, first-out.
+	if (vector_len(queue->timers) > 0
+		&& (*(struct job**)vector_get(queue->timers, 0))->due_tick <= queue->tick)
+	{
+		num_left = vector_len(queue->ready) - queue->next_ready;
+		for (i = 0; i < num_left; ++i)
+			vector_put(queue->ready, i, vector_get(queue->ready, queue->next_ready + i));
+		vector_resize(queue->ready, num_left);
+		queue->next_ready = 0;
+		while (vector_len(queue->timers) > 0
+			&& (*(struct job**)vector_get(queue->timers, 0))->due_tick <= queue->tick)
+		{
+			job = pop_timer(queue);
+			job->state = JOB_QUEUED;
+			vector_push(queue->ready, &job);
+		}
+		vector_sort(queue->ready, sort_by_token);
+	}
 
 	// process one-time jobs
-	queue = hint == JOB_ON_EXIT ? s_exit_jobs
-		: s_onetime_jobs;
-	for (i = 0; i < vector_len(queue); ++i) {
-		job = (struct job*)vector_get(queue, i);
-		if (job->hint != hint)
+	while (queue->next_ready < vector_len(queue->ready)) {
+		job = *(struct job**)vector_get(queue->ready, queue->next_ready++);
+		if (job->finished) {
+			free_job(job);
 			continue;
-		if (!job->paused && job->timer-- <= 0 && !job->finished) {
-			job->finished = true;
-			script_run(job->script, false);  // invalidates job pointer
 		}
-		if (last_call_id == call_id) {
-			job = (struct job*)vector_get(queue, i);
-			if (job->finished) {
-				script_unref(job->script);
-				vector_remove(queue, i--);
-			}
+		if (job->paused) {
+			job->state = JOB_PAUSED;
+			job->timer = 0;
+			queue->run_token = job->token;
+			continue;
 		}
-		else {
+		job->state = JOB_RUNNING;
+		job->finished = true;
+		queue->run_token = job->token;
+		script_run(job->script, false);
+		free_job(job);
+		if (hint == JOB_ON_TICK)
+			jsal_run_jobs();
+		if (last_call_id != call_id) {
 			// reentrancy detected; bail out since it's unsafe to continue
-			return false;
+			goto reentered;
 		}
 	}
+	vector_clear(queue->ready);
+	queue->next_ready = 0;
 
+	--queue->num_active;
 	return true;
+
+reentered:
+	--queue->num_active;
+	return false;
+}
+
+static bool
+add_job(struct job* job)
+{
+	// note: tokens are unique, so there's no need to check for an existing entry.
+	return hashmap_put(s_jobs, &job->token, sizeof(int64_t), &job) != NULL;
+}
+
+static void
+free_job(struct job* job)
+{
+	hashmap_remove(s_jobs, &job->token, sizeof(int64_t));
+	if (job->state != JOB_RECURRING) {
+		if (job->hint == JOB_ON_EXIT)
+			--s_num_exit_jobs;
+		else
+			--s_num_onetime_jobs;
+	}
+	script_unref(job->script);
+	free(job);
 }
 
 static struct job*
 job_from_token(int64_t token)
+{
+	struct job** job_ptr;
+
+	if (s_jobs == NULL)
+		return NULL;
+	if (!(job_ptr = hashmap_get(s_jobs, &token, sizeof(int64_t))))
+		return NULL;
+	return *job_ptr;
+}
+
+static int64_t
+next_tick(const struct queue* queue, int64_t token)
+{
+	// note: this is the tick on which dispatch_run() will next look at a job.  if
+	//       a run is in progress, jobs are looked at in token order, so a job
+	//       which comes before the one currently running has missed its chance.
+
+	if (queue->num_active > 0 && token > queue->run_token)
+		return queue->tick;
+	return queue->tick + 1;
+}
+
+static struct job*
+pop_timer(struct queue* queue)
 {
 	struct job* job;
 
-	iter_t iter;
+	job = *(struct job**)vector_get(queue->timers, 0);
+	remove_timer(queue, job);
+	return job;
+}
+
+static void
+push_timer(struct queue* queue, struct job* job)
+{
+	job->heap_index = vector_len(queue->timers);
+	vector_push(queue->timers, &job);
+	sift_up(queue, job->heap_index);
+}
+
+static void
+remove_timer(struct queue* queue, struct job* job)
+{
+	struct job* last_job;
+	int         index;
+
+	index = job->heap_index;
+	last_job = *(struct job**)vector_get(queue->timers, vector_len(queue->timers) - 1);
+	vector_pop(queue->timers, 1);
+	if (last_job == job)
+		return;
+	last_job->heap_index = index;
+	vector_put(queue->timers, index, &last_job);
+	sift_up(queue, index);
+	sift_down(queue, last_job->heap_index);
+}
 
-	iter = vector_enum(s_recurring_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+static void
+schedule_job(struct queue* queue, struct job* job, int timeout)
+{
+	int64_t     due_tick;
+	int         hi;
+	int         lo;
+	int         mid;
+	struct job* other;
+	int64_t     run_tick;
+
+	// a job which is due before the ready queue is next emptied can go straight
+	// into it.  anything else waits in the timer heap.
+	due_tick = next_tick(queue, job->token) + (timeout > 0 ? timeout : 0);
+	run_tick = queue->num_active > 0 ? queue->tick : queue->tick + 1;
+	if (due_tick <= run_tick) {
+		// the ready queue is in token order.  new jobs always go at the end, but a
+		// job being unpaused may need to go somewhere in the middle.
+		job->state = JOB_QUEUED;
+		lo = queue->next_ready;
+		hi = vector_len(queue->ready);
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			other = *(struct job**)vector_get(queue->ready, mid);
+			if (other->token < job->token)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		vector_insert(queue->ready, lo, &job);
 	}
-	iter = vector_enum(s_onetime_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+	else {
+		job->state = JOB_WAITING;
+		job->due_tick = due_tick;
+		push_timer(queue, job);
 	}
-	iter = vector_enum(s_exit_jobs);
-	while ((job = iter_next(&iter))) {
-		if (token == job->token)
-			return job;
+}
+
+static void
+sift_down(struct queue* queue, int index)
+{
+	struct job* child;
+	int         child_index;
+	struct job* job;
+	int         num_jobs;
+
+	num_jobs = vector_len(queue->timers);
+	job = *(struct job**)vector_get(queue->timers, index);
+	while ((child_index = index * 2 + 1) < num_jobs) {
+		child = *(struct job**)vector_get(queue->timers, child_index);
+		if (child_index + 1 < num_jobs
+			&& timer_before(*(struct job**)vector_get(queue->timers, child_index + 1), child))
+		{
+			child = *(struct job**)vector_get(queue->timers, ++child_index);
+		}
+		if (!timer_before(child, job))
+			break;
+		child->heap_index = index;
+		vector_put(queue->timers, index, &child);
+		index = child_index;
 	}
-	return NULL;
+	job->heap_index = index;
+	vector_put(queue->timers, index, &job);
 }
 
 static void
-recheck_busy_flag(void)
+sift_up(struct queue* queue, int index)
 {
 	struct job* job;
+	struct job* parent;
+	int         parent_index;
+
+	job = *(struct job**)vector_get(queue->timers, index);
+	while (index > 0) {
+		parent_index = (index - 1) / 2;
+		parent = *(struct job**)vector_get(queue->timers, parent_index);
+		if (!timer_before(job, parent))
+			break;
+		parent->heap_index = index;
+		vector_put(queue->timers, index, &parent);
+		index = parent_index;
+	}
+	job->heap_index = index;
+	vector_put(queue->timers, index, &job);
+}
 
-	iter_t iter;
+static int
+sort_by_token(const void* in_a, const void* in_b)
+{
+	const struct job* job_a;
+	const struct job* job_b;
 
-	// check for recurring jobs that should keep the event loop alive
-	s_is_busy = false;
-	iter = vector_enum(s_recurring_jobs);
-	while ((job = iter_next(&iter)))
-		s_is_busy |= !job->finished && !job->background;
+	job_a = *(const struct job**)in_a;
+	job_b = *(const struct job**)in_b;
+	return job_a->token < job_b->token ? -1 : job_a->token > job_b->token ? 1
+		: 0;
 }
 
 static int
@@ -316,11 +615,18 @@ sort_jobs(const void* in_a, const void* in_b)
 	struct job* job_a;
 	struct job* job_b;
 
-	job_a = (struct job*)in_a;
-	job_b = (struct job*)in_b;
+	job_a = *(struct job**)in_a;
+	job_b = *(struct job**)in_b;
 	delta = job_b->priority - job_a->priority;
 	fifo_delta = job_a->token - job_b->token;
 	return delta < 0.0 ? -1 : delta > 0.0 ? 1
 		: fifo_delta < 0 ? -1 : fifo_delta > 0 ? 1
 		: 0;
 }
+
+static bool
+timer_before(const struct job* job_a, const struct job* job_b)
+{
+	return job_a->due_tick < job_b->due_tick
+		|| (job_a->due_tick == job_b->due_tick && job_a->token < job_b->token);
+}
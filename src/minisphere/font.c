@@ -34,11 +34,30 @@
 #include "font.h"
 
 #include "color.h"
+#include "hashmap.h"
 #include "image.h"
 #include "unicode.h"
 
-static bool do_multiline_text_line (int line_idx, const char* line, int size, void* userdata);
-static void update_font_metrics    (font_t* font);
+// strings which are drawn, measured or wrapped are laid out once and the result kept in
+// a cache shared by all fonts, so that text redrawn every frame (e.g. a menu) doesn't need
+// to be decoded from scratch each time.  the least recently used entry is evicted when
+// the cache fills up.  very long strings bypass the cache entirely.
+#define TEXT_CACHE_SIZE       128
+#define TEXT_CACHE_MAX_LENGTH 1024
+
+struct cached_text;
+
+static bool                do_multiline_text_line (int line_idx, const char* line, int size, void* userdata);
+static void                free_cached_text       (struct cached_text* entry);
+static struct cached_text* get_layout             (const font_t* font, const char* text);
+static uint32_t            glyph_index_of         (const font_t* font, uint32_t cp);
+static uint32_t            hash_text              (unsigned int font_id, const char* text, int wrap_width);
+static bool                layout_text            (const font_t* font, const char* text, struct cached_text* entry);
+static struct cached_text* lookup_text            (const font_t* font, const char* text, int wrap_width, bool add_it);
+static int                 measure_text           (const font_t* font, const char* text);
+static void                purge_text_cache       (unsigned int font_id);
+static void                update_font_metrics    (font_t* font);
+static wraptext_t*         wrap_text              (const font_t* font, const char* text, int width);
 
 struct font
 {
@@ -78,6 +97,38 @@ struct wraptext
 	size_t pitch;
 };
 
+struct cached_text
+{
+	unsigned int font_id;
+	uint32_t*    glyphs;
+	uint32_t     hash;
+	unsigned int last_used;
+	int          num_glyphs;
+	char*        text;
+	int          width;
+	int          wrap_width;
+	wraptext_t*  wraptext;
+};
+
+// CP1252 characters in the 0x80-0x9F range, which are mapped to other codepoints in
+// Unicode.  RFN fonts store them at their CP1252 positions.  sorted by codepoint.
+static const
+struct cp1252_glyph
+{
+	uint16_t codepoint;
+	uint8_t  glyph_index;
+}
+CP1252_GLYPHS[] =
+{
+	{ 0x0152, 140 }, { 0x0153, 156 }, { 0x0160, 138 }, { 0x0161, 154 },
+	{ 0x0178, 159 }, { 0x017D, 142 }, { 0x017E, 158 }, { 0x0192, 131 },
+	{ 0x02C6, 136 }, { 0x02DC, 152 }, { 0x2013, 150 }, { 0x2014, 151 },
+	{ 0x2018, 145 }, { 0x2019, 146 }, { 0x201A, 130 }, { 0x201C, 147 },
+	{ 0x201D, 148 }, { 0x201E, 132 }, { 0x2020, 134 }, { 0x2021, 135 },
+	{ 0x2022, 149 }, { 0x2026, 133 }, { 0x2030, 137 }, { 0x2039, 139 },
+	{ 0x203A, 155 }, { 0x20AC, 128 }, { 0x2122, 153 },
+};
+
 #pragma pack(push, 1)
 struct rfn_header
 {
@@ -95,8 +146,10 @@ struct rfn_glyph_header
 };
 #pragma pack(pop)
 
-static unsigned int s_next_font_id = 1;
-static unsigned int s_next_ttf_id = 1;
+static unsigned int       s_next_font_id = 1;
+static unsigned int       s_next_ttf_id = 1;
+static struct cached_text s_text_cache[TEXT_CACHE_SIZE];
+static unsigned int       s_text_clock = 0;
 
 font_t*
 font_load(const char* filename)
@@ -290,6 +343,7 @@ font_unref(font_t* it)
 		return;
 
 	console_log(3, "disposing font #%u no longer in use", it->id);
+	purge_text_cache(it->id);
 	for (i = 0; i < it->num_glyphs; ++i)
 		image_unref(it->glyphs[i].image);
 	free(it->glyphs);
@@ -329,6 +383,7 @@ font_set_glyph(font_t* it, uint32_t cp, image_t* image)
 	it->glyphs[cp].image = image_ref(image);
 	image_unref(old_image);
 	it->modified = true;
+	purge_text_cache(it->id);
 }
 
 void
@@ -340,66 +395,47 @@ font_set_mask(font_t* it, color_t color)
 void
 font_draw_text(font_t* it, int x, int y, text_align_t alignment, const char* text)
 {
-	uint32_t       cp;
-	utf8_ret_t     ret;
-	int            tab_width;
-	utf8_decode_t* utf8;
+	uint32_t            cp;
+	struct cached_text* layout;
+	struct cached_text  scratch;
+	int                 tab_width;
+
+	int i;
 
 	if (it->modified)
 		update_font_metrics(it);
 
+	// note: if the string can't be cached, lay it out into a scratch entry which is
+	//       thrown away afterwards.
+	if (!(layout = get_layout(it, text))) {
+		memset(&scratch, 0, sizeof(struct cached_text));
+		if (!layout_text(it, text, &scratch))
+			return;
+		layout = &scratch;
+	}
+
 	if (alignment == TEXT_ALIGN_CENTER)
-		x -= font_get_width(it, text) / 2;
+		x -= layout->width / 2;
 	else if (alignment == TEXT_ALIGN_RIGHT)
-		x -= font_get_width(it, text);
+		x -= layout->width;
 
+	// all glyphs for an RFN font are sliced from a single atlas, so with drawing held
+	// Allegro sends the whole string to the GPU in one batch.
 	tab_width = it->glyphs[' '].width * 3;
 	al_hold_bitmap_drawing(true);
-	utf8 = utf8_decode_start(true);
-	do {
-		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
-		if (ret == UTF8_RETRY)
-			--text;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < it->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		if (cp == '\t')
+	for (i = 0; i < layout->num_glyphs; ++i) {
+		cp = layout->glyphs[i];
+		if (cp == '\t') {
 			x += tab_width;
-		else if (cp != '\0') {
+		}
+		else {
 			image_draw_masked(it->glyphs[cp].image, it->color_mask, x, y);
 			x += it->glyphs[cp].width;
 		}
-	} while (cp != '\0');
-	utf8_decode_end(utf8);
+	}
 	al_hold_bitmap_drawing(false);
+	if (layout == &scratch)
+		free_cached_text(&scratch);
 }
 
 void
@@ -416,197 +452,43 @@ font_get_metrics(const font_t* it, int* out_min_width, int* out_max_width, int*
 int
 font_get_width(const font_t* it, const char* text)
 {
-	uint32_t       cp;
-	utf8_ret_t     ret;
-	utf8_decode_t* utf8;
-	int            width = 0;
+	struct cached_text* layout;
 
-	utf8 = utf8_decode_start(true);
-	do {
-		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
-		if (ret == UTF8_RETRY)
-			--text;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < it->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		if (cp != '\0')
-			width += it->glyphs[cp].width;
-	} while (cp != '\0');
-	utf8_decode_end(utf8);
-	return width;
+	if (!(layout = get_layout(it, text)))
+		return measure_text(it, text);
+	return layout->width;
 }
 
 wraptext_t*
 font_wrap(const font_t* font, const char* text, int width)
 {
-	char*          buffer = NULL;
-	uint8_t        ch_byte;
-	char*          carry;
-	size_t         ch_size;
-	uint32_t       cp;
-	int            glyph_width;
-	bool           is_line_end = false;
-	int            line_idx;
-	int            line_width;
-	int            max_lines = 10;
-	char*          last_break;
-	char*          last_space;
-	char*          last_tab;
-	char*          line_buffer;
-	size_t         line_length;
-	char*          new_buffer;
-	size_t         pitch;
-	utf8_ret_t     ret;
-	utf8_decode_t* utf8;
-	wraptext_t*    wraptext;
-	const char     *p, *start;
-
+	struct cached_text* entry;
+	char*               buffer;
+	wraptext_t*         wraptext;
+
+	// note: callers own the wraptext_t they get back and free it when they're done,
+	//       so hand out a copy of the cached one.
+	if (width < 0)
+		return wrap_text(font, text, width);  // -1 is reserved for plain layouts
+	if (!(entry = lookup_text(font, text, width, false))) {
+		if (!(wraptext = wrap_text(font, text, width)))
+			return NULL;
+		if (!(entry = lookup_text(font, text, width, true)))
+			return wraptext;  // couldn't cache it, hand out the original
+		entry->wraptext = wraptext;
+	}
 	if (!(wraptext = calloc(1, sizeof(wraptext_t))))
-		goto on_error;
-
-	// allocate initial buffer
-	font_get_metrics(font, &glyph_width, NULL, NULL);
-	pitch = 4 * (glyph_width > 0 ? width / glyph_width : width) + 3;
-	if (!(buffer = malloc(max_lines * pitch)))
-		goto on_error;
-	carry = malloc(pitch);
-
-	// run through one character at a time, carrying as necessary
-	line_buffer = buffer; line_buffer[0] = '\0';
-	line_idx = 0; line_width = 0; line_length = 0;
-	memset(line_buffer, 0, pitch);  // fill line with NULs
-	utf8 = utf8_decode_start(true);
-	p = text;
-	do {
-		start = p;
-		while ((ret = utf8_decode_next(utf8, ch_byte = *p++, &cp)) == UTF8_CONTINUE);
-		if (ret == UTF8_RETRY)
-			--p;
-		ch_size = p - start;
-		cp = cp == 0x20AC ? 128
-			: cp == 0x201A ? 130
-			: cp == 0x0192 ? 131
-			: cp == 0x201E ? 132
-			: cp == 0x2026 ? 133
-			: cp == 0x2020 ? 134
-			: cp == 0x2021 ? 135
-			: cp == 0x02C6 ? 136
-			: cp == 0x2030 ? 137
-			: cp == 0x0160 ? 138
-			: cp == 0x2039 ? 139
-			: cp == 0x0152 ? 140
-			: cp == 0x017D ? 142
-			: cp == 0x2018 ? 145
-			: cp == 0x2019 ? 146
-			: cp == 0x201C ? 147
-			: cp == 0x201D ? 148
-			: cp == 0x2022 ? 149
-			: cp == 0x2013 ? 150
-			: cp == 0x2014 ? 151
-			: cp == 0x02DC ? 152
-			: cp == 0x2122 ? 153
-			: cp == 0x0161 ? 154
-			: cp == 0x203A ? 155
-			: cp == 0x0153 ? 156
-			: cp == 0x017E ? 158
-			: cp == 0x0178 ? 159
-			: cp;
-		cp = ret == UTF8_CODEPOINT
-			? cp < (uint32_t)font->num_glyphs ? cp : 0x1A
-			: 0x1A;
-		switch (cp) {
-		case '\n': case '\r':  // explicit newline
-			if (cp == '\r' && *p == '\n')
-				++text;  // CRLF
-			is_line_end = true;
-			break;
-		case '\t':  // tab
-			line_buffer[line_length++] = cp;
-			line_width += font_get_width(font, "   ");
-			is_line_end = false;
-			break;
-		case '\0':  // NUL terminator
-			is_line_end = line_length > 0;  // commit last line on EOT
-			break;
-		default:  // default case, copy character as-is
-			memcpy(line_buffer + line_length, start, ch_size);
-			line_length += ch_size;
-			line_width += font->glyphs[cp].width;
-			is_line_end = false;
-		}
-		if (is_line_end)
-			carry[0] = '\0';
-		if (line_width > width || line_length >= pitch - 1) {
-			// wrap width exceeded, carry current word to next line
-			is_line_end = true;
-			last_space = strrchr(line_buffer, ' ');
-			last_tab = strrchr(line_buffer, '\t');
-			last_break = last_space > last_tab ? last_space : last_tab;
-			if (last_break != NULL)  // word break (space or tab) found
-				strcpy(carry, last_break + 1);
-			else  // no word break, so just carry last character
-				sprintf(carry, "%c", line_buffer[line_length - 1]);
-			line_buffer[line_length - strlen(carry)] = '\0';
-		}
-		if (is_line_end) {
-			// do we need to enlarge the buffer?
-			if (++line_idx >= max_lines) {
-				max_lines *= 2;
-				if (!(new_buffer = realloc(buffer, max_lines * pitch)))
-					goto on_error;
-				buffer = new_buffer;
-				line_buffer = buffer + line_idx * pitch;
-			}
-			else {
-				line_buffer += pitch;
-			}
-
-			memset(line_buffer, 0, pitch);  // fill line with NULs
-
-			// copy carry text into new line
-			line_width = font_get_width(font, carry);
-			line_length = strlen(carry);
-			strcpy(line_buffer, carry);
-		}
-	} while (cp != '\0');
-	free(carry);
-	wraptext->num_lines = line_idx;
+		return NULL;
+	if (!(buffer = malloc((entry->wraptext->num_lines + 1) * entry->wraptext->pitch))) {
+		free(wraptext);
+		return NULL;
+	}
+	memcpy(buffer, entry->wraptext->buffer, (entry->wraptext->num_lines + 1) * entry->wraptext->pitch);
 	wraptext->buffer = buffer;
-	wraptext->pitch = pitch;
+	wraptext->max_lines = entry->wraptext->num_lines + 1;
+	wraptext->num_lines = entry->wraptext->num_lines;
+	wraptext->pitch = entry->wraptext->pitch;
 	return wraptext;
-
-on_error:
-	free(buffer);
-	free(wraptext);
-	return NULL;
 }
 
 ttf_t*
@@ -834,6 +716,195 @@ do_multiline_text_line(int line_idx, const char* line, int size, void* userdata)
 	return true;
 }
 
+static void
+free_cached_text(struct cached_text* entry)
+{
+	free(entry->glyphs);
+	free(entry->text);
+	wraptext_free(entry->wraptext);
+	memset(entry, 0, sizeof(struct cached_text));
+}
+
+static struct cached_text*
+get_layout(const font_t* font, const char* text)
+{
+	struct cached_text* entry;
+
+	if ((entry = lookup_text(font, text, -1, false)))
+		return entry;
+	if (!(entry = lookup_text(font, text, -1, true)))
+		return NULL;
+	if (!layout_text(font, text, entry)) {
+		free_cached_text(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+static uint32_t
+glyph_index_of(const font_t* font, uint32_t cp)
+{
+	int hi;
+	int lo = 0;
+	int mid;
+	int num_entries;
+
+	// note: nothing below U+0152 is remapped, which covers all of ASCII and Latin-1,
+	//       so most characters skip the search altogether.
+	if (cp >= CP1252_GLYPHS[0].codepoint) {
+		num_entries = sizeof CP1252_GLYPHS / sizeof CP1252_GLYPHS[0];
+		hi = num_entries;
+		while (lo < hi) {
+			mid = (lo + hi) / 2;
+			if (CP1252_GLYPHS[mid].codepoint < cp)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo < num_entries && CP1252_GLYPHS[lo].codepoint == cp)
+			cp = CP1252_GLYPHS[lo].glyph_index;
+	}
+	return cp < font->num_glyphs ? cp : 0x1A;
+}
+
+static uint32_t
+hash_text(unsigned int font_id, const char* text, int wrap_width)
+{
+	struct {
+		uint32_t     text_hash;
+		unsigned int font_id;
+		int          wrap_width;
+	} key;
+
+	// note: the key is zero-filled first so that any padding bytes hash consistently.
+	memset(&key, 0, sizeof key);
+	key.text_hash = fnv1a(text, strlen(text));
+	key.font_id = font_id;
+	key.wrap_width = wrap_width;
+	return fnv1a(&key, sizeof key);
+}
+
+static bool
+layout_text(const font_t* font, const char* text, struct cached_text* entry)
+{
+	uint32_t       cp;
+	uint32_t*      glyphs;
+	int            max_glyphs;
+	uint32_t*      new_glyphs;
+	int            num_glyphs = 0;
+	utf8_ret_t     ret;
+	utf8_decode_t* utf8;
+	int            width = 0;
+
+	max_glyphs = (int)strlen(text) + 1;
+	if (!(glyphs = malloc(max_glyphs * sizeof(uint32_t))))
+		return false;
+	utf8 = utf8_decode_start(true);
+	do {
+		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
+		if (ret == UTF8_RETRY)
+			--text;
+		cp = ret == UTF8_CODEPOINT ? glyph_index_of(font, cp) : 0x1A;
+		if (cp != '\0') {
+			if (num_glyphs >= max_glyphs) {
+				max_glyphs *= 2;
+				if (!(new_glyphs = realloc(glyphs, max_glyphs * sizeof(uint32_t))))
+					goto on_error;
+				glyphs = new_glyphs;
+			}
+			glyphs[num_glyphs++] = cp;
+			width += font->glyphs[cp].width;
+		}
+	} while (cp != '\0');
+	utf8_decode_end(utf8);
+	entry->glyphs = glyphs;
+	entry->num_glyphs = num_glyphs;
+	entry->width = width;
+	return true;
+
+on_error:
+	utf8_decode_end(utf8);
+	free(glyphs);
+	return false;
+}
+
+static struct cached_text*
+lookup_text(const font_t* font, const char* text, int wrap_width, bool add_it)
+{
+	// note: wrapped text is filed under the wrap width; plain layouts use -1.
+
+	struct cached_text* entry;
+	uint32_t            hash;
+	struct cached_text* victim = NULL;
+
+	int i;
+
+	if (strlen(text) > TEXT_CACHE_MAX_LENGTH)
+		return NULL;
+	hash = hash_text(font->id, text, wrap_width);
+	for (i = 0; i < TEXT_CACHE_SIZE; ++i) {
+		entry = &s_text_cache[i];
+		if (victim == NULL || (victim->text != NULL
+			&& (entry->text == NULL || entry->last_used < victim->last_used)))
+		{
+			victim = entry;
+		}
+		if (entry->text == NULL || entry->hash != hash)
+			continue;
+		if (entry->font_id == font->id && entry->wrap_width == wrap_width
+			&& strcmp(entry->text, text) == 0)
+		{
+			entry->last_used = ++s_text_clock;
+			return entry;
+		}
+	}
+	if (!add_it)
+		return NULL;
+
+	// not found, evict the least recently used entry (or take an empty one) to make
+	// room for it.
+	free_cached_text(victim);
+	if (!(victim->text = strdup(text)))
+		return NULL;
+	victim->font_id = font->id;
+	victim->hash = hash;
+	victim->last_used = ++s_text_clock;
+	victim->wrap_width = wrap_width;
+	return victim;
+}
+
+static int
+measure_text(const font_t* font, const char* text)
+{
+	uint32_t       cp;
+	utf8_ret_t     ret;
+	utf8_decode_t* utf8;
+	int            width = 0;
+
+	utf8 = utf8_decode_start(true);
+	do {
+		while ((ret = utf8_decode_next(utf8, *text++, &cp)) == UTF8_CONTINUE);
+		if (ret == UTF8_RETRY)
+			--text;
+		cp = ret == UTF8_CODEPOINT ? glyph_index_of(font, cp) : 0x1A;
+		if (cp != '\0')
+			width += font->glyphs[cp].width;
+	} while (cp != '\0');
+	utf8_decode_end(utf8);
+	return width;
+}
+
+static void
+purge_text_cache(unsigned int font_id)
+{
+	int i;
+
+	for (i = 0; i < TEXT_CACHE_SIZE; ++i) {
+		if (s_text_cache[i].text != NULL && s_text_cache[i].font_id == font_id)
+			free_cached_text(&s_text_cache[i]);
+	}
+}
+
 static void
 update_font_metrics(font_t* font)
 {
@@ -853,5 +924,122 @@ update_font_metrics(font_t* font)
 	font->max_width = max_x;
 	font->height = max_y;
 
+	// glyph widths may have changed, so any cached layouts are now stale
+	purge_text_cache(font->id);
 	font->modified = false;
 }
+
+static wraptext_t*
+wrap_text(const font_t* font, const char* text, int width)
+{
+	char*          buffer = NULL;
+	uint8_t        ch_byte;
+	char*          carry;
+	size_t         ch_size;
+	uint32_t       cp;
+	int            glyph_width;
+	bool           is_line_end = false;
+	int            line_idx;
+	int            line_width;
+	int            max_lines = 10;
+	char*          last_break;
+	char*          last_space;
+	char*          last_tab;
+	char*          line_buffer;
+	size_t         line_length;
+	char*          new_buffer;
+	size_t         pitch;
+	utf8_ret_t     ret;
+	utf8_decode_t* utf8;
+	wraptext_t*    wraptext;
+	const char     *p, *start;
+
+	if (!(wraptext = calloc(1, sizeof(wraptext_t))))
+		goto on_error;
+
+	// allocate initial buffer
+	font_get_metrics(font, &glyph_width, NULL, NULL);
+	pitch = 4 * (glyph_width > 0 ? width / glyph_width : width) + 3;
+	if (!(buffer = malloc(max_lines * pitch)))
+		goto on_error;
+	carry = malloc(pitch);
+
+	// run through one character at a time, carrying as necessary
+	line_buffer = buffer; line_buffer[0] = '\0';
+	line_idx = 0; line_width = 0; line_length = 0;
+	memset(line_buffer, 0, pitch);  // fill line with NULs
+	utf8 = utf8_decode_start(true);
+	p = text;
+	do {
+		start = p;
+		while ((ret = utf8_decode_next(utf8, ch_byte = *p++, &cp)) == UTF8_CONTINUE);
+		if (ret == UTF8_RETRY)
+			--p;
+		ch_size = p - start;
+		cp = ret == UTF8_CODEPOINT ? glyph_index_of(font, cp) : 0x1A;
+		switch (cp) {
+		case '\n': case '\r':  // explicit newline
+			if (cp == '\r' && *p == '\n')
+				++text;  // CRLF
+			is_line_end = true;
+			break;
+		case '\t':  // tab
+			line_buffer[line_length++] = cp;
+			line_width += measure_text(font, "   ");
+			is_line_end = false;
+			break;
+		case '\0':  // NUL terminator
+			is_line_end = line_length > 0;  // commit last line on EOT
+			break;
+		default:  // default case, copy character as-is
+			memcpy(line_buffer + line_length, start, ch_size);
+			line_length += ch_size;
+			line_width += font->glyphs[cp].width;
+			is_line_end = false;
+		}
+		if (is_line_end)
+			carry[0] = '\0';
+		if (line_width > width || line_length >= pitch - 1) {
+			// wrap width exceeded, carry current word to next line
+			is_line_end = true;
+			last_space = strrchr(line_buffer, ' ');
+			last_tab = strrchr(line_buffer, '\t');
+			last_break = last_space > last_tab ? last_space : last_tab;
+			if (last_break != NULL)  // word break (space or tab) found
+				strcpy(carry, last_break + 1);
+			else  // no word break, so just carry last character
+				sprintf(carry, "%c", line_buffer[line_length - 1]);
+			line_buffer[line_length - strlen(carry)] = '\0';
+		}
+		if (is_line_end) {
+			// do we need to enlarge the buffer?
+			if (++line_idx >= max_lines) {
+				max_lines *= 2;
+				if (!(new_buffer = realloc(buffer, max_lines * pitch)))
+					goto on_error;
+				buffer = new_buffer;
+				line_buffer = buffer + line_idx * pitch;
+			}
+			else {
+				line_buffer += pitch;
+			}
+
+			memset(line_buffer, 0, pitch);  // fill line with NULs
+
+			// copy carry text into new line
+			line_width = measure_text(font, carry);
+			line_length = strlen(carry);
+			strcpy(line_buffer, carry);
+		}
+	} while (cp != '\0');
+	free(carry);
+	wraptext->num_lines = line_idx;
+	wraptext->buffer = buffer;
+	wraptext->pitch = pitch;
+	return wraptext;
+
+on_error:
+	free(buffer);
+	free(wraptext);
+	return NULL;
+}
@@ -34,10 +34,29 @@
 #include "galileo.h"
 
 #include "color.h"
+#include "hashmap.h"
 #include "vector.h"
 
-static void free_cached_uniform (shader_t* shader, const char* name);
-static void render_shape        (shape_t* shape);
+#include <allegro5/allegro_opengl.h>
+
+// consecutive draws sharing the same render state are collected into a single vertex
+// stream and submitted together.  only small shapes are batched; anything larger than
+// BATCH_MAX_SHAPE_VERTICES is already cheap per vertex and is drawn straight from its
+// vertex buffer.
+#define BATCH_MAX_SHAPE_VERTICES 64
+#define BATCH_MAX_VERTICES       6144
+
+// uniform location which hasn't been looked up in the shader program yet
+#define UNIFORM_UNRESOLVED -2
+
+struct uniform;
+
+static bool            batch_shape          (shape_t* shape, image_t* surface, transform_t* transform);
+static void            commit_uniform       (shader_t* shader, struct uniform* uniform);
+static void            copy_packed_vertices (ALLEGRO_VERTEX* entries, const float* data, int num_vertices);
+static struct uniform* get_uniform          (shader_t* shader, const char* name, int type, int num_values);
+static void            render_shape         (shape_t* shape);
+static void            upload_uniform       (shader_t* shader, struct uniform* uniform);
 
 enum uniform_type
 {
@@ -52,9 +71,12 @@ enum uniform_type
 };
 struct uniform
 {
-	char              name[256];
-	enum uniform_type type;
+	bool              have_value;
+	bool              is_dirty;
+	int               location;
+	char*             name;
 	int               num_values;
+	enum uniform_type type;
 	union {
 		bool              bool_value;
 		int*              int_list;
@@ -72,6 +94,8 @@ struct ibo
 	unsigned int          refcount;
 	ALLEGRO_INDEX_BUFFER* buffer;
 	vector_t*             indices;
+	uint16_t*             mirror;
+	int                   num_indices;
 };
 
 struct model
@@ -88,8 +112,9 @@ struct shader
 	unsigned int    id;
 	unsigned int    refcount;
 	char*           fragment_path;
+	int             num_dirty;
 	ALLEGRO_SHADER* program;
-	vector_t*       uniforms;
+	hashmap_t*      uniforms;
 	char*           vertex_path;
 };
 
@@ -107,14 +132,30 @@ struct vbo
 {
 	unsigned int           refcount;
 	ALLEGRO_VERTEX_BUFFER* buffer;
+	ALLEGRO_VERTEX*        mirror;
+	int                    num_vertices;
 	vector_t*              vertices;
 };
 
+struct batch
+{
+	int             num_vertices;
+	shader_t*       shader;
+	image_t*        surface;
+	ALLEGRO_BITMAP* texture;
+	ALLEGRO_VERTEX* vertices;
+};
+
+static struct batch s_batch;
 static shader_t*    s_def_shader;
+static int          s_frame_batches = 0;
+static int          s_frame_draws = 0;
 static shader_t*    s_last_shader;
 static unsigned int s_next_model_id = 1;
 static unsigned int s_next_shader_id = 1;
 static unsigned int s_next_shape_id = 1;
+static int          s_num_batches = 0;
+static int          s_num_draws = 0;
 
 void
 galileo_init(void)
@@ -122,15 +163,30 @@ galileo_init(void)
 	console_log(1, "initializing Galileo subsystem");
 	s_def_shader = NULL;
 	s_last_shader = NULL;
+	memset(&s_batch, 0, sizeof(struct batch));
+	s_batch.vertices = malloc(BATCH_MAX_VERTICES * sizeof(ALLEGRO_VERTEX));
 }
 
 void
 galileo_uninit(void)
 {
 	console_log(1, "shutting down Galileo subsystem");
+	free(s_batch.vertices);
 	shader_unref(s_def_shader);
 }
 
+int
+galileo_num_batches(void)
+{
+	return s_frame_batches;
+}
+
+int
+galileo_num_draws(void)
+{
+	return s_frame_draws;
+}
+
 shader_t*
 galileo_shader(void)
 {
@@ -143,6 +199,67 @@ galileo_shader(void)
 	return s_def_shader;
 }
 
+void
+galileo_batch(image_t* surface, shader_t* shader, ALLEGRO_BITMAP* texture, const ALLEGRO_VERTEX* vertices, int num_vertices)
+{
+	// note: `vertices` is a triangle list in surface coordinates, i.e. with any model
+	//       transform already applied, which allows draws with different transforms to
+	//       share a batch.  anything that changes render state between two batched
+	//       draws is responsible for calling galileo_flush() first.
+
+	++s_num_draws;
+	if (num_vertices > BATCH_MAX_VERTICES) {
+		galileo_flush();
+		image_render_to(surface, NULL);
+		shader_use(shader, false);
+		al_draw_prim(vertices, NULL, texture, 0, num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+		++s_num_batches;
+		return;
+	}
+	if (s_batch.num_vertices == 0
+		|| surface != s_batch.surface
+		|| shader != s_batch.shader
+		|| texture != s_batch.texture
+		|| s_batch.num_vertices + num_vertices > BATCH_MAX_VERTICES
+		|| transform_dirty(image_get_transform(surface)))
+	{
+		galileo_flush();
+		image_render_to(surface, NULL);
+		shader_use(shader, false);
+		s_batch.surface = surface;
+		s_batch.shader = shader;
+		s_batch.texture = texture;
+	}
+	memcpy(&s_batch.vertices[s_batch.num_vertices], vertices, num_vertices * sizeof(ALLEGRO_VERTEX));
+	s_batch.num_vertices += num_vertices;
+}
+
+void
+galileo_end_frame(void)
+{
+	galileo_flush();
+	s_frame_batches = s_num_batches;
+	s_frame_draws = s_num_draws;
+	s_num_batches = 0;
+	s_num_draws = 0;
+}
+
+void
+galileo_flush(void)
+{
+	int num_vertices;
+
+	if (s_batch.num_vertices == 0)
+		return;
+
+	// note: the render state for the batch was set up when it was started and nothing
+	//       has touched it since, so the vertices can be submitted as-is.
+	num_vertices = s_batch.num_vertices;
+	s_batch.num_vertices = 0;
+	al_draw_prim(s_batch.vertices, NULL, s_batch.texture, 0, num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+	++s_num_batches;
+}
+
 void
 galileo_reset(void)
 {
@@ -182,6 +299,7 @@ ibo_unref(ibo_t* it)
 	if (it->buffer != NULL)
 		al_destroy_index_buffer(it->buffer);
 	vector_free(it->indices);
+	free(it->mirror);
 	free(it);
 }
 
@@ -195,7 +313,7 @@ int
 ibo_len(const ibo_t* it)
 {
 	if (it != NULL)
-		return vector_len(it->indices);
+		return it->num_indices;
 	else
 		return 0;
 }
@@ -208,32 +326,47 @@ ibo_add_index(ibo_t* it, uint16_t index)
 
 bool
 ibo_upload(ibo_t* it)
+{
+	if (vector_len(it->indices) == 0)
+		return false;
+	return ibo_upload_packed(it, vector_get(it->indices, 0), vector_len(it->indices));
+}
+
+bool
+ibo_upload_packed(ibo_t* it, const uint16_t* indices, int num_indices)
 {
 	ALLEGRO_INDEX_BUFFER* buffer;
 	uint16_t*             entries;
 
-	iter_t iter;
-
 	if (it->buffer != NULL) {
 		al_destroy_index_buffer(it->buffer);
 		it->buffer = NULL;
+		it->num_indices = 0;
 	}
+	free(it->mirror);
+	it->mirror = NULL;
 
 	// create the index buffer object
-	if (!(buffer = al_create_index_buffer(2, NULL, vector_len(it->indices), ALLEGRO_PRIM_BUFFER_STATIC)))
+	if (!(buffer = al_create_index_buffer(2, NULL, num_indices, ALLEGRO_PRIM_BUFFER_STATIC)))
 		return false;
 
-	// upload indices to the GPU
-	if (!(entries = al_lock_index_buffer(buffer, 0, vector_len(it->indices), ALLEGRO_LOCK_WRITEONLY))) {
+	// upload indices to the GPU.  the list is already in the format the GPU wants,
+	// so this is a straight copy.
+	if (!(entries = al_lock_index_buffer(buffer, 0, num_indices, ALLEGRO_LOCK_WRITEONLY))) {
 		al_destroy_index_buffer(buffer);
 		return false;
 	}
-	iter = vector_enum(it->indices);
-	while (iter_next(&iter))
-		entries[iter.index] = *(uint16_t*)iter.ptr;
+	memcpy(entries, indices, num_indices * sizeof(uint16_t));
 	al_unlock_index_buffer(buffer);
 
+	// keep a copy of small index lists in main memory for batching
+	if (num_indices <= BATCH_MAX_SHAPE_VERTICES) {
+		if ((it->mirror = malloc(num_indices * sizeof(uint16_t))))
+			memcpy(it->mirror, indices, num_indices * sizeof(uint16_t));
+	}
+
 	it->buffer = buffer;
+	it->num_indices = num_indices;
 	return true;
 }
 
@@ -347,6 +480,8 @@ shader_new(const char* vert_filename, const char* frag_filename)
 
 	if (!(shader = calloc(1, sizeof(shader_t))))
 		goto on_error;
+	if (!(shader->uniforms = hashmap_new(sizeof(struct uniform))))
+		goto on_error;
 
 	console_log(2, "compiling new shader program #%u", s_next_shader_id);
 
@@ -374,7 +509,6 @@ shader_new(const char* vert_filename, const char* frag_filename)
 	shader->id = s_next_shader_id++;
 	shader->fragment_path = strdup(frag_filename);
 	shader->vertex_path = strdup(vert_filename);
-	shader->uniforms = vector_new(sizeof(struct uniform));
 	return shader_ref(shader);
 
 on_error:
@@ -383,6 +517,7 @@ on_error:
 	if (shader != NULL) {
 		if (shader->program != NULL)
 			al_destroy_shader(shader->program);
+		hashmap_free(shader->uniforms);
 		free(shader);
 	}
 	return NULL;
@@ -409,12 +544,25 @@ shader_ref(shader_t* it)
 void
 shader_unref(shader_t* it)
 {
+	struct uniform* uniform;
+
+	iter_t iter;
+
 	if (it == NULL || --it->refcount > 0)
 		return;
 
 	console_log(3, "disposing shader program #%u no longer in use", it->id);
+	galileo_flush();
 	al_destroy_shader(it->program);
-	vector_free(it->uniforms);
+	iter = hashmap_enum(it->uniforms);
+	while ((uniform = iter_next(&iter))) {
+		free(uniform->name);
+		if (uniform->type == UNIFORM_FLOAT_ARR)
+			free(uniform->float_list);
+		else if (uniform->type == UNIFORM_INT_ARR)
+			free(uniform->int_list);
+	}
+	hashmap_free(it->uniforms);
 	free(it);
 }
 
@@ -427,151 +575,105 @@ shader_program(const shader_t* it)
 void
 shader_put_bool(shader_t* it, const char* name, bool value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_bool(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_BOOL;
-		unif.bool_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_BOOL, 1)))
+		return;
+	if (uniform->have_value && uniform->bool_value == value)
+		return;
+	uniform->bool_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float(shader_t* it, const char* name, float value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT;
-		unif.float_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT, 1)))
+		return;
+	if (uniform->have_value && uniform->float_value == value)
+		return;
+	uniform->float_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float_array(shader_t* it, const char* name, float values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_ARR;
-		unif.float_list = malloc(size * sizeof(float));
-		unif.num_values = size;
-		memcpy(unif.float_list, values, size * sizeof(float));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT_ARR, size)))
+		return;
+	if (uniform->have_value && memcmp(uniform->float_list, values, size * sizeof(float)) == 0)
+		return;
+	memcpy(uniform->float_list, values, size * sizeof(float));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_float_vector(shader_t* it, const char* name, float values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_float_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_FLOAT_VEC;
-		unif.num_values = size;
-		memcpy(unif.float_vec, values, sizeof(float) * size);
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_FLOAT_VEC, size)))
+		return;
+	if (uniform->have_value && memcmp(uniform->float_vec, values, size * sizeof(float)) == 0)
+		return;
+	memcpy(uniform->float_vec, values, size * sizeof(float));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int(shader_t* it, const char* name, int value)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int(name, value);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT;
-		unif.int_value = value;
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT, 1)))
+		return;
+	if (uniform->have_value && uniform->int_value == value)
+		return;
+	uniform->int_value = value;
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int_array(shader_t* it, const char* name, int values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, 1, values, size);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_ARR;
-		unif.int_list = malloc(size * sizeof(int));
-		unif.num_values = size;
-		memcpy(unif.int_list, values, size * sizeof(int));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT_ARR, size)))
+		return;
+	if (uniform->have_value && memcmp(uniform->int_list, values, size * sizeof(int)) == 0)
+		return;
+	memcpy(uniform->int_list, values, size * sizeof(int));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_int_vector(shader_t* it, const char* name, int values[], int size)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_int_vector(name, size, values, 1);
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_INT_VEC;
-		unif.num_values = size;
-		memcpy(unif.int_vec, values, sizeof(int) * size);
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_INT_VEC, size)))
+		return;
+	if (uniform->have_value && memcmp(uniform->int_vec, values, size * sizeof(int)) == 0)
+		return;
+	memcpy(uniform->int_vec, values, size * sizeof(int));
+	commit_uniform(it, uniform);
 }
 
 void
 shader_put_matrix(shader_t* it, const char* name, const transform_t* matrix)
 {
-	struct uniform unif;
+	struct uniform* uniform;
 
-	if (s_last_shader == it) {
-		al_set_shader_matrix(name, transform_matrix(matrix));
-	}
-	else {
-		free_cached_uniform(it, name);
-		strncpy(unif.name, name, 255);
-		unif.name[255] = '\0';
-		unif.type = UNIFORM_MATRIX;
-		al_copy_transform(&unif.mat_value, transform_matrix(matrix));
-		vector_push(it->uniforms, &unif);
-	}
+	if (!(uniform = get_uniform(it, name, UNIFORM_MATRIX, 1)))
+		return;
+	if (uniform->have_value && memcmp(&uniform->mat_value, transform_matrix(matrix), sizeof(ALLEGRO_TRANSFORM)) == 0)
+		return;
+	al_copy_transform(&uniform->mat_value, transform_matrix(matrix));
+	commit_uniform(it, uniform);
 }
 
 bool
@@ -585,6 +687,8 @@ shader_use(shader_t* it, bool force_set)
 	if (it == s_last_shader && !force_set)
 		return true;
 
+	galileo_flush();
+
 	if (it != NULL)
 		console_log(4, "activating shader program #%u", it->id);
 	else
@@ -595,39 +699,12 @@ shader_use(shader_t* it, bool force_set)
 		return false;
 
 	// set any uniforms defined while we were inactive
-	if (it != NULL) {
-		iter = vector_enum(it->uniforms);
+	if (it != NULL && it->num_dirty > 0) {
+		iter = hashmap_enum(it->uniforms);
 		while ((uniform = iter_next(&iter))) {
-			switch (uniform->type) {
-			case UNIFORM_BOOL:
-				al_set_shader_bool(uniform->name, uniform->bool_value);
-				break;
-			case UNIFORM_FLOAT:
-				al_set_shader_float(uniform->name, uniform->float_value);
-				break;
-			case UNIFORM_FLOAT_ARR:
-				al_set_shader_float_vector(uniform->name, 1, uniform->float_list, uniform->num_values);
-				free(uniform->float_list);
-				break;
-			case UNIFORM_FLOAT_VEC:
-				al_set_shader_float_vector(uniform->name, uniform->num_values, uniform->float_vec, 1);
-				break;
-			case UNIFORM_INT:
-				al_set_shader_int(uniform->name, uniform->int_value);
-				break;
-			case UNIFORM_INT_ARR:
-				al_set_shader_int_vector(uniform->name, 1, uniform->int_list, uniform->num_values);
-				free(uniform->int_list);
-				break;
-			case UNIFORM_INT_VEC:
-				al_set_shader_int_vector(uniform->name, uniform->num_values, uniform->int_vec, 1);
-				break;
-			case UNIFORM_MATRIX:
-				al_set_shader_matrix(uniform->name, &uniform->mat_value);
-				break;
-			}
+			if (uniform->is_dirty)
+				upload_uniform(it, uniform);
 		}
-		vector_clear(it->uniforms);
 	}
 
 	s_last_shader = it;
@@ -731,6 +808,8 @@ shape_set_vbo(shape_t* it, vbo_t* vbo)
 void
 shape_draw(shape_t* it, image_t* surface, transform_t* transform)
 {
+	if (batch_shape(it, surface, transform))
+		return;
 	image_render_to(surface, transform);
 	shader_use(galileo_shader(), false);
 	render_shape(it);
@@ -762,6 +841,7 @@ vbo_unref(vbo_t* it)
 	if (it->buffer != NULL)
 		al_destroy_vertex_buffer(it->buffer);
 	vector_free(it->vertices);
+	free(it->mirror);
 	free(it);
 }
 
@@ -774,7 +854,7 @@ vbo_buffer(const vbo_t* it)
 int
 vbo_len(const vbo_t* it)
 {
-	return vector_len(it->vertices);
+	return it->num_vertices;
 }
 
 void
@@ -788,6 +868,8 @@ vbo_upload(vbo_t* it)
 {
 	ALLEGRO_VERTEX_BUFFER* buffer;
 	ALLEGRO_VERTEX*        entries;
+	int                    num_vertices;
+	ALLEGRO_VERTEX*        outputs;
 	vertex_t*              vertex;
 
 	iter_t iter;
@@ -795,45 +877,250 @@ vbo_upload(vbo_t* it)
 	if (it->buffer != NULL) {
 		al_destroy_vertex_buffer(it->buffer);
 		it->buffer = NULL;
+		it->num_vertices = 0;
 	}
+	free(it->mirror);
+	it->mirror = NULL;
 
 	// create the vertex buffer object
-	if (!(buffer = al_create_vertex_buffer(NULL, NULL, vector_len(it->vertices), ALLEGRO_PRIM_BUFFER_STATIC)))
+	num_vertices = vector_len(it->vertices);
+	if (!(buffer = al_create_vertex_buffer(NULL, NULL, num_vertices, ALLEGRO_PRIM_BUFFER_STATIC)))
 		return false;
 
-	// upload indices to the GPU
-	if (!(entries = al_lock_vertex_buffer(buffer, 0, vector_len(it->vertices), ALLEGRO_LOCK_WRITEONLY))) {
+	// upload indices to the GPU.  small vertex lists are also kept in main memory so
+	// they can be batched.
+	if (!(entries = al_lock_vertex_buffer(buffer, 0, num_vertices, ALLEGRO_LOCK_WRITEONLY))) {
 		al_destroy_vertex_buffer(buffer);
 		return false;
 	}
+	if (num_vertices <= BATCH_MAX_SHAPE_VERTICES)
+		it->mirror = malloc(num_vertices * sizeof(ALLEGRO_VERTEX));
+	outputs = it->mirror != NULL ? it->mirror : entries;
 	iter = vector_enum(it->vertices);
 	while (iter_next(&iter)) {
 		vertex = iter.ptr;
-		entries[iter.index].x = vertex->x;
-		entries[iter.index].y = vertex->y;
-		entries[iter.index].z = vertex->z;
-		entries[iter.index].u = vertex->u;
-		entries[iter.index].v = vertex->v;
-		entries[iter.index].color = nativecolor(vertex->color);
+		outputs[iter.index].x = vertex->x;
+		outputs[iter.index].y = vertex->y;
+		outputs[iter.index].z = vertex->z;
+		outputs[iter.index].u = vertex->u;
+		outputs[iter.index].v = vertex->v;
+		outputs[iter.index].color = nativecolor(vertex->color);
+	}
+	if (it->mirror != NULL)
+		memcpy(entries, it->mirror, num_vertices * sizeof(ALLEGRO_VERTEX));
+	al_unlock_vertex_buffer(buffer);
+
+	it->buffer = buffer;
+	it->num_vertices = num_vertices;
+	return true;
+}
+
+bool
+vbo_upload_packed(vbo_t* it, const float* data, int num_vertices)
+{
+	ALLEGRO_VERTEX_BUFFER* buffer;
+	ALLEGRO_VERTEX*        entries;
+
+	if (it->buffer != NULL) {
+		al_destroy_vertex_buffer(it->buffer);
+		it->buffer = NULL;
+		it->num_vertices = 0;
+	}
+	free(it->mirror);
+	it->mirror = NULL;
+
+	if (!(buffer = al_create_vertex_buffer(NULL, NULL, num_vertices, ALLEGRO_PRIM_BUFFER_STATIC)))
+		return false;
+	if (!(entries = al_lock_vertex_buffer(buffer, 0, num_vertices, ALLEGRO_LOCK_WRITEONLY))) {
+		al_destroy_vertex_buffer(buffer);
+		return false;
 	}
+	copy_packed_vertices(entries, data, num_vertices);
 	al_unlock_vertex_buffer(buffer);
+	if (num_vertices <= BATCH_MAX_SHAPE_VERTICES) {
+		if ((it->mirror = malloc(num_vertices * sizeof(ALLEGRO_VERTEX))))
+			copy_packed_vertices(it->mirror, data, num_vertices);
+	}
 
 	it->buffer = buffer;
+	it->num_vertices = num_vertices;
+	return true;
+}
+
+bool
+vbo_update_packed(vbo_t* it, int offset, const float* data, int num_vertices)
+{
+	ALLEGRO_VERTEX* entries;
+
+	if (it->buffer == NULL || offset < 0 || num_vertices <= 0)
+		return false;
+	if (offset + num_vertices > it->num_vertices)
+		return false;
+
+	// note: only the range being replaced is locked, so the driver doesn't have to
+	//       round-trip the whole buffer when a small part of a large mesh changes.
+	if (!(entries = al_lock_vertex_buffer(it->buffer, offset, num_vertices, ALLEGRO_LOCK_WRITEONLY)))
+		return false;
+	copy_packed_vertices(entries, data, num_vertices);
+	al_unlock_vertex_buffer(it->buffer);
+	if (it->mirror != NULL)
+		copy_packed_vertices(&it->mirror[offset], data, num_vertices);
 	return true;
 }
 
+static bool
+batch_shape(shape_t* shape, image_t* surface, transform_t* transform)
+{
+	ALLEGRO_BITMAP*          bitmap;
+	const uint16_t*          indices = NULL;
+	const ALLEGRO_TRANSFORM* matrix = NULL;
+	int                      num_indices;
+	int                      num_outputs = 0;
+	int                      num_vertices;
+	ALLEGRO_VERTEX           outputs[BATCH_MAX_SHAPE_VERTICES * 3];
+	int                      tri[3];
+	ALLEGRO_VERTEX*          vertex;
+	const ALLEGRO_VERTEX*    vertices;
+	float                    x, y, z;
+
+	int i, j;
+
+	// only small triangle-based shapes whose vertices are available in main memory can
+	// be batched.  everything else is drawn directly from its vertex buffer.
+	if (shape->vbo == NULL || shape->vbo->mirror == NULL)
+		return false;
+	if (shape->type != SHAPE_TRIANGLES && shape->type != SHAPE_TRI_STRIP && shape->type != SHAPE_TRI_FAN)
+		return false;
+	vertices = shape->vbo->mirror;
+	num_vertices = shape->vbo->num_vertices;
+	num_indices = num_vertices;
+	if (shape->ibo != NULL) {
+		if (shape->ibo->mirror == NULL)
+			return false;
+		indices = shape->ibo->mirror;
+		num_indices = shape->ibo->num_indices;
+		for (i = 0; i < num_indices; ++i) {
+			if (indices[i] >= num_vertices)
+				return false;
+		}
+	}
+	if (transform != NULL) {
+		// vertices are transformed on the CPU, which only works for affine transforms
+		matrix = transform_matrix(transform);
+		if (matrix->m[0][3] != 0.0f || matrix->m[1][3] != 0.0f || matrix->m[2][3] != 0.0f
+			|| matrix->m[3][3] != 1.0f)
+		{
+			return false;
+		}
+	}
+
+	// expand the shape into a triangle list
+	for (i = 0; i + 2 < num_indices; i += shape->type == SHAPE_TRIANGLES ? 3 : 1) {
+		tri[0] = shape->type == SHAPE_TRI_FAN ? 0 : i;
+		tri[1] = shape->type == SHAPE_TRI_STRIP && i % 2 == 1 ? i + 2 : i + 1;
+		tri[2] = shape->type == SHAPE_TRI_STRIP && i % 2 == 1 ? i + 1 : i + 2;
+		for (j = 0; j < 3; ++j) {
+			vertex = &outputs[num_outputs++];
+			*vertex = vertices[indices != NULL ? indices[tri[j]] : tri[j]];
+			if (matrix != NULL) {
+				x = vertex->x;
+				y = vertex->y;
+				z = vertex->z;
+				vertex->x = x * matrix->m[0][0] + y * matrix->m[1][0] + z * matrix->m[2][0] + matrix->m[3][0];
+				vertex->y = x * matrix->m[0][1] + y * matrix->m[1][1] + z * matrix->m[2][1] + matrix->m[3][1];
+				vertex->z = x * matrix->m[0][2] + y * matrix->m[1][2] + z * matrix->m[2][2] + matrix->m[3][2];
+			}
+		}
+	}
+	if (num_outputs == 0)
+		return true;
+
+	bitmap = shape->texture != NULL ? image_bitmap(shape->texture) : NULL;
+	galileo_batch(surface, galileo_shader(), bitmap, outputs, num_outputs);
+	return true;
+}
+
+static void
+commit_uniform(shader_t* shader, struct uniform* uniform)
+{
+	// uniforms for the active shader are sent to the GPU right away, otherwise they're
+	// held until the shader is next activated.
+	// note: upload_uniform() writes through glUniform*(), which goes to whatever
+	//       program is bound right now.  Allegro rebinds the target bitmap's shader
+	//       whenever the render target changes, so if that's no longer ours, forget
+	//       the active shader and let shader_use() bind it again before uploading.
+	uniform->have_value = true;
+	if (shader == s_last_shader && al_get_current_shader() != shader->program)
+		s_last_shader = NULL;
+	if (shader == s_last_shader) {
+		galileo_flush();
+		upload_uniform(shader, uniform);
+	}
+	else if (!uniform->is_dirty) {
+		uniform->is_dirty = true;
+		++shader->num_dirty;
+	}
+}
+
 static void
-free_cached_uniform(shader_t* shader, const char* name)
+copy_packed_vertices(ALLEGRO_VERTEX* entries, const float* data, int num_vertices)
 {
+	int i;
+
+	// note: ALLEGRO_VERTEX is normally laid out exactly like a packed vertex, in
+	//       which case the whole array can be copied in one go.
+	if (sizeof(ALLEGRO_VERTEX) == VERTEX_PACKED_FLOATS * sizeof(float)
+		&& offsetof(ALLEGRO_VERTEX, color) == 5 * sizeof(float))
+	{
+		memcpy(entries, data, num_vertices * sizeof(ALLEGRO_VERTEX));
+		return;
+	}
+	for (i = 0; i < num_vertices; ++i) {
+		entries[i].x = data[0];
+		entries[i].y = data[1];
+		entries[i].z = data[2];
+		entries[i].u = data[3];
+		entries[i].v = data[4];
+		entries[i].color = al_map_rgba_f(data[5], data[6], data[7], data[8]);
+		data += VERTEX_PACKED_FLOATS;
+	}
+}
+
+static struct uniform*
+get_uniform(shader_t* shader, const char* name, int type, int num_values)
+{
+	// note: a uniform's GL location is looked up the first time it's uploaded and
+	//       cached along with its value, so it only has to be found once per program.
 	struct uniform* uniform;
 
-	iter_t iter;
+	if (!(uniform = hashmap_get(shader->uniforms, name, strlen(name)))) {
+		if (!(uniform = hashmap_put(shader->uniforms, name, strlen(name), NULL)))
+			return NULL;
+		if (!(uniform->name = strdup(name))) {
+			hashmap_remove(shader->uniforms, name, strlen(name));
+			return NULL;
+		}
+		uniform->location = UNIFORM_UNRESOLVED;
+		uniform->type = type;
+	}
 
-	iter = vector_enum(shader->uniforms);
-	while ((uniform = iter_next(&iter))) {
-		if (strcmp(uniform->name, name) == 0)
-			iter_remove(&iter);
+	// if the type or size changed, the old value can't be used to skip redundant updates
+	if (uniform->type != type || uniform->num_values != num_values) {
+		if (uniform->type == UNIFORM_FLOAT_ARR && uniform->have_value)
+			free(uniform->float_list);
+		else if (uniform->type == UNIFORM_INT_ARR && uniform->have_value)
+			free(uniform->int_list);
+		uniform->have_value = false;
+		uniform->type = type;
+		uniform->num_values = num_values;
+	}
+	if (!uniform->have_value) {
+		if (type == UNIFORM_FLOAT_ARR && !(uniform->float_list = malloc(num_values * sizeof(float))))
+			return NULL;
+		if (type == UNIFORM_INT_ARR && !(uniform->int_list = malloc(num_values * sizeof(int))))
+			return NULL;
 	}
+	return uniform;
 }
 
 static void
@@ -857,9 +1144,67 @@ render_shape(shape_t* shape)
 		: shape->type == SHAPE_TRI_FAN ? ALLEGRO_PRIM_TRIANGLE_FAN
 		: ALLEGRO_PRIM_POINT_LIST;
 
+	++s_num_draws;
+	++s_num_batches;
 	bitmap = shape->texture != NULL ? image_bitmap(shape->texture) : NULL;
 	if (shape->ibo != NULL)
 		al_draw_indexed_buffer(vbo_buffer(shape->vbo), bitmap, ibo_buffer(shape->ibo), 0, num_indices, draw_mode);
 	else
 		al_draw_vertex_buffer(vbo_buffer(shape->vbo), bitmap, 0, num_vertices, draw_mode);
 }
+
+static void
+upload_uniform(shader_t* shader, struct uniform* uniform)
+{
+	GLint location;
+
+	if (uniform->is_dirty) {
+		uniform->is_dirty = false;
+		--shader->num_dirty;
+	}
+	if (uniform->location == UNIFORM_UNRESOLVED)
+		uniform->location = glGetUniformLocation(al_get_opengl_program_object(shader->program), uniform->name);
+	if ((location = uniform->location) < 0)
+		return;  // not used by the program
+
+	switch (uniform->type) {
+	case UNIFORM_BOOL:
+		glUniform1i(location, uniform->bool_value ? 1 : 0);
+		break;
+	case UNIFORM_FLOAT:
+		glUniform1f(location, uniform->float_value);
+		break;
+	case UNIFORM_FLOAT_ARR:
+		glUniform1fv(location, uniform->num_values, uniform->float_list);
+		break;
+	case UNIFORM_FLOAT_VEC:
+		if (uniform->num_values == 2)
+			glUniform2fv(location, 1, uniform->float_vec);
+		else if (uniform->num_values == 3)
+			glUniform3fv(location, 1, uniform->float_vec);
+		else if (uniform->num_values == 4)
+			glUniform4fv(location, 1, uniform->float_vec);
+		else
+			glUniform1fv(location, 1, uniform->float_vec);
+		break;
+	case UNIFORM_INT:
+		glUniform1i(location, uniform->int_value);
+		break;
+	case UNIFORM_INT_ARR:
+		glUniform1iv(location, uniform->num_values, uniform->int_list);
+		break;
+	case UNIFORM_INT_VEC:
+		if (uniform->num_values == 2)
+			glUniform2iv(location, 1, uniform->int_vec);
+		else if (uniform->num_values == 3)
+			glUniform3iv(location, 1, uniform->int_vec);
+		else if (uniform->num_values == 4)
+			glUniform4iv(location, 1, uniform->int_vec);
+		else
+			glUniform1iv(location, 1, uniform->int_vec);
+		break;
+	case UNIFORM_MATRIX:
+		glUniformMatrix4fv(location, 1, GL_FALSE, (const GLfloat*)uniform->mat_value.m);
+		break;
+	}
+}
@@ -33,6 +33,10 @@
 #ifndef SPHERE__GALILEO_H__INCLUDED
 #define SPHERE__GALILEO_H__INCLUDED
 
+// number of floats per vertex in a packed vertex array:
+//     x, y, z, u, v, r, g, b, a
+#define VERTEX_PACKED_FLOATS 9
+
 typedef struct ibo    ibo_t;
 typedef struct model  model_t;
 typedef struct shader shader_t;
@@ -70,7 +74,12 @@ struct vertex
 
 void                   galileo_init            (void);
 void                   galileo_uninit          (void);
+int                    galileo_num_batches     (void);
+int                    galileo_num_draws       (void);
 shader_t*              galileo_shader          (void);
+void                   galileo_batch           (image_t* surface, shader_t* shader, ALLEGRO_BITMAP* texture, const ALLEGRO_VERTEX* vertices, int num_vertices);
+void                   galileo_end_frame       (void);
+void                   galileo_flush           (void);
 void                   galileo_reset           (void);
 ibo_t*                 ibo_new                 (void);
 ibo_t*                 ibo_ref                 (ibo_t* it);
@@ -79,6 +88,7 @@ ALLEGRO_INDEX_BUFFER*  ibo_buffer              (const ibo_t* it);
 int                    ibo_len                 (const ibo_t* it);
 void                   ibo_add_index           (ibo_t* it, uint16_t index);
 bool                   ibo_upload              (ibo_t* it);
+bool                   ibo_upload_packed       (ibo_t* it, const uint16_t* indices, int num_indices);
 model_t*               model_new               (shader_t* shader);
 model_t*               model_ref               (model_t* it);
 void                   model_unref             (model_t* it);
@@ -119,5 +129,7 @@ ALLEGRO_VERTEX_BUFFER* vbo_buffer              (const vbo_t* it);
 int                    vbo_len                 (const vbo_t* it);
 void                   vbo_add_vertex          (vbo_t* it, vertex_t vertex);
 bool                   vbo_upload              (vbo_t* it);
+bool                   vbo_upload_packed       (vbo_t* it, const float* data, int num_vertices);
+bool                   vbo_update_packed       (vbo_t* it, int offset, const float* data, int num_vertices);
 
 #endif // SPHERE__GALILEO_H__INCLUDED
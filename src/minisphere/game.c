@@ -60,9 +60,12 @@ struct game
 	image_t*       default_arrow_up;
 	font_t*        default_font;
 	windowstyle_t* default_windowstyle;
+	vector_t*      dir_listings;
 	bool           empty_promises;
 	vector_t*      file_type_map;
+	unsigned int   fs_version;
 	bool           fullscreen;
+	size_t         heap_limit;
 	js_ref_t*      manifest;
 	lstring_t*     name;
 	package_t*     package;
@@ -78,6 +81,13 @@ struct game
 	int            version;
 };
 
+struct dir_listing
+{
+	vector_t* filenames;
+	time_t    mtime;
+	char*     pathname;
+};
+
 struct directory
 {
 	vector_t* entries;
@@ -96,7 +106,10 @@ struct file
 	const char*   path;
 };
 
+static int       compare_filenames   (const void* in_a, const void* in_b);
 static bool      help_list_dir       (vector_t* list, const char* dirname, const path_t* origin_path, bool want_dirs, bool recursive);
+static void      invalidate_listings (game_t* game);
+static bool      is_file_listed      (const game_t* game, const path_t* path);
 static void      load_default_assets (game_t* game);
 static vector_t* read_directory      (const game_t* game, const char* dirname, bool want_dirs, bool recursive);
 static bool      resolve_pathname    (const game_t* game, const char* pathname, path_t* *out_path, enum fs_type *out_fs_type);
@@ -120,6 +133,7 @@ game_open(const char* game_path)
 
 	game = game_ref(calloc(1, sizeof(game_t)));
 	game->safety = FS_SAFETY_FULL;
+	game->dir_listings = vector_new(sizeof(struct dir_listing));
 
 	game->id = s_next_game_id;
 	path = path_new(game_path);
@@ -285,6 +299,9 @@ game_unref(game_t* it)
 		vector_free(it->file_type_map);
 	}
 
+	invalidate_listings(it);
+	vector_free(it->dir_listings);
+
 	if (it->type == FS_PACKAGE)
 		package_unref(it->package);
 	path_free(it->script_path);
@@ -379,6 +396,17 @@ game_file_exists(const game_t* it, const char* filename)
 		goto on_error;
 	switch (fs_type) {
 	case FS_LOCAL:
+		// note: listings of directories under the game and system roots are memoized
+		//       and only reread when the directory's modification time changes.  this
+		//       makes repeated probing (e.g. by the module resolver) much cheaper.
+		if (strncmp(filename, "@/", 2) == 0 || strncmp(filename, "#/", 2) == 0
+			|| strncmp(filename, "$/", 2) == 0)
+		{
+			if (!is_file_listed(it, path))
+				goto on_error;
+			path_free(path);
+			return true;
+		}
 		if (stat(path_cstr(path), &stats) != 0)
 			goto on_error;
 		path_free(path);
@@ -395,6 +423,12 @@ on_error:
 	return false;
 }
 
+unsigned int
+game_fs_version(const game_t* it)
+{
+	return it->fs_version;
+}
+
 path_t*
 game_full_path(const game_t* it, const char* filename, const char* base_dir_name, bool v1_mode)
 {
@@ -462,6 +496,12 @@ game_fullscreen(const game_t* it)
 	return it->fullscreen;
 }
 
+size_t
+game_heap_limit(const game_t* it)
+{
+	return it->heap_limit;
+}
+
 const js_ref_t*
 game_manifest(const game_t* it)
 {
@@ -582,6 +622,7 @@ game_mkdir(game_t* it, const char* dirname)
 		return false;
 	switch (fs_type) {
 	case FS_LOCAL:
+		invalidate_listings(it);
 		return path_mkdir(path);
 	case FS_PACKAGE:
 		return false;
@@ -640,6 +681,7 @@ game_rename(game_t* it, const char* old_pathname, const char* new_pathname)
 			return true;  // avoid rename() deleting file if oldname == newname
 		if (game_file_exists(it, new_pathname) || game_dir_exists(it, new_pathname))
 			return false; // don't overwrite existing file
+		invalidate_listings(it);
 		return rename(path_cstr(old_path), path_cstr(new_path)) == 0;
 	case FS_PACKAGE:
 		return false;  // SPK packages are not writable
@@ -658,6 +700,7 @@ game_rmdir(game_t* it, const char* dirname)
 		return false;
 	switch (fs_type) {
 	case FS_LOCAL:
+		invalidate_listings(it);
 		return rmdir(path_cstr(path)) == 0;
 	case FS_PACKAGE:
 		return false;
@@ -688,6 +731,7 @@ game_unlink(game_t* it, const char* filename)
 		return false;
 	switch (fs_type) {
 	case FS_LOCAL:
+		invalidate_listings(it);
 		return unlink(path_cstr(path)) == 0;
 	case FS_PACKAGE:
 		return false;
@@ -839,6 +883,7 @@ file_open(game_t* game, const char* filename, const char* mode)
 			dir_path = path_strip(path_dup(file_path));
 			path_mkdir(dir_path);
 			path_free(dir_path);
+			invalidate_listings(game);
 		}
 		if (!(file->handle = al_fopen(path_cstr(file_path), mode)))
 			goto on_error;
@@ -957,6 +1002,18 @@ file_write(file_t* it, const void* buf, size_t count, size_t size)
 	}
 }
 
+static int
+compare_filenames(const void* in_a, const void* in_b)
+{
+	// note: this should match the case sensitivity of the host file system, otherwise
+	//       memoized directory listings won't agree with stat().
+#if defined(_WIN32) || defined(__APPLE__)
+	return strcasecmp(*(const char**)in_a, *(const char**)in_b);
+#else
+	return strcmp(*(const char**)in_a, *(const char**)in_b);
+#endif
+}
+
 static bool
 help_list_dir(vector_t* list, const char* dirname, const path_t* origin_path, bool want_dirs, bool recursive)
 {
@@ -1000,6 +1057,95 @@ on_error:
 	return false;
 }
 
+static void
+invalidate_listings(game_t* game)
+{
+	struct dir_listing* listing;
+
+	iter_t iter;
+	iter_t iter2;
+
+	++game->fs_version;
+	iter = vector_enum(game->dir_listings);
+	while ((listing = iter_next(&iter))) {
+		iter2 = vector_enum(listing->filenames);
+		while (iter_next(&iter2))
+			free(*(char**)iter2.ptr);
+		vector_free(listing->filenames);
+		free(listing->pathname);
+	}
+	vector_clear(game->dir_listings);
+}
+
+static bool
+is_file_listed(const game_t* game, const path_t* path)
+{
+	// note: files can be added or removed behind the engine's back (e.g. by an editor
+	//       during development, or by Cell rebuilding the game), so a memoized listing
+	//       is only trusted as long as the directory's mtime hasn't changed.
+
+	tinydir_dir         dir_info;
+	path_t*             dir_path;
+	tinydir_file        file_info;
+	const char*         filename;
+	char*               found_name;
+	struct dir_listing* listing = NULL;
+	time_t              mtime;
+	struct dir_listing  new_listing;
+	struct stat         stats;
+
+	iter_t iter;
+	iter_t iter2;
+
+	if ((filename = path_filename(path)) == NULL)
+		return false;
+	dir_path = path_strip(path_dup(path));
+	mtime = stat(path_cstr(dir_path), &stats) == 0 ? stats.st_mtime : 0;
+	iter = vector_enum(game->dir_listings);
+	while ((listing = iter_next(&iter))) {
+		if (strcmp(listing->pathname, path_cstr(dir_path)) == 0)
+			break;
+	}
+	if (listing == NULL) {
+		new_listing.pathname = strdup(path_cstr(dir_path));
+		new_listing.filenames = vector_new(sizeof(char*));
+		vector_push(game->dir_listings, &new_listing);
+		listing = vector_get(game->dir_listings, vector_len(game->dir_listings) - 1);
+	}
+	else if (listing->mtime != mtime) {
+		iter2 = vector_enum(listing->filenames);
+		while (iter_next(&iter2))
+			free(*(char**)iter2.ptr);
+		vector_clear(listing->filenames);
+	}
+	else {
+		goto have_listing;
+	}
+
+	// directory not listed yet (or changed since), read it in.  a directory that
+	// doesn't exist gets an empty listing.
+	listing->mtime = mtime;
+	if (tinydir_open(&dir_info, path_cstr(dir_path)) == 0) {
+		while (dir_info.has_next) {
+			tinydir_readfile(&dir_info, &file_info);
+			if (file_info.is_reg) {
+				found_name = strdup(file_info.name);
+				vector_push(listing->filenames, &found_name);
+			}
+			tinydir_next(&dir_info);
+		}
+		tinydir_close(&dir_info);
+	}
+	vector_sort(listing->filenames, compare_filenames);
+
+have_listing:
+	path_free(dir_path);
+	if (vector_len(listing->filenames) == 0)
+		return false;
+	return bsearch(&filename, vector_get(listing->filenames, 0), vector_len(listing->filenames),
+		sizeof(char*), compare_filenames) != NULL;
+}
+
 static void
 load_default_assets(game_t* game)
 {
@@ -1127,11 +1273,16 @@ try_load_s2gm(game_t* game, const lstring_t* json_text)
 	else
 		game->fullscreen = game->version < 2;
 
+	// note: the soft heap limit is specified in megabytes.  it's not enforced as such, but
+	//       tells the engine when it's worth doing a full GC pass between frames.
+	if (jsal_get_prop_string(-10, "softHeapLimit") && jsal_is_number(-1) && jsal_get_number(-1) > 0.0)
+		game->heap_limit = fmin(jsal_get_number(-1), SIZE_MAX / 1048576) * 1048576;
+
 	// for SpheRun only: load dev configuration from manifest.  otherwise use defaults to avoid
 	// security issues in production.
 	game->safety = FS_SAFETY_FULL;
 #if defined(MINISPHERE_SPHERUN)
-	if (jsal_get_prop_string(-10, "development") && jsal_is_object(-1)) {
+	if (jsal_get_prop_string(-11, "development") && jsal_is_object(-1)) {
 		if (jsal_get_prop_string(-1, "emptyPromises") && jsal_is_boolean(-1))
 			game->empty_promises = jsal_get_boolean(-1);
 		if (jsal_get_prop_string(-2, "retrograde") && jsal_is_boolean(-1))
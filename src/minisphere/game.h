@@ -72,8 +72,10 @@ windowstyle_t*  game_default_windowstyle (const game_t* it);
 bool            game_dir_exists          (const game_t* it, const char* dirname);
 bool            game_empty_promises      (const game_t* it);
 bool            game_file_exists         (const game_t* it, const char* filename);
+unsigned int    game_fs_version          (const game_t* it);
 path_t*         game_full_path           (const game_t* it, const char* filename, const char* base_dir_name, bool v1_mode);
 bool            game_fullscreen          (const game_t* it);
+size_t          game_heap_limit          (const game_t* it);
 const js_ref_t* game_manifest            (const game_t* it);
 const char*     game_name                (const game_t* it);
 const path_t*   game_path                (const game_t* it);
@@ -38,6 +38,22 @@
 #include "galileo.h"
 #include "transform.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// pixel effects applied to large regions are split into horizontal bands which are
+// processed in parallel, one per thread.  below MIN_PARALLEL_PIXELS it's not worth the
+// cost of starting the threads.
+#define MAX_PIXEL_THREADS   8
+#define MIN_PARALLEL_PIXELS 131072
+
+// image_get_pixel() reads from a CPU-side copy of the image which is filled in one
+// PIXEL_TILE_SIZE-square tile at a time, as pixels in each tile are first read.  writes
+// to a known region only invalidate the tiles they overlap.
+#define PIXEL_TILE_SIZE 64
+
 struct image
 {
 	unsigned int    refcount;
@@ -52,16 +68,48 @@ struct image
 	unsigned int    lock_count;
 	transform_t*    modelview;
 	char*           path;
+	int             num_tiles_x;
+	int             num_tiles_y;
 	color_t*        pixel_cache;
 	rect_t          scissor_box;
+	uint8_t*        tile_valid;
 	transform_t*    transform;
 	int             width;
 	int             height;
 	image_t*        parent;
 };
 
-static void cache_pixels   (image_t* image);
-static void uncache_pixels (image_t* image);
+enum pixel_op
+{
+	PIXEL_OP_COLOR_FX,
+	PIXEL_OP_COLOR_FX_4,
+	PIXEL_OP_LOOKUP,
+	PIXEL_OP_REPLACE,
+};
+
+struct pixel_job
+{
+	color_t        color;
+	color_fx_t     matrices[4];
+	const uint8_t* lookup[4];
+	color_t        new_color;
+	enum pixel_op  op;
+	color_t*       pixels;
+	ptrdiff_t      pitch;
+	int            x, y, width, height;
+	int            y_start, y_end;
+};
+
+static bool  cache_tile        (image_t* image, int tile_x, int tile_y);
+static void  color_fx_4_rows   (const struct pixel_job* job);
+static void  color_fx_rows     (const struct pixel_job* job);
+static void  free_pixel_cache  (image_t* image);
+static void  lookup_rows       (const struct pixel_job* job);
+static void* pixel_job_proc    (ALLEGRO_THREAD* thread, void* udata);
+static void  replace_rows      (const struct pixel_job* job);
+static void  run_pixel_job     (struct pixel_job* job);
+static void  uncache_pixels    (image_t* image);
+static void  uncache_region    (image_t* image, int x, int y, int width, int height);
 
 static image_t*     s_last_image = NULL;
 static unsigned int s_next_image_id = 0;
@@ -235,7 +283,8 @@ image_unref(image_t* it)
 
 	console_log(3, "disposing image #%u no longer in use",
 		it->id);
-	uncache_pixels(it);
+	galileo_flush();
+	free_pixel_cache(it);
 	al_destroy_bitmap(it->bitmap);
 	image_unref(it->parent);
 	free(it->path);
@@ -297,6 +346,8 @@ image_set_blend_op(image_t* it, blend_op_t* op)
 {
 	blend_op_t* prev_op;
 
+	if (it == s_last_image && !blend_op_equal(op, it->blend_op))
+		galileo_flush();
 	prev_op = it->blend_op;
 	it->blend_op = blend_op_ref(op);
 	blend_op_unref(prev_op);
@@ -309,6 +360,8 @@ image_set_depth_op(image_t* it, depth_op_t op)
 {
 	int depth_func;
 	
+	if (it == s_last_image && op != it->depth_op)
+		galileo_flush();
 	it->depth_op = op;
 	if (it == s_last_image) {
 		depth_func = it->depth_op == DEPTH_PASS ? ALLEGRO_RENDER_ALWAYS
@@ -327,6 +380,8 @@ image_set_depth_op(image_t* it, depth_op_t op)
 void
 image_set_scissor(image_t* it, rect_t value)
 {
+	if (it == s_last_image)
+		galileo_flush();
 	it->scissor_box = value;
 	if (it == s_last_image)
 		al_set_clipping_rectangle(value.x1, value.y1, value.x2 - value.x1, value.y2 - value.y1);
@@ -347,18 +402,22 @@ image_set_transform(image_t* it, transform_t* transform)
 bool
 image_apply_color_fx(image_t* it, color_fx_t matrix, int x, int y, int width, int height)
 {
-	image_lock_t* lock;
-	color_t*      pixel;
-
-	int i_x, i_y;
+	struct pixel_job job;
+	image_lock_t*    lock;
 
 	if (!(lock = image_lock(it, true, true)))
 		return false;
-	uncache_pixels(it);
-	for (i_x = x; i_x < x + width; ++i_x) for (i_y = y; i_y < y + height; ++i_y) {
-		pixel = &lock->pixels[i_x + i_y * lock->pitch];
-		*pixel = color_transform(*pixel, matrix);
-	}
+	uncache_region(it, x, y, width, height);
+	memset(&job, 0, sizeof(struct pixel_job));
+	job.op = PIXEL_OP_COLOR_FX;
+	job.matrices[0] = matrix;
+	job.pixels = lock->pixels;
+	job.pitch = lock->pitch;
+	job.x = x;
+	job.y = y;
+	job.width = width;
+	job.height = height;
+	run_pixel_job(&job);
 	image_unlock(it, lock);
 	return true;
 }
@@ -371,35 +430,25 @@ image_apply_color_fx_4(image_t* it, color_fx_t ul_mat, color_fx_t ur_mat, color_
 	// boils down to is bilinear interpolation, but with matrices. it's much more
 	// straightforward than it sounds.
 
-	int           i1, i2;
-	image_lock_t* lock;
-	color_fx_t mat_1, mat_2, mat_3;
-	color_t*      pixel;
-
-	int i_x, i_y;
+	struct pixel_job job;
+	image_lock_t*    lock;
 
 	if (!(lock = image_lock(it, true, true)))
 		return false;
-	uncache_pixels(it);
-	for (i_y = y; i_y < y + h; ++i_y) {
-		// thankfully, we don't have to do a full bilinear interpolation every frame.
-		// two thirds of the work is done in the outer loop, giving us two color matrices
-		// which we then use in the inner loop to calculate the transforms for individual
-		// pixels.
-		i1 = y + h - 1 - i_y;
-		i2 = i_y - y;
-		mat_1 = color_fx_mix(ul_mat, ll_mat, i1, i2);
-		mat_2 = color_fx_mix(ur_mat, lr_mat, i1, i2);
-		for (i_x = x; i_x < x + w; ++i_x) {
-			// calculate the final matrix for this pixel and transform it
-			i1 = x + w - 1 - i_x;
-			i2 = i_x - x;
-			mat_3 = color_fx_mix(mat_1, mat_2, i1, i2);
-			pixel = &lock->pixels[i_x + i_y * lock->pitch];
-			*pixel = color_transform(*pixel, mat_3);
-
-		}
-	}
+	uncache_region(it, x, y, w, h);
+	memset(&job, 0, sizeof(struct pixel_job));
+	job.op = PIXEL_OP_COLOR_FX_4;
+	job.matrices[0] = ul_mat;
+	job.matrices[1] = ur_mat;
+	job.matrices[2] = ll_mat;
+	job.matrices[3] = lr_mat;
+	job.pixels = lock->pixels;
+	job.pitch = lock->pitch;
+	job.x = x;
+	job.y = y;
+	job.width = w;
+	job.height = h;
+	run_pixel_job(&job);
 	image_unlock(it, lock);
 	return true;
 }
@@ -407,23 +456,26 @@ image_apply_color_fx_4(image_t* it, color_fx_t ul_mat, color_fx_t ur_mat, color_
 bool
 image_apply_lookup(image_t* it, int x, int y, int width, int height, uint8_t red_lu[256], uint8_t green_lu[256], uint8_t blue_lu[256], uint8_t alpha_lu[256])
 {
-	ALLEGRO_BITMAP*        bitmap = image_bitmap(it);
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
+	struct pixel_job job;
+	image_lock_t*    lock;
 
-	int i_x, i_y;
-
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!(lock = image_lock(it, true, true)))
 		return false;
-	uncache_pixels(it);
-	for (i_x = x; i_x < x + width; ++i_x) for (i_y = y; i_y < y + height; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		pixel[0] = red_lu[pixel[0]];
-		pixel[1] = green_lu[pixel[1]];
-		pixel[2] = blue_lu[pixel[2]];
-		pixel[3] = alpha_lu[pixel[3]];
-	}
-	al_unlock_bitmap(bitmap);
+	uncache_region(it, x, y, width, height);
+	memset(&job, 0, sizeof(struct pixel_job));
+	job.op = PIXEL_OP_LOOKUP;
+	job.lookup[0] = red_lu;
+	job.lookup[1] = green_lu;
+	job.lookup[2] = blue_lu;
+	job.lookup[3] = alpha_lu;
+	job.pixels = lock->pixels;
+	job.pitch = lock->pitch;
+	job.x = x;
+	job.y = y;
+	job.width = width;
+	job.height = height;
+	run_pixel_job(&job);
+	image_unlock(it, lock);
 	return true;
 }
 
@@ -435,6 +487,7 @@ image_blit(image_t* it, image_t* target_image, int x, int y)
 	int             blend_op;
 	ALLEGRO_BITMAP* old_target;
 
+	galileo_flush();
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(image_bitmap(target_image));
 	al_get_blender(&blend_op, &blend_mode_src, &blend_mode_dest);
@@ -555,6 +608,7 @@ image_fill(image_t* it, color_t color, float depth)
 	int             clip_y;
 	ALLEGRO_BITMAP* old_target;
 
+	galileo_flush();
 	uncache_pixels(it);
 	al_get_clipping_rectangle(&clip_x, &clip_y, &clip_width, &clip_height);
 	al_reset_clipping_rectangle();
@@ -575,6 +629,7 @@ image_flip(image_t* it, bool is_h_flip, bool is_v_flip)
 
 	if (!is_h_flip && !is_v_flip)  // this really shouldn't happen...
 		return true;
+	galileo_flush();
 	uncache_pixels(it);
 	if (!(new_bitmap = al_create_bitmap(it->width, it->height)))
 		return false;
@@ -594,17 +649,20 @@ image_flip(image_t* it, bool is_h_flip, bool is_v_flip)
 color_t
 image_get_pixel(image_t* it, int x, int y)
 {
-	if (it->pixel_cache == NULL) {
-		console_log(4, "image_get_pixel() cache miss for image #%u", it->id);
-		cache_pixels(it);
+	int tile_x;
+	int tile_y;
+
+	tile_x = x / PIXEL_TILE_SIZE;
+	tile_y = y / PIXEL_TILE_SIZE;
+	if (it->pixel_cache == NULL || !it->tile_valid[tile_x + tile_y * it->num_tiles_x]) {
+		console_log(4, "image_get_pixel() cache miss for image #%u tile (%d,%d)", it->id, tile_x, tile_y);
+		if (!cache_tile(it, tile_x, tile_y))
+			return mk_color(0, 0, 0, 0);
 	}
 	else {
 		++it->cache_hits;
 	}
-
-	return it->pixel_cache != NULL
-		? it->pixel_cache[x + y * it->width]
-		: mk_color(0, 0, 0, 0);
+	return it->pixel_cache[x + y * it->width];
 }
 
 image_lock_t*
@@ -614,6 +672,7 @@ image_lock(image_t* it, bool uploading, bool downloading)
 	int                    lock_flag;
 
 	if (it->lock_count == 0) {
+		galileo_flush();
 		lock_flag = downloading && uploading ? ALLEGRO_LOCK_READWRITE
 			: downloading ? ALLEGRO_LOCK_READONLY
 			: uploading ? ALLEGRO_LOCK_WRITEONLY
@@ -636,6 +695,10 @@ image_render_to(image_t* it, transform_t* transform)
 	ALLEGRO_TRANSFORM matrix;
 	rect_t            scissor;
 
+	// note: batched draws are submitted with the render state in effect when the batch
+	//       was started, so any pending batch must go out before that state changes.
+	galileo_flush();
+
 	if (it != s_last_image) {
 		al_set_target_bitmap(it->bitmap);
 		shader_use(NULL, true);
@@ -678,33 +741,22 @@ image_render_to(image_t* it, transform_t* transform)
 bool
 image_replace_color(image_t* it, color_t color, color_t new_color)
 {
-	ALLEGRO_BITMAP*        bitmap;
-	uint8_t*               pixel;
-	ALLEGRO_LOCKED_REGION* lock;
-	int                    w, h;
-
-	int i_x, i_y;
+	struct pixel_job job;
+	image_lock_t*    lock;
 
-	bitmap = image_bitmap(it);
-	if ((lock = al_lock_bitmap(bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888, ALLEGRO_LOCK_READWRITE)) == NULL)
+	if (!(lock = image_lock(it, true, true)))
 		return false;
 	uncache_pixels(it);
-	w = al_get_bitmap_width(bitmap);
-	h = al_get_bitmap_height(bitmap);
-	for (i_x = 0; i_x < w; ++i_x) for (i_y = 0; i_y < h; ++i_y) {
-		pixel = (uint8_t*)lock->data + i_x * 4 + i_y * lock->pitch;
-		if (pixel[0] == color.r &&
-		    pixel[1] == color.g &&
-		    pixel[2] == color.b &&
-		    pixel[3] == color.a)
-		{
-			pixel[0] = new_color.r;
-			pixel[1] = new_color.g;
-			pixel[2] = new_color.b;
-			pixel[3] = new_color.a;
-		}
-	}
-	al_unlock_bitmap(bitmap);
+	memset(&job, 0, sizeof(struct pixel_job));
+	job.op = PIXEL_OP_REPLACE;
+	job.color = color;
+	job.new_color = new_color;
+	job.pixels = lock->pixels;
+	job.pitch = lock->pitch;
+	job.width = it->width;
+	job.height = it->height;
+	run_pixel_job(&job);
+	image_unlock(it, lock);
 	return true;
 }
 
@@ -718,7 +770,8 @@ image_rescale(image_t* it, int width, int height)
 		return true;
 	if (!(new_bitmap = al_create_bitmap(width, height)))
 		return false;
-	uncache_pixels(it);
+	galileo_flush();
+	free_pixel_cache(it);
 	old_target = al_get_target_bitmap();
 	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
 	al_set_target_bitmap(new_bitmap);
@@ -762,7 +815,8 @@ image_set_pixel(image_t* it, int x, int y, color_t color)
 {
 	ALLEGRO_BITMAP* old_target;
 
-	uncache_pixels(it);
+	galileo_flush();
+	uncache_region(it, x, y, 1, 1);
 	old_target = al_get_target_bitmap();
 	al_set_target_bitmap(it->bitmap);
 	al_draw_pixel(x + 0.5, y + 0.5, nativecolor(color));
@@ -808,42 +862,345 @@ image_upload(image_t* it, const color_t* pixels)
 	return true;
 }
 
-static void
-cache_pixels(image_t* image)
+static bool
+cache_tile(image_t* image, int tile_x, int tile_y)
 {
-	color_t*      cache;
-	image_lock_t* lock;
-	void          *psrc, *pdest;
+	const uint8_t*         in_ptr;
+	ALLEGRO_LOCKED_REGION* ll_lock = NULL;
+	ptrdiff_t              in_pitch;
+	color_t*               out_ptr;
+	int                    x, y, width, height;
 
 	int i;
 
-	free(image->pixel_cache); image->pixel_cache = NULL;
-	if (!(lock = image_lock(image, false, true)))
-		goto on_error;
-	if (!(cache = malloc(image->width * image->height * 4)))
-		goto on_error;
-	console_log(4, "creating new pixel cache for image #%u", image->id);
-	for (i = 0; i < image->height; ++i) {
-		psrc = lock->pixels + i * lock->pitch;
-		pdest = cache + i * image->width;
-		memcpy(pdest, psrc, image->width * 4);
+	if (image->pixel_cache == NULL) {
+		image->num_tiles_x = (image->width + PIXEL_TILE_SIZE - 1) / PIXEL_TILE_SIZE;
+		image->num_tiles_y = (image->height + PIXEL_TILE_SIZE - 1) / PIXEL_TILE_SIZE;
+		if (!(image->tile_valid = calloc(image->num_tiles_x * image->num_tiles_y, sizeof(uint8_t))))
+			goto on_error;
+		if (!(image->pixel_cache = malloc((size_t)image->width * image->height * sizeof(color_t))))
+			goto on_error;
+		console_log(4, "creating new pixel cache for image #%u", image->id);
+		image->cache_hits = 0;
 	}
-	image_unlock(image, lock);
-	image->pixel_cache = cache;
-	image->cache_hits = 0;
-	return;
 
-on_error:
-	if (lock != NULL)
+	// note: if the image is already locked, read straight from the lock.  otherwise
+	//       only the tile itself is locked so the rest of the image doesn't need to be
+	//       downloaded.
+	x = tile_x * PIXEL_TILE_SIZE;
+	y = tile_y * PIXEL_TILE_SIZE;
+	width = x + PIXEL_TILE_SIZE <= image->width ? PIXEL_TILE_SIZE : image->width - x;
+	height = y + PIXEL_TILE_SIZE <= image->height ? PIXEL_TILE_SIZE : image->height - y;
+	if (image->lock_count > 0) {
+		in_ptr = (const uint8_t*)(image->lock.pixels + x + y * image->lock.pitch);
+		in_pitch = image->lock.pitch * sizeof(color_t);
+	}
+	else {
+		galileo_flush();
+		if (!(ll_lock = al_lock_bitmap_region(image->bitmap, x, y, width, height,
+			ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_READONLY)))
+		{
+			return false;
+		}
+		in_ptr = ll_lock->data;
+		in_pitch = ll_lock->pitch;
+	}
+	out_ptr = image->pixel_cache + x + y * image->width;
+	for (i = 0; i < height; ++i) {
+		memcpy(out_ptr, in_ptr, width * sizeof(color_t));
+		in_ptr += in_pitch;
+		out_ptr += image->width;
+	}
+	if (ll_lock != NULL)
 		al_unlock_bitmap(image->bitmap);
+	image->tile_valid[tile_x + tile_y * image->num_tiles_x] = 1;
+	return true;
+
+on_error:
+	free_pixel_cache(image);
+	return false;
+}
+
+static void
+color_fx_4_rows(const struct pixel_job* job)
+{
+	// this might be difficult to understand at first.  the implementation is, however,
+	// much easier to follow than the one in Sphere.  basically what it boils down to is
+	// bilinear interpolation, but with matrices.  it's much more straightforward than
+	// it sounds.
+
+	int        i1, i2;
+	color_fx_t mat_1, mat_2, mat_3;
+	color_t*   pixel;
+
+	int i_x, i_y;
+
+	for (i_y = job->y_start; i_y < job->y_end; ++i_y) {
+		// thankfully, we don't have to do a full bilinear interpolation every frame.
+		// two thirds of the work is done in the outer loop, giving us two color matrices
+		// which we then use in the inner loop to calculate the transforms for individual
+		// pixels.
+		i1 = job->y + job->height - 1 - i_y;
+		i2 = i_y - job->y;
+		mat_1 = color_fx_mix(job->matrices[0], job->matrices[2], i1, i2);
+		mat_2 = color_fx_mix(job->matrices[1], job->matrices[3], i1, i2);
+		pixel = &job->pixels[job->x + i_y * job->pitch];
+		for (i_x = job->x; i_x < job->x + job->width; ++i_x) {
+			// calculate the final matrix for this pixel and transform it
+			i1 = job->x + job->width - 1 - i_x;
+			i2 = i_x - job->x;
+			mat_3 = color_fx_mix(mat_1, mat_2, i1, i2);
+			*pixel = color_transform(*pixel, mat_3);
+			++pixel;
+		}
+	}
+}
+
+static void
+color_fx_rows(const struct pixel_job* job)
+{
+	color_fx_t mat;
+	color_t*   pixel;
+
+	int i_x, i_y;
+
+#if defined(HAVE_SSE2)
+	__m128i alpha_mask;
+	__m128i byte_mask;
+	__m128  divisor;
+	bool    use_simd;
+	__m128  m_rr, m_rg, m_rb, m_gr, m_gg, m_gb, m_br, m_bg, m_bb;
+	__m128i m_rn, m_gn, m_bn;
+	__m128i r, g, b, v;
+	__m128  fr, fg, fb;
+	__m128i zero;
+#endif
+
+	mat = job->matrices[0];
+
+#if defined(HAVE_SSE2)
+	// note: the vector path works in single precision, which is exact for integer sums
+	//       below 2^24.  that's guaranteed as long as no coefficient exceeds 21845 in
+	//       magnitude (3 * 255 * 21845 < 2^24), which covers any sane matrix.  anything
+	//       else goes through color_transform() to get identical results.
+	use_simd = abs(mat.rr) <= 21845 && abs(mat.rg) <= 21845 && abs(mat.rb) <= 21845
+		&& abs(mat.gr) <= 21845 && abs(mat.gg) <= 21845 && abs(mat.gb) <= 21845
+		&& abs(mat.br) <= 21845 && abs(mat.bg) <= 21845 && abs(mat.bb) <= 21845
+		&& abs(mat.rn) <= 0x1000000 && abs(mat.gn) <= 0x1000000 && abs(mat.bn) <= 0x1000000;
+	alpha_mask = _mm_set1_epi32((int)0xFF000000);
+	byte_mask = _mm_set1_epi32(0xFF);
+	divisor = _mm_set1_ps(255.0f);
+	zero = _mm_setzero_si128();
+	m_rr = _mm_set1_ps(mat.rr); m_rg = _mm_set1_ps(mat.rg); m_rb = _mm_set1_ps(mat.rb);
+	m_gr = _mm_set1_ps(mat.gr); m_gg = _mm_set1_ps(mat.gg); m_gb = _mm_set1_ps(mat.gb);
+	m_br = _mm_set1_ps(mat.br); m_bg = _mm_set1_ps(mat.bg); m_bb = _mm_set1_ps(mat.bb);
+	m_rn = _mm_set1_epi32(mat.rn);
+	m_gn = _mm_set1_epi32(mat.gn);
+	m_bn = _mm_set1_epi32(mat.bn);
+#endif
+
+	for (i_y = job->y_start; i_y < job->y_end; ++i_y) {
+		pixel = &job->pixels[job->x + i_y * job->pitch];
+		i_x = 0;
+#if defined(HAVE_SSE2)
+		// four pixels at a time: split out the channels into 32-bit lanes, transform
+		// them, then saturate back down to 8 bits.  alpha is passed through as-is.
+		for (; use_simd && i_x + 4 <= job->width; i_x += 4) {
+			v = _mm_loadu_si128((const __m128i*)&pixel[i_x]);
+			fr = _mm_cvtepi32_ps(_mm_and_si128(v, byte_mask));
+			fg = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), byte_mask));
+			fb = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), byte_mask));
+			r = _mm_cvttps_epi32(_mm_div_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(m_rr, fr), _mm_mul_ps(m_rg, fg)), _mm_mul_ps(m_rb, fb)), divisor));
+			g = _mm_cvttps_epi32(_mm_div_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(m_gr, fr), _mm_mul_ps(m_gg, fg)), _mm_mul_ps(m_gb, fb)), divisor));
+			b = _mm_cvttps_epi32(_mm_div_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(m_br, fr), _mm_mul_ps(m_bg, fg)), _mm_mul_ps(m_bb, fb)), divisor));
+			r = _mm_packs_epi32(_mm_add_epi32(r, m_rn), zero);
+			g = _mm_packs_epi32(_mm_add_epi32(g, m_gn), zero);
+			b = _mm_packs_epi32(_mm_add_epi32(b, m_bn), zero);
+			r = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_packus_epi16(r, zero), zero), zero);
+			g = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_packus_epi16(g, zero), zero), zero);
+			b = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_packus_epi16(b, zero), zero), zero);
+			v = _mm_or_si128(_mm_and_si128(v, alpha_mask), _mm_or_si128(r,
+				_mm_or_si128(_mm_slli_epi32(g, 8), _mm_slli_epi32(b, 16))));
+			_mm_storeu_si128((__m128i*)&pixel[i_x], v);
+		}
+#endif
+		for (; i_x < job->width; ++i_x)
+			pixel[i_x] = color_transform(pixel[i_x], mat);
+	}
+}
+
+static void
+free_pixel_cache(image_t* image)
+{
+	if (image->pixel_cache != NULL) {
+		console_log(4, "pixel cache freed for image #%u, hits: %u", image->id, image->cache_hits);
+	}
+	free(image->pixel_cache);
+	free(image->tile_valid);
+	image->pixel_cache = NULL;
+	image->tile_valid = NULL;
+}
+
+static void
+lookup_rows(const struct pixel_job* job)
+{
+	color_t* pixel;
+
+	int i_x, i_y;
+
+	for (i_y = job->y_start; i_y < job->y_end; ++i_y) {
+		pixel = &job->pixels[job->x + i_y * job->pitch];
+		for (i_x = 0; i_x < job->width; ++i_x) {
+			pixel[i_x].r = job->lookup[0][pixel[i_x].r];
+			pixel[i_x].g = job->lookup[1][pixel[i_x].g];
+			pixel[i_x].b = job->lookup[2][pixel[i_x].b];
+			pixel[i_x].a = job->lookup[3][pixel[i_x].a];
+		}
+	}
+}
+
+static void*
+pixel_job_proc(ALLEGRO_THREAD* thread, void* udata)
+{
+	const struct pixel_job* job;
+
+	job = udata;
+	switch (job->op) {
+	case PIXEL_OP_COLOR_FX:
+		color_fx_rows(job);
+		break;
+	case PIXEL_OP_COLOR_FX_4:
+		color_fx_4_rows(job);
+		break;
+	case PIXEL_OP_LOOKUP:
+		lookup_rows(job);
+		break;
+	case PIXEL_OP_REPLACE:
+		replace_rows(job);
+		break;
+	}
+	return NULL;
+}
+
+static void
+replace_rows(const struct pixel_job* job)
+{
+	uint32_t  match_value;
+	uint32_t  new_value;
+	uint32_t* pixel;
+
+	int i_x, i_y;
+
+#if defined(HAVE_SSE2)
+	__m128i mask;
+	__m128i match;
+	__m128i replacement;
+	__m128i v;
+#endif
+
+	// note: colors are compared and replaced as whole 32-bit words, which is the same
+	//       as checking all four channels.
+	memcpy(&match_value, &job->color, sizeof(uint32_t));
+	memcpy(&new_value, &job->new_color, sizeof(uint32_t));
+#if defined(HAVE_SSE2)
+	match = _mm_set1_epi32((int)match_value);
+	replacement = _mm_set1_epi32((int)new_value);
+#endif
+	for (i_y = job->y_start; i_y < job->y_end; ++i_y) {
+		pixel = (uint32_t*)&job->pixels[job->x + i_y * job->pitch];
+		i_x = 0;
+#if defined(HAVE_SSE2)
+		for (; i_x + 4 <= job->width; i_x += 4) {
+			v = _mm_loadu_si128((const __m128i*)&pixel[i_x]);
+			mask = _mm_cmpeq_epi32(v, match);
+			if (_mm_movemask_epi8(mask) == 0)
+				continue;  // nothing to replace, skip the store
+			v = _mm_or_si128(_mm_and_si128(mask, replacement), _mm_andnot_si128(mask, v));
+			_mm_storeu_si128((__m128i*)&pixel[i_x], v);
+		}
+#endif
+		for (; i_x < job->width; ++i_x) {
+			if (pixel[i_x] == match_value)
+				pixel[i_x] = new_value;
+		}
+	}
+}
+
+static void
+run_pixel_job(struct pixel_job* job)
+{
+	struct pixel_job jobs[MAX_PIXEL_THREADS];
+	int              num_threads = 1;
+	ALLEGRO_THREAD*  threads[MAX_PIXEL_THREADS];
+
+	int i;
+
+	if (job->width <= 0 || job->height <= 0)
+		return;
+
+	// every row is independent of the others, so each thread takes a band of rows.  the
+	// calling thread does the first band itself.
+	if ((int64_t)job->width * job->height >= MIN_PARALLEL_PIXELS) {
+		num_threads = al_get_cpu_count();
+		if (num_threads > MAX_PIXEL_THREADS)
+			num_threads = MAX_PIXEL_THREADS;
+		if (num_threads > job->height)
+			num_threads = job->height;
+	}
+	for (i = 0; i < num_threads; ++i) {
+		jobs[i] = *job;
+		jobs[i].y_start = job->y + (int)((int64_t)job->height * i / num_threads);
+		jobs[i].y_end = job->y + (int)((int64_t)job->height * (i + 1) / num_threads);
+		threads[i] = NULL;
+		if (i > 0 && (threads[i] = al_create_thread(pixel_job_proc, &jobs[i])))
+			al_start_thread(threads[i]);
+	}
+	pixel_job_proc(NULL, &jobs[0]);
+	for (i = 1; i < num_threads; ++i) {
+		if (threads[i] != NULL) {
+			al_join_thread(threads[i], NULL);
+			al_destroy_thread(threads[i]);
+		}
+		else {
+			// couldn't start a thread for this band, do it here instead
+			pixel_job_proc(NULL, &jobs[i]);
+		}
+	}
 }
 
 static void
 uncache_pixels(image_t* image)
 {
+	// note: the cache itself is kept around so the memory can be reused the next time
+	//       the image is read from.
 	if (image->pixel_cache == NULL)
 		return;
 	console_log(4, "pixel cache invalidated for image #%u, hits: %u", image->id, image->cache_hits);
-	free(image->pixel_cache);
-	image->pixel_cache = NULL;
+	memset(image->tile_valid, 0, image->num_tiles_x * image->num_tiles_y);
+}
+
+static void
+uncache_region(image_t* image, int x, int y, int width, int height)
+{
+	int x1, y1, x2, y2;
+
+	int i_x, i_y;
+
+	if (image->pixel_cache == NULL)
+		return;
+	x1 = x > 0 ? x : 0;
+	y1 = y > 0 ? y : 0;
+	x2 = x + width < image->width ? x + width : image->width;
+	y2 = y + height < image->height ? y + height : image->height;
+	if (x2 <= x1 || y2 <= y1)
+		return;
+	x1 /= PIXEL_TILE_SIZE;
+	y1 /= PIXEL_TILE_SIZE;
+	x2 = (x2 - 1) / PIXEL_TILE_SIZE;
+	y2 = (y2 - 1) / PIXEL_TILE_SIZE;
+	for (i_y = y1; i_y <= y2; ++i_y) for (i_x = x1; i_x <= x2; ++i_x)
+		image->tile_valid[i_x + i_y * image->num_tiles_x] = 0;
 }
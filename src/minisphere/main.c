@@ -54,6 +54,9 @@
 #include "spriteset.h"
 #include "vanilla.h"
 
+// don't bother with GC between frames when there's less than this much time to spare
+#define MIN_GC_SLACK 0.002
+
 // enable Windows visual styles (MSVC)
 #ifdef _MSC_VER
 #pragma comment(linker, \
@@ -66,6 +69,8 @@
 #endif
 
 game_t*   g_game = NULL;
+uint32_t  g_gc_count = 0;
+double    g_gc_time = 0.0;
 double    g_idle_time = 0.0;
 js_ref_t* g_main_object = NULL;
 screen_t* g_screen = NULL;
@@ -78,7 +83,6 @@ enum fullscreen_mode
 	FULLSCREEN_OFF,
 };
 
-static void on_enqueue_js_job   (void);
 static bool on_reject_promise   (void);
 static void on_socket_idle      (void);
 static bool initialize_engine   (void);
@@ -92,6 +96,8 @@ static void show_error_screen   (const char* message);
 
 static int                  s_event_loop_version;
 static ALLEGRO_EVENT_QUEUE* s_event_queue = NULL;
+static double               s_gc_cost;
+static size_t               s_gc_live_size;
 static path_t*              s_game_path = NULL;
 static path_t*              s_last_game_path = NULL;
 static bool                 s_restart_game = false;
@@ -482,6 +488,58 @@ sphere_change_game(const char* pathname)
 	sphere_restart();
 }
 
+double
+sphere_collect_garbage(double time_left)
+{
+	// note: this is called by screen_flip() with whatever time is left over before the next
+	//       frame is due, or INFINITY if the frame rate is unthrottled.  GC work done here is
+	//       work Chakra won't have to do later in the middle of a frame, which is where the
+	//       hitches come from.  a full collection is only done when the heap is over the
+	//       game's soft limit and the last one we did fits in the time available; otherwise
+	//       Chakra just gets an idle slice.  only full collections count as GC time, idle
+	//       slices are idle time as far as the profiler is concerned.
+
+	double elapsed;
+	size_t heap_limit;
+	size_t heap_size;
+	double start_time;
+	size_t threshold;
+
+	if (time_left < MIN_GC_SLACK)
+		return 0.0;
+
+	heap_limit = game_heap_limit(g_game);
+	heap_size = heap_limit > 0 ? jsal_heap_size() : 0;
+
+	// if most of the heap survived the last full pass, don't try again until it grows
+	// by half again.  otherwise a game whose live set is over the limit would end up
+	// doing a full collection every frame for nothing.
+	threshold = heap_limit;
+	if (s_gc_live_size + s_gc_live_size / 2 > threshold)
+		threshold = s_gc_live_size + s_gc_live_size / 2;
+
+	if (heap_limit == 0 || heap_size <= threshold) {
+		jsal_idle();
+		return 0.0;
+	}
+	if (time_left < s_gc_cost) {
+		// let the cost estimate decay while we're holding off, so that one unusually slow
+		// collection can't lock us out of doing full passes for the rest of the game.
+		s_gc_cost *= 0.9;
+		jsal_idle();
+		return 0.0;
+	}
+
+	start_time = al_get_time();
+	jsal_gc();
+	elapsed = al_get_time() - start_time;
+	s_gc_cost = s_gc_cost > 0.0 ? (s_gc_cost + elapsed) / 2.0 : elapsed;
+	s_gc_live_size = jsal_heap_size();
+	g_gc_time += elapsed;
+	++g_gc_count;
+	return elapsed;
+}
+
 void
 sphere_exit(bool allow_game_change)
 {
@@ -563,15 +621,6 @@ sphere_sleep(double time)
 	} while (al_get_time() < end_time);
 }
 
-static void
-on_enqueue_js_job(void)
-{
-	script_t* script;
-
-	script = script_new_function(0);
-	dispatch_defer(script, 0, JOB_ON_TICK, true);
-}
-
 static bool
 on_reject_promise(void)
 {
@@ -657,8 +706,10 @@ initialize_engine(void)
 	console_log(1, "initializing JavaScript");
 	if (!jsal_init())
 		goto on_error;
-	jsal_on_enqueue_job(on_enqueue_js_job);
+	jsal_enable_jobs(true);
 	jsal_on_reject_promise(on_reject_promise);
+	s_gc_cost = 0.0;
+	s_gc_live_size = 0;
 
 	// initialize engine components
 	dispatch_init();
@@ -696,6 +747,7 @@ shutdown_engine(void)
 
 	map_engine_uninit();
 	shutdown_input();
+	modules_uninit();
 	scripts_uninit();
 	sockets_uninit();
 
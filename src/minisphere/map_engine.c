@@ -38,6 +38,7 @@
 #include "color.h"
 #include "dispatch.h"
 #include "event_loop.h"
+#include "galileo.h"
 #include "geometry.h"
 #include "image.h"
 #include "input.h"
@@ -49,9 +50,30 @@
 #include "vanilla.h"
 #include "vector.h"
 
+// persons are filed into a spatial hash by the bounding box of their sprite base so
+// that collision checks only need to consider persons in the immediate vicinity.
+// each hash bucket covers all the PERSON_CELL_SIZE-square cells that hash to it,
+// across all layers, so candidates pulled from a bucket must still be tested.
+#define PERSON_CELL_SIZE 64
+#define PERSON_HASH_SIZE 1024
+
+// map layers are drawn in square chunks of LAYER_CHUNK_SIZE tiles on a side.  each chunk
+// is built into a single vertex buffer which is drawn in one go and only needs to be
+// rebuilt when tiles within it are changed.
+#define LAYER_CHUNK_SIZE 32
+
+// triggers and zones are indexed by a coarse grid laid over the map, at most
+// REGION_GRID_MAX cells on a side, so that finding the ones under a given point doesn't
+// mean testing all of them.  the grid is rebuilt on demand after any of them are added,
+// removed or moved.
+#define REGION_CELL_SIZE 64
+#define REGION_GRID_MAX  64
+
 static const person_t*     s_acting_person;
+static unsigned int        s_anim_serial = 0;
 static mixer_t*            s_bgm_mixer = NULL;
 static person_t*           s_camera_person = NULL;
+static vector_t*           s_person_hash[PERSON_HASH_SIZE];
 static int                 s_camera_x = 0;
 static int                 s_camera_y = 0;
 static color_t             s_color_mask;
@@ -93,6 +115,17 @@ struct deferred
 	int       frames_left;
 };
 
+struct region_grid
+{
+	int* cell_starts;
+	int  cell_h;
+	int  cell_w;
+	int* entries;
+	bool is_valid;
+	int  num_cols;
+	int  num_rows;
+};
+
 struct map
 {
 	int                width, height;
@@ -101,7 +134,9 @@ struct map
 	lstring_t*         bgm_file;
 	script_t*          scripts[MAP_SCRIPT_MAX];
 	tileset_t*         tileset;
+	struct region_grid trigger_grid;
 	vector_t*          triggers;
+	struct region_grid zone_grid;
 	vector_t*          zones;
 	int                num_layers;
 	int                num_persons;
@@ -111,20 +146,43 @@ struct map
 
 struct map_layer
 {
-	lstring_t*       name;
-	bool             is_parallax;
-	bool             is_reflective;
-	bool             is_visible;
-	float            autoscroll_x;
-	float            autoscroll_y;
-	color_t          color_mask;
-	int              height;
-	obsmap_t*        obsmap;
-	float            parallax_x;
-	float            parallax_y;
-	script_t*        render_script;
-	struct map_tile* tilemap;
-	int              width;
+	lstring_t*          name;
+	bool                is_parallax;
+	bool                is_reflective;
+	bool                is_visible;
+	float               autoscroll_x;
+	float               autoscroll_y;
+	struct layer_chunk* chunks;
+	color_t             color_mask;
+	int                 height;
+	int                 num_chunks_x;
+	int                 num_chunks_y;
+	obsmap_t*           obsmap;
+	float               parallax_x;
+	float               parallax_y;
+	script_t*           render_script;
+	struct map_tile*    tilemap;
+	int                 width;
+};
+
+struct layer_chunk
+{
+	vector_t*              anim_cells;
+	unsigned int           anim_serial;
+	ALLEGRO_VERTEX_BUFFER* buffer;
+	int                    dirty_first;
+	int                    dirty_last;
+	bool                   is_built;
+	int                    num_vertices;
+	unsigned int           revision;
+	ALLEGRO_VERTEX*        vertices;
+};
+
+struct anim_cell
+{
+	int frame_index;
+	int tile_index;
+	int vertex_index;
 };
 
 struct map_person
@@ -169,9 +227,13 @@ struct person
 	char*           direction;
 	int             follow_distance;
 	int             frame;
+	rect_t          hash_base;
+	int             hash_layer;
 	bool            ignore_all_persons;
 	bool            ignore_all_tiles;
 	vector_t*       ignore_list;
+	int             index;
+	bool            is_hashed;
 	bool            is_persistent;
 	bool            is_visible;
 	int             layer;
@@ -270,26 +332,43 @@ struct rmp_zone_header
 };
 #pragma pack(pop)
 
+static void                build_chunk          (struct map_layer* layer, struct layer_chunk* chunk, int chunk_x, int chunk_y);
+static bool                build_region_grid    (struct region_grid* grid, const rect_t* rects, int num_rects, int width, int height);
 static bool                change_map           (const char* filename, bool preserve_persons);
 static void                command_person       (person_t* person, int command);
 static int                 compare_persons      (const void* a, const void* b);
 static void                detach_person        (const person_t* person);
 static bool                does_person_exist    (const person_t* person);
+static void                draw_layer_tiles     (struct map_layer* layer, bool is_repeating, int off_x, int off_y);
 static void                draw_persons         (int layer, bool is_flipped, int cam_x, int cam_y);
 static bool                enlarge_step_history (person_t* person, int new_size);
+static void                free_layer_chunks    (struct map_layer* layer);
 static void                free_map             (struct map* map);
 static void                free_person          (person_t* person);
+static void                free_region_grid     (struct region_grid* grid);
 static struct map_trigger* get_trigger_at       (int x, int y, int layer, int* out_index);
 static struct map_zone*    get_zone_at          (int x, int y, int layer, int which, int* out_index);
+static void                hash_person          (person_t* person);
+static bool                index_triggers       (void);
+static bool                index_zones          (void);
+static void                invalidate_chunk     (struct map_layer* layer, int x, int y);
 static struct map*         load_map             (const char* path);
 static void                map_screen_to_layer  (int layer, int camera_x, int camera_y, int* inout_x, int* inout_y);
 static void                map_screen_to_map    (int camera_x, int camera_y, int* inout_x, int* inout_y);
+static unsigned int        person_bucket_of     (int cell_x, int cell_y);
+static int                 person_cell_of       (int coordinate);
 static void                process_map_input    (void);
+static const int*          query_region_grid    (const struct region_grid* grid, int x, int y, int* out_count);
 static void                record_step          (person_t* person);
+static int                 region_cell_of       (int coordinate, int cell_size, int num_cells);
 static void                reset_persons        (bool keep_existing);
 static void                set_person_name      (person_t* person, const char* name);
+static void                set_tile_uv          (ALLEGRO_VERTEX* vertices, rect_t uv);
 static void                sort_persons         (void);
+static rect_t              trigger_bounds       (const struct map_trigger* trigger);
+static void                update_chunk         (struct map_layer* layer, struct layer_chunk* chunk, int chunk_x, int chunk_y);
 static void                update_map_engine    (bool is_main_loop);
+static void                unhash_person        (person_t* person);
 static void                update_person        (person_t* person, bool* out_has_moved);
 
 bool
@@ -309,6 +388,8 @@ map_engine_init(void)
 	s_camera_person = NULL;
 	if (!(s_players = calloc(PLAYER_MAX, sizeof(struct player))))
 		return false;
+	for (i = 0; i < PERSON_HASH_SIZE; ++i)
+		s_person_hash[i] = vector_new(sizeof(person_t*));
 	for (i = 0; i < PLAYER_MAX; ++i)
 		s_players[i].is_talk_allowed = true;
 	s_current_trigger = -1;
@@ -355,6 +436,8 @@ map_engine_uninit(void)
 	for (i = 0; i < PERSON_SCRIPT_MAX; ++i)
 		script_unref(s_def_person_scripts[i]);
 	free(s_persons);
+	for (i = 0; i < PERSON_HASH_SIZE; ++i)
+		vector_free(s_person_hash[i]);
 
 	mixer_unref(s_bgm_mixer);
 
@@ -542,16 +625,11 @@ void
 map_engine_draw_map(void)
 {
 	bool              is_repeating;
-	int               cell_x;
-	int               cell_y;
-	int               first_cell_x;
-	int               first_cell_y;
 	struct map_layer* layer;
 	int               layer_height;
 	int               layer_width;
 	size2_t           resolution;
 	int               tile_height;
-	int               tile_index;
 	int               tile_width;
 	int               off_x;
 	int               off_y;
@@ -574,6 +652,10 @@ map_engine_draw_map(void)
 		off_y = 0;
 		map_screen_to_layer(z, s_camera_x, s_camera_y, &off_x, &off_y);
 
+		// the previous layer's render script may have left batched draws pending, which
+		// need to go out before anything is drawn directly.
+		galileo_flush();
+
 		// render person reflections if layer is reflective
 		al_hold_bitmap_drawing(true);
 		if (layer->is_reflective) {
@@ -586,18 +668,12 @@ map_engine_draw_map(void)
 			}
 		}
 
-		// render tiles, but only if the layer is visible
+		// render tiles, but only if the layer is visible.  tiles are drawn as primitives
+		// rather than bitmaps, so drawing can't be held while they're being drawn.
 		if (layer->is_visible) {
-			first_cell_x = off_x / tile_width;
-			first_cell_y = off_y / tile_height;
-			for (y = 0; y < resolution.height / tile_height + 2; ++y) for (x = 0; x < resolution.width / tile_width + 2; ++x) {
-				cell_x = is_repeating ? (x + first_cell_x) % layer->width : x + first_cell_x;
-				cell_y = is_repeating ? (y + first_cell_y) % layer->height : y + first_cell_y;
-				if (cell_x < 0 || cell_x >= layer->width || cell_y < 0 || cell_y >= layer->height)
-					continue;
-				tile_index = layer->tilemap[cell_x + cell_y * layer->width].tile_index;
-				tileset_draw(s_map->tileset, layer->color_mask, x * tile_width - off_x % tile_width, y * tile_height - off_y % tile_height, tile_index);
-			}
+			al_hold_bitmap_drawing(false);
+			draw_layer_tiles(layer, is_repeating, off_x, off_y);
+			al_hold_bitmap_drawing(true);
 		}
 
 		// render persons
@@ -613,6 +689,7 @@ map_engine_draw_map(void)
 		script_run(layer->render_script, false);
 	}
 
+	galileo_flush();
 	al_draw_filled_rectangle(0, 0, resolution.width, resolution.height, nativecolor(s_color_mask));
 	script_run(s_render_script, false);
 }
@@ -647,6 +724,7 @@ map_engine_start(const char* filename, int framerate)
 	s_color_mask = mk_color(0, 0, 0, 0);
 	s_fade_color_to = s_fade_color_from = s_color_mask;
 	s_fade_progress = s_fade_frames = 0;
+	galileo_flush();
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 	s_frame_rate = framerate;
 	if (!change_map(filename, true))
@@ -781,25 +859,11 @@ map_tileset(void)
 int
 map_trigger_at(int x, int y, int layer)
 {
-	rect_t              bounds;
-	int                 tile_w, tile_h;
-	struct map_trigger* trigger;
-
-	iter_t iter;
+	int index;
 
-	tileset_get_size(s_map->tileset, &tile_w, &tile_h);
-	iter = vector_enum(s_map->triggers);
-	while ((trigger = iter_next(&iter))) {
-		if (trigger->z != layer && false)  // layer ignored for compatibility
-			continue;
-		bounds.x1 = trigger->x - tile_w / 2;
-		bounds.y1 = trigger->y - tile_h / 2;
-		bounds.x2 = bounds.x1 + tile_w;
-		bounds.y2 = bounds.y1 + tile_h;
-		if (is_point_in_rect(x, y, bounds))
-			return iter.index;
-	}
-	return -1;
+	if (get_trigger_at(x, y, layer, &index) == NULL)
+		return -1;
+	return index;
 }
 
 point2_t
@@ -817,18 +881,11 @@ map_xy_from_screen(point2_t screen_xy)
 int
 map_zone_at(int x, int y, int layer, int which)
 {
-	struct map_zone* zone;
-
-	iter_t iter;
+	int index;
 
-	iter = vector_enum(s_map->zones);
-	while ((zone = iter_next(&iter))) {
-		if (zone->layer != layer && false)  // layer ignored for compatibility
-			continue;
-		if (is_point_in_rect(x, y, zone->bounds) && --which < 0)
-			return iter.index;
-	}
-	return -1;
+	if (get_zone_at(x, y, layer, which > 0 ? which : 0, &index) == NULL)
+		return -1;
+	return index;
 }
 
 point2_t
@@ -865,6 +922,7 @@ map_add_trigger(int x, int y, int layer, script_t* script)
 	trigger.script = script_ref(script);
 	if (!vector_push(s_map->triggers, &trigger))
 		return false;
+	s_map->trigger_grid.is_valid = false;
 	return true;
 }
 
@@ -884,6 +942,7 @@ map_add_zone(rect_t bounds, int layer, script_t* script, int steps)
 	zone.steps_left = 0;
 	if (!vector_push(s_map->zones, &zone))
 		return false;
+	s_map->zone_grid.is_valid = false;
 	return true;
 }
 
@@ -916,12 +975,14 @@ void
 map_remove_trigger(int trigger_index)
 {
 	vector_remove(s_map->triggers, trigger_index);
+	s_map->trigger_grid.is_valid = false;
 }
 
 void
 map_remove_zone(int zone_index)
 {
 	vector_remove(s_map->zones, zone_index);
+	s_map->zone_grid.is_valid = false;
 }
 
 void
@@ -984,7 +1045,14 @@ layer_get_visible(int layer)
 void
 layer_set_color_mask(int layer, color_t color)
 {
+	color_t old_mask;
+
+	// the color mask is baked into the layer's vertex buffers, so they need to be
+	// rebuilt if it changes.
+	old_mask = s_map->layers[layer].color_mask;
 	s_map->layers[layer].color_mask = color;
+	if (color.r != old_mask.r || color.g != old_mask.g || color.b != old_mask.b || color.a != old_mask.a)
+		free_layer_chunks(&s_map->layers[layer]);
 }
 
 void
@@ -1003,6 +1071,7 @@ layer_set_tile(int layer, int x, int y, int tile_index)
 	tile = &s_map->layers[layer].tilemap[x + y * width];
 	tile->tile_index = tile_index;
 	tile->frames_left = tileset_get_delay(s_map->tileset, tile_index);
+	invalidate_chunk(&s_map->layers[layer], x, y);
 }
 
 void
@@ -1024,8 +1093,10 @@ layer_replace_tiles(int layer, int old_index, int new_index)
 	layer_h = s_map->layers[layer].height;
 	for (i_x = 0; i_x < layer_w; ++i_x) for (i_y = 0; i_y < layer_h; ++i_y) {
 		tile = &s_map->layers[layer].tilemap[i_x + i_y * layer_w];
-		if (tile->tile_index == old_index)
+		if (tile->tile_index == old_index) {
 			tile->tile_index = new_index;
+			invalidate_chunk(&s_map->layers[layer], i_x, i_y);
+		}
 	}
 }
 
@@ -1068,6 +1139,7 @@ layer_resize(int layer, int x_size, int y_size)
 	}
 
 	// free the old tilemap and substitute the new one
+	free_layer_chunks(&s_map->layers[layer]);
 	free(s_map->layers[layer].tilemap);
 	s_map->layers[layer].tilemap = tilemap;
 	s_map->layers[layer].width = x_size;
@@ -1085,6 +1157,11 @@ layer_resize(int layer, int x_size, int y_size)
 		}
 	}
 
+	// on a repeating map, the layer size affects where persons end up after
+	// wraparound, so they all need to be refiled.
+	for (i = 0; i < s_num_persons; ++i)
+		hash_person(s_persons[i]);
+
 	// ensure zones and triggers remain in-bounds.  if any are completely
 	// out-of-bounds, delete them.
 	for (i = vector_len(s_map->zones) - 1; i >= 0; --i) {
@@ -1104,6 +1181,8 @@ layer_resize(int layer, int x_size, int y_size)
 		if (trigger->x >= s_map->width || trigger->y >= s_map->height)
 			vector_remove(s_map->triggers, i);
 	}
+	s_map->trigger_grid.is_valid = false;
+	s_map->zone_grid.is_valid = false;
 
 	return true;
 }
@@ -1135,6 +1214,8 @@ person_new(const char* name, spriteset_t* spriteset, bool is_persistent, script_
 	person->anim_frames = spriteset_frame_delay(person->sprite, person->direction, 0);
 	person->mask = mk_color(255, 255, 255, 255);
 	person->scale_x = person->scale_y = 1.0;
+	person->index = s_num_persons - 1;
+	hash_person(person);
 	person->scripts[PERSON_SCRIPT_ON_CREATE] = create_script;
 	person_activate(person, PERSON_SCRIPT_ON_CREATE, NULL, true);
 	sort_persons();
@@ -1256,10 +1337,13 @@ person_obstructed_at(const person_t* person, double x, double y, person_t** out_
 {
 	rect_t           area;
 	rect_t           base, my_base;
+	vector_t*        bucket;
+	person_t*        candidate;
 	double           cur_x, cur_y;
 	bool             is_obstructed = false;
 	int              layer;
 	const obsmap_t*  obsmap;
+	person_t*        obstructing_person = NULL;
 	int              tile_w, tile_h;
 	const tileset_t* tileset;
 
@@ -1274,22 +1358,36 @@ person_obstructed_at(const person_t* person, double x, double y, person_t** out_
 		*out_tile_index = -1;
 
 	// check for obstructing persons
+	// note: only persons filed under the same hash cells as our base can possibly overlap it.
+	//       if more than one person does, the one earliest in the sort order wins, as it
+	//       would for a full scan of the person list.
 	if (!person->ignore_all_persons) {
-		for (i = 0; i < s_num_persons; ++i) {
-			if (s_persons[i] == person)  // these persons aren't going to obstruct themselves!
-				continue;
-			if (s_persons[i]->layer != layer)
-				continue;  // ignore persons not on the same layer
-			if (person_following(s_persons[i], person))
-				continue;  // ignore own followers
-			base = person_base(s_persons[i]);
-			if (do_rects_overlap(my_base, base) && !person_ignored_by(person, s_persons[i])) {
-				is_obstructed = true;
-				if (out_obstructing_person)
-					*out_obstructing_person = s_persons[i];
-				break;
+		area.x1 = person_cell_of(my_base.x1);
+		area.y1 = person_cell_of(my_base.y1);
+		area.x2 = person_cell_of(my_base.x2);
+		area.y2 = person_cell_of(my_base.y2);
+		for (i_y = area.y1; i_y <= area.y2; ++i_y) for (i_x = area.x1; i_x <= area.x2; ++i_x) {
+			bucket = s_person_hash[person_bucket_of(i_x, i_y)];
+			for (i = 0; i < vector_len(bucket); ++i) {
+				candidate = *(person_t**)vector_get(bucket, i);
+				if (candidate == person)  // these persons aren't going to obstruct themselves!
+					continue;
+				if (candidate->layer != layer)
+					continue;  // ignore persons not on the same layer
+				if (obstructing_person != NULL && candidate->index >= obstructing_person->index)
+					continue;  // already found one earlier in the sort order
+				if (person_following(candidate, person))
+					continue;  // ignore own followers
+				base = person_base(candidate);
+				if (do_rects_overlap(my_base, base) && !person_ignored_by(person, candidate))
+					obstructing_person = candidate;
 			}
 		}
+		if (obstructing_person != NULL) {
+			is_obstructed = true;
+			if (out_obstructing_person)
+				*out_obstructing_person = obstructing_person;
+		}
 	}
 
 	// no obstructing person, check map-defined obstructions
@@ -1488,6 +1586,7 @@ void
 person_set_layer(person_t* person, int layer)
 {
 	person->layer = layer;
+	hash_person(person);
 }
 
 bool
@@ -1541,6 +1640,7 @@ person_set_scale(person_t* person, double scale_x, double scale_y)
 {
 	person->scale_x = scale_x;
 	person->scale_y = scale_y;
+	hash_person(person);
 }
 
 void
@@ -1560,6 +1660,7 @@ person_set_spriteset(person_t* person, spriteset_t* spriteset)
 	person->anim_frames = spriteset_frame_delay(person->sprite, person->direction, 0);
 	person->frame = 0;
 	spriteset_unref(old_spriteset);
+	hash_person(person);
 }
 
 void
@@ -1581,6 +1682,7 @@ person_set_xyz(person_t* person, double x, double y, int layer)
 	person->x = x;
 	person->y = y;
 	person->layer = layer;
+	hash_person(person);
 	sort_persons();
 }
 
@@ -1794,6 +1896,7 @@ trigger_set_xy(int trigger_index, int x, int y)
 	trigger = vector_get(s_map->triggers, trigger_index);
 	trigger->x = x;
 	trigger->y = y;
+	s_map->trigger_grid.is_valid = false;
 }
 
 void
@@ -1844,6 +1947,7 @@ zone_set_bounds(int zone_index, rect_t bounds)
 	zone = vector_get(s_map->zones, zone_index);
 	rect_normalize(&bounds);
 	zone->bounds = bounds;
+	s_map->zone_grid.is_valid = false;
 }
 
 void
@@ -1890,6 +1994,165 @@ zone_activate(int zone_index)
 	s_current_zone = last_zone;
 }
 
+static void
+build_chunk(struct map_layer* layer, struct layer_chunk* chunk, int chunk_x, int chunk_y)
+{
+	struct anim_cell anim_cell;
+	ALLEGRO_COLOR    color;
+	int              frame_index;
+	int              num_tiles;
+	int              num_vertices = 0;
+	int              tile_height;
+	int              tile_index;
+	int              tile_width;
+	tileset_t*       tileset;
+	ALLEGRO_VERTEX*  vertices;
+	ALLEGRO_VERTEX*  v;
+	float            x_off;
+	float            y_off;
+	int              x1, y1, x2, y2;
+
+	int i, x, y;
+
+	tileset = s_map->tileset;
+	tileset_get_size(tileset, &tile_width, &tile_height);
+	num_tiles = tileset_len(tileset);
+	color = nativecolor(layer->color_mask);
+	x1 = chunk_x * LAYER_CHUNK_SIZE;
+	y1 = chunk_y * LAYER_CHUNK_SIZE;
+	x2 = x1 + LAYER_CHUNK_SIZE < layer->width ? x1 + LAYER_CHUNK_SIZE : layer->width;
+	y2 = y1 + LAYER_CHUNK_SIZE < layer->height ? y1 + LAYER_CHUNK_SIZE : layer->height;
+
+	if (chunk->buffer != NULL)
+		al_destroy_vertex_buffer(chunk->buffer);
+	free(chunk->vertices);
+	chunk->buffer = NULL;
+	chunk->vertices = NULL;
+	chunk->num_vertices = 0;
+	chunk->dirty_first = -1;
+	if (chunk->anim_cells == NULL)
+		chunk->anim_cells = vector_new(sizeof(struct anim_cell));
+	vector_clear(chunk->anim_cells);
+
+	if (!(vertices = malloc((x2 - x1) * (y2 - y1) * 6 * sizeof(ALLEGRO_VERTEX))))
+		return;
+	for (y = y1; y < y2; ++y) for (x = x1; x < x2; ++x) {
+		tile_index = layer->tilemap[x + y * layer->width].tile_index;
+		if (tile_index < 0 || tile_index >= num_tiles)
+			continue;
+		frame_index = tileset_get_frame(tileset, tile_index);
+		x_off = (x - x1) * tile_width;
+		y_off = (y - y1) * tile_height;
+		v = &vertices[num_vertices];
+		v[0].x = x_off; v[0].y = y_off;
+		v[1].x = x_off + tile_width; v[1].y = y_off;
+		v[2].x = x_off; v[2].y = y_off + tile_height;
+		v[3].x = x_off + tile_width; v[3].y = y_off;
+		v[4].x = x_off + tile_width; v[4].y = y_off + tile_height;
+		v[5].x = x_off; v[5].y = y_off + tile_height;
+		for (i = 0; i < 6; ++i) {
+			v[i].z = 0.0f;
+			v[i].color = color;
+		}
+		set_tile_uv(v, tileset_get_uv(tileset, frame_index));
+
+		// keep track of any animated tiles so their texture coordinates can be
+		// updated when the animation advances.
+		if (frame_index != tile_index || tileset_get_next(tileset, tile_index) != tile_index) {
+			anim_cell.frame_index = frame_index;
+			anim_cell.tile_index = tile_index;
+			anim_cell.vertex_index = num_vertices;
+			vector_push(chunk->anim_cells, &anim_cell);
+		}
+		num_vertices += 6;
+	}
+	chunk->vertices = vertices;
+	chunk->num_vertices = num_vertices;
+	chunk->anim_serial = s_anim_serial;
+	chunk->revision = tileset_revision(tileset);
+	chunk->is_built = true;
+
+	// if a vertex buffer can't be created (e.g. because the hardware doesn't support
+	// them), the chunk will be drawn straight from system memory instead.
+	if (num_vertices > 0)
+		chunk->buffer = al_create_vertex_buffer(NULL, vertices, num_vertices, ALLEGRO_PRIM_BUFFER_DYNAMIC);
+}
+
+static bool
+build_region_grid(struct region_grid* grid, const rect_t* rects, int num_rects, int width, int height)
+{
+	int* cell_starts = NULL;
+	int  cell_h;
+	int  cell_w;
+	int* entries = NULL;
+	int  num_cells;
+	int  num_cols;
+	int  num_entries = 0;
+	int  num_rows;
+	int  x1, y1, x2, y2;
+
+	int i, x, y;
+
+	free_region_grid(grid);
+	num_cols = (width + REGION_CELL_SIZE - 1) / REGION_CELL_SIZE;
+	num_rows = (height + REGION_CELL_SIZE - 1) / REGION_CELL_SIZE;
+	num_cols = num_cols < 1 ? 1 : num_cols > REGION_GRID_MAX ? REGION_GRID_MAX : num_cols;
+	num_rows = num_rows < 1 ? 1 : num_rows > REGION_GRID_MAX ? REGION_GRID_MAX : num_rows;
+	cell_w = width > num_cols ? (width + num_cols - 1) / num_cols : 1;
+	cell_h = height > num_rows ? (height + num_rows - 1) / num_rows : 1;
+	num_cells = num_cols * num_rows;
+
+	// two passes: the first counts how many regions overlap each cell, the second files
+	// them.  rects are filed in order so each cell's list comes out sorted by index.
+	if (!(cell_starts = calloc(num_cells + 1, sizeof(int))))
+		goto on_error;
+	for (i = 0; i < num_rects; ++i) {
+		if (rects[i].x2 <= rects[i].x1 || rects[i].y2 <= rects[i].y1)
+			continue;  // empty rect, can't contain any points
+		x1 = region_cell_of(rects[i].x1, cell_w, num_cols);
+		y1 = region_cell_of(rects[i].y1, cell_h, num_rows);
+		x2 = region_cell_of(rects[i].x2 - 1, cell_w, num_cols);
+		y2 = region_cell_of(rects[i].y2 - 1, cell_h, num_rows);
+		for (y = y1; y <= y2; ++y) for (x = x1; x <= x2; ++x)
+			++cell_starts[x + y * num_cols + 1];
+		num_entries += (x2 - x1 + 1) * (y2 - y1 + 1);
+	}
+	for (i = 1; i <= num_cells; ++i)
+		cell_starts[i] += cell_starts[i - 1];
+	if (!(entries = malloc((num_entries + 1) * sizeof(int))))
+		goto on_error;
+	for (i = 0; i < num_rects; ++i) {
+		if (rects[i].x2 <= rects[i].x1 || rects[i].y2 <= rects[i].y1)
+			continue;
+		x1 = region_cell_of(rects[i].x1, cell_w, num_cols);
+		y1 = region_cell_of(rects[i].y1, cell_h, num_rows);
+		x2 = region_cell_of(rects[i].x2 - 1, cell_w, num_cols);
+		y2 = region_cell_of(rects[i].y2 - 1, cell_h, num_rows);
+		for (y = y1; y <= y2; ++y) for (x = x1; x <= x2; ++x)
+			entries[cell_starts[x + y * num_cols]++] = i;
+	}
+
+	// filing the entries advanced each cell's start to where the next one begins, so
+	// shift everything back into place.
+	for (i = num_cells; i > 0; --i)
+		cell_starts[i] = cell_starts[i - 1];
+	cell_starts[0] = 0;
+
+	grid->cell_starts = cell_starts;
+	grid->cell_h = cell_h;
+	grid->cell_w = cell_w;
+	grid->entries = entries;
+	grid->num_cols = num_cols;
+	grid->num_rows = num_rows;
+	grid->is_valid = true;
+	return true;
+
+on_error:
+	free(cell_starts);
+	free(entries);
+	return false;
+}
+
 static bool
 change_map(const char* filename, bool preserve_persons)
 {
@@ -2046,6 +2309,7 @@ command_person(person_t* person, int command)
 				person->mv_y = new_y > person->y ? 1 : -1;
 			person->x = new_x;
 			person->y = new_y;
+			hash_person(person);
 		}
 		else {
 			// if not, and we collided with a person, call that person's touch script
@@ -2100,6 +2364,91 @@ does_person_exist(const person_t* person)
 	return false;
 }
 
+static void
+draw_layer_tiles(struct map_layer* layer, bool is_repeating, int off_x, int off_y)
+{
+	ALLEGRO_BITMAP*     bitmap;
+	struct layer_chunk* chunk;
+	int                 chunk_height;
+	int                 chunk_width;
+	int                 layer_height;
+	int                 layer_width;
+	ALLEGRO_TRANSFORM   matrix;
+	ALLEGRO_TRANSFORM   old_matrix;
+	size2_t             resolution;
+	int                 tile_height;
+	int                 tile_width;
+	int                 x_origin;
+	int                 y_origin;
+	int                 c_x1, c_y1, c_x2, c_y2;
+	int                 r_x1, r_y1, r_x2, r_y2;
+
+	int c_x, c_y, r_x, r_y;
+
+	if (layer->width <= 0 || layer->height <= 0)
+		return;
+
+	resolution = screen_size(g_screen);
+	tileset_get_size(s_map->tileset, &tile_width, &tile_height);
+	layer_width = layer->width * tile_width;
+	layer_height = layer->height * tile_height;
+	chunk_width = LAYER_CHUNK_SIZE * tile_width;
+	chunk_height = LAYER_CHUNK_SIZE * tile_height;
+	if (layer->chunks == NULL) {
+		// chunks are created on demand and built the first time they're drawn
+		layer->num_chunks_x = (layer->width + LAYER_CHUNK_SIZE - 1) / LAYER_CHUNK_SIZE;
+		layer->num_chunks_y = (layer->height + LAYER_CHUNK_SIZE - 1) / LAYER_CHUNK_SIZE;
+		if (!(layer->chunks = calloc(layer->num_chunks_x * layer->num_chunks_y, sizeof(struct layer_chunk))))
+			return;
+	}
+
+	// on a repeating layer, the layer itself gets drawn as many times as necessary to
+	// cover the whole screen.
+	r_x1 = r_x2 = 0;
+	r_y1 = r_y2 = 0;
+	if (is_repeating) {
+		r_x1 = (int)floor((double)off_x / layer_width);
+		r_y1 = (int)floor((double)off_y / layer_height);
+		r_x2 = (int)floor((double)(off_x + resolution.width - 1) / layer_width);
+		r_y2 = (int)floor((double)(off_y + resolution.height - 1) / layer_height);
+	}
+
+	bitmap = image_bitmap(tileset_texture(s_map->tileset));
+	al_copy_transform(&old_matrix, al_get_current_transform());
+	for (r_y = r_y1; r_y <= r_y2; ++r_y) for (r_x = r_x1; r_x <= r_x2; ++r_x) {
+		// only draw the chunks which are actually on screen
+		x_origin = r_x * layer_width - off_x;
+		y_origin = r_y * layer_height - off_y;
+		c_x1 = (int)floor((double)-x_origin / chunk_width);
+		c_y1 = (int)floor((double)-y_origin / chunk_height);
+		c_x2 = (int)floor((double)(resolution.width - 1 - x_origin) / chunk_width);
+		c_y2 = (int)floor((double)(resolution.height - 1 - y_origin) / chunk_height);
+		if (c_x1 < 0)
+			c_x1 = 0;
+		if (c_y1 < 0)
+			c_y1 = 0;
+		if (c_x2 >= layer->num_chunks_x)
+			c_x2 = layer->num_chunks_x - 1;
+		if (c_y2 >= layer->num_chunks_y)
+			c_y2 = layer->num_chunks_y - 1;
+		for (c_y = c_y1; c_y <= c_y2; ++c_y) for (c_x = c_x1; c_x <= c_x2; ++c_x) {
+			chunk = &layer->chunks[c_x + c_y * layer->num_chunks_x];
+			update_chunk(layer, chunk, c_x, c_y);
+			if (chunk->num_vertices == 0)
+				continue;
+			al_identity_transform(&matrix);
+			al_translate_transform(&matrix, x_origin + c_x * chunk_width, y_origin + c_y * chunk_height);
+			al_compose_transform(&matrix, &old_matrix);
+			al_use_transform(&matrix);
+			if (chunk->buffer != NULL)
+				al_draw_vertex_buffer(chunk->buffer, bitmap, 0, chunk->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+			else
+				al_draw_prim(chunk->vertices, NULL, bitmap, 0, chunk->num_vertices, ALLEGRO_PRIM_TRIANGLE_LIST);
+		}
+	}
+	al_use_transform(&old_matrix);
+}
+
 void
 draw_persons(int layer, bool is_flipped, int cam_x, int cam_y)
 {
@@ -2154,6 +2503,26 @@ enlarge_step_history(person_t* person, int new_size)
 	return true;
 }
 
+static void
+free_layer_chunks(struct map_layer* layer)
+{
+	struct layer_chunk* chunk;
+
+	int i;
+
+	if (layer->chunks == NULL)
+		return;
+	for (i = 0; i < layer->num_chunks_x * layer->num_chunks_y; ++i) {
+		chunk = &layer->chunks[i];
+		if (chunk->buffer != NULL)
+			al_destroy_vertex_buffer(chunk->buffer);
+		free(chunk->vertices);
+		vector_free(chunk->anim_cells);
+	}
+	free(layer->chunks);
+	layer->chunks = NULL;
+}
+
 static void
 free_map(struct map* map)
 {
@@ -2170,6 +2539,7 @@ free_map(struct map* map)
 	for (i = 0; i < map->num_layers; ++i) {
 		script_unref(map->layers[i].render_script);
 		lstr_free(map->layers[i].name);
+		free_layer_chunks(&map->layers[i]);
 		free(map->layers[i].tilemap);
 		obsmap_free(map->layers[i].obsmap);
 	}
@@ -2192,6 +2562,8 @@ free_map(struct map* map)
 	tileset_free(map->tileset);
 	free(map->layers);
 	free(map->persons);
+	free_region_grid(&map->trigger_grid);
+	free_region_grid(&map->zone_grid);
 	vector_free(map->triggers);
 	vector_free(map->zones);
 	free(map);
@@ -2202,6 +2574,7 @@ free_person(person_t* person)
 {
 	int i;
 
+	unhash_person(person);
 	free(person->steps);
 	for (i = 0; i < PERSON_SCRIPT_MAX; ++i)
 		script_unref(person->scripts[i]);
@@ -2212,56 +2585,171 @@ free_person(person_t* person)
 	free(person);
 }
 
+static void
+free_region_grid(struct region_grid* grid)
+{
+	free(grid->cell_starts);
+	free(grid->entries);
+	grid->cell_starts = NULL;
+	grid->entries = NULL;
+	grid->is_valid = false;
+}
+
 static struct map_trigger*
 get_trigger_at(int x, int y, int layer, int* out_index)
 {
-	rect_t              bounds;
-	struct map_trigger* found_item = NULL;
-	int                 tile_w, tile_h;
+	const int*          candidates;
+	int                 index;
+	int                 num_candidates;
 	struct map_trigger* trigger;
 
-	iter_t iter;
+	int i;
 
-	tileset_get_size(s_map->tileset, &tile_w, &tile_h);
-	iter = vector_enum(s_map->triggers);
-	while ((trigger = iter_next(&iter))) {
+	// note: candidates are listed in index order, so the first hit is the same
+	//       trigger a full scan would find.  if the grid can't be built for some
+	//       reason, fall back on testing every trigger.
+	if (!s_map->trigger_grid.is_valid)
+		index_triggers();
+	candidates = query_region_grid(&s_map->trigger_grid, x, y, &num_candidates);
+	if (candidates == NULL)
+		num_candidates = vector_len(s_map->triggers);
+	for (i = 0; i < num_candidates; ++i) {
+		index = candidates != NULL ? candidates[i] : i;
+		trigger = vector_get(s_map->triggers, index);
 		if (trigger->z != layer && false)  // layer ignored for compatibility reasons
 			continue;
-		bounds.x1 = trigger->x - tile_w / 2;
-		bounds.y1 = trigger->y - tile_h / 2;
-		bounds.x2 = bounds.x1 + tile_w;
-		bounds.y2 = bounds.y1 + tile_h;
-		if (is_point_in_rect(x, y, bounds)) {
-			found_item = trigger;
+		if (is_point_in_rect(x, y, trigger_bounds(trigger))) {
 			if (out_index != NULL)
-				*out_index = iter.index;
-			break;
+				*out_index = index;
+			return trigger;
 		}
 	}
-	return found_item;
+	return NULL;
 }
 
 static struct map_zone*
 get_zone_at(int x, int y, int layer, int which, int* out_index)
 {
-	struct map_zone* found_item = NULL;
+	const int*       candidates;
+	int              index;
+	int              num_candidates;
 	struct map_zone* zone;
 
-	iter_t iter;
-	int    i;
+	int i;
 
-	iter = vector_enum(s_map->zones); i = -1;
-	while ((zone = iter_next(&iter))) {
+	if (!s_map->zone_grid.is_valid)
+		index_zones();
+	candidates = query_region_grid(&s_map->zone_grid, x, y, &num_candidates);
+	if (candidates == NULL)
+		num_candidates = vector_len(s_map->zones);
+	for (i = 0; i < num_candidates; ++i) {
+		index = candidates != NULL ? candidates[i] : i;
+		zone = vector_get(s_map->zones, index);
 		if (zone->layer != layer && false)  // layer ignored for compatibility
 			continue;
 		if (is_point_in_rect(x, y, zone->bounds) && which-- == 0) {
-			found_item = zone;
-			if (out_index)
-				*out_index = iter.index;
-			break;
+			if (out_index != NULL)
+				*out_index = index;
+			return zone;
 		}
 	}
-	return found_item;
+	return NULL;
+}
+
+static void
+hash_person(person_t* person)
+{
+	rect_t    base;
+	vector_t* bucket;
+	int       x1, y1, x2, y2;
+
+	int i, i_x, i_y;
+
+	base = person_base(person);
+	if (person->is_hashed && person->hash_layer == person->layer
+		&& base.x1 == person->hash_base.x1 && base.y1 == person->hash_base.y1
+		&& base.x2 == person->hash_base.x2 && base.y2 == person->hash_base.y2)
+	{
+		return;  // still filed in the right place
+	}
+
+	unhash_person(person);
+	x1 = person_cell_of(base.x1);
+	y1 = person_cell_of(base.y1);
+	x2 = person_cell_of(base.x2);
+	y2 = person_cell_of(base.y2);
+	for (i_y = y1; i_y <= y2; ++i_y) for (i_x = x1; i_x <= x2; ++i_x) {
+		// several cells may hash to the same bucket; make sure the person is only
+		// filed once per bucket so that unhashing them later is straightforward.
+		bucket = s_person_hash[person_bucket_of(i_x, i_y)];
+		for (i = 0; i < vector_len(bucket); ++i) {
+			if (*(person_t**)vector_get(bucket, i) == person)
+				break;
+		}
+		if (i == vector_len(bucket))
+			vector_push(bucket, &person);
+	}
+	person->hash_base = base;
+	person->hash_layer = person->layer;
+	person->is_hashed = true;
+}
+
+static bool
+index_triggers(void)
+{
+	rect_t* bounds;
+	bool    is_ok;
+	int     num_triggers;
+	int     tile_w, tile_h;
+
+	int i;
+
+	num_triggers = vector_len(s_map->triggers);
+	if (!(bounds = malloc((num_triggers + 1) * sizeof(rect_t))))
+		return false;
+	for (i = 0; i < num_triggers; ++i)
+		bounds[i] = trigger_bounds(vector_get(s_map->triggers, i));
+	tileset_get_size(s_map->tileset, &tile_w, &tile_h);
+	is_ok = build_region_grid(&s_map->trigger_grid, bounds, num_triggers,
+		s_map->width * tile_w, s_map->height * tile_h);
+	free(bounds);
+	return is_ok;
+}
+
+static bool
+index_zones(void)
+{
+	rect_t*          bounds;
+	bool             is_ok;
+	int              num_zones;
+	int              tile_w, tile_h;
+	struct map_zone* zone;
+
+	int i;
+
+	num_zones = vector_len(s_map->zones);
+	if (!(bounds = malloc((num_zones + 1) * sizeof(rect_t))))
+		return false;
+	for (i = 0; i < num_zones; ++i) {
+		zone = vector_get(s_map->zones, i);
+		bounds[i] = zone->bounds;
+	}
+	tileset_get_size(s_map->tileset, &tile_w, &tile_h);
+	is_ok = build_region_grid(&s_map->zone_grid, bounds, num_zones,
+		s_map->width * tile_w, s_map->height * tile_h);
+	free(bounds);
+	return is_ok;
+}
+
+static void
+invalidate_chunk(struct map_layer* layer, int x, int y)
+{
+	struct layer_chunk* chunk;
+
+	if (layer->chunks == NULL)
+		return;
+	chunk = &layer->chunks[x / LAYER_CHUNK_SIZE + y / LAYER_CHUNK_SIZE * layer->num_chunks_x];
+	chunk->is_built = false;
 }
 
 static struct map*
@@ -2634,6 +3122,22 @@ map_screen_to_map(int camera_x, int camera_y, int* inout_x, int* inout_y)
 	}
 }
 
+static unsigned int
+person_bucket_of(int cell_x, int cell_y)
+{
+	return ((unsigned int)cell_x * 73856093U ^ (unsigned int)cell_y * 19349663U)
+		% PERSON_HASH_SIZE;
+}
+
+static int
+person_cell_of(int coordinate)
+{
+	// note: this rounds toward negative infinity so that bases hanging off the
+	//       top or left edge of the map land in the correct cell.
+	return coordinate >= 0 ? coordinate / PERSON_CELL_SIZE
+		: -((-coordinate + PERSON_CELL_SIZE - 1) / PERSON_CELL_SIZE);
+}
+
 static void
 process_map_input(void)
 {
@@ -2722,6 +3226,19 @@ process_map_input(void)
 	update_bound_keys(true);
 }
 
+static const int*
+query_region_grid(const struct region_grid* grid, int x, int y, int* out_count)
+{
+	int cell_index;
+
+	if (!grid->is_valid)
+		return NULL;
+	cell_index = region_cell_of(x, grid->cell_w, grid->num_cols)
+		+ region_cell_of(y, grid->cell_h, grid->num_rows) * grid->num_cols;
+	*out_count = grid->cell_starts[cell_index + 1] - grid->cell_starts[cell_index];
+	return &grid->entries[grid->cell_starts[cell_index]];
+}
+
 static void
 record_step(person_t* person)
 {
@@ -2754,6 +3271,7 @@ reset_persons(bool keep_existing)
 			person->x = origin.x;
 			person->y = origin.y;
 			person->layer = origin.z;
+			hash_person(person);
 		}
 		else {
 			person_activate(person, PERSON_SCRIPT_ON_DESTROY, NULL, true);
@@ -2774,10 +3292,143 @@ set_person_name(person_t* person, const char* name)
 	strcpy(person->name, name);
 }
 
+static int
+region_cell_of(int coordinate, int cell_size, int num_cells)
+{
+	int cell;
+
+	// note: points and regions off the edge of the grid are clamped into the edge
+	//       cells.  this keeps the mapping monotonic, so a point outside the map still
+	//       finds every region that covers it.
+	cell = coordinate >= 0 ? coordinate / cell_size : -1;
+	return cell < 0 ? 0 : cell >= num_cells ? num_cells - 1 : cell;
+}
+
+static void
+set_tile_uv(ALLEGRO_VERTEX* vertices, rect_t uv)
+{
+	// note: vertices are in the order laid down by build_chunk(), i.e. two triangles
+	//       with the top-right and bottom-left corners shared between them.
+	vertices[0].u = uv.x1; vertices[0].v = uv.y1;
+	vertices[1].u = uv.x2; vertices[1].v = uv.y1;
+	vertices[2].u = uv.x1; vertices[2].v = uv.y2;
+	vertices[3].u = uv.x2; vertices[3].v = uv.y1;
+	vertices[4].u = uv.x2; vertices[4].v = uv.y2;
+	vertices[5].u = uv.x1; vertices[5].v = uv.y2;
+}
+
 static void
 sort_persons(void)
 {
-	qsort(s_persons, s_num_persons, sizeof(person_t*), compare_persons);
+	// note: persons only move a few pixels per frame, so the list is almost always
+	//       already in order or very close to it.  an insertion sort handles that in
+	//       close to linear time, where qsort() would redo the whole thing.  since
+	//       compare_persons() never calls two distinct persons equal, this yields the
+	//       same order qsort() would.
+
+	person_t* person;
+
+	int i, j;
+
+	for (i = 1; i < s_num_persons; ++i) {
+		person = s_persons[i];
+		for (j = i; j > 0 && compare_persons(&s_persons[j - 1], &person) > 0; --j)
+			s_persons[j] = s_persons[j - 1];
+		s_persons[j] = person;
+	}
+	for (i = 0; i < s_num_persons; ++i)
+		s_persons[i]->index = i;
+}
+
+static void
+unhash_person(person_t* person)
+{
+	vector_t* bucket;
+	int       x1, y1, x2, y2;
+
+	int i, i_x, i_y;
+
+	if (!person->is_hashed)
+		return;
+	x1 = person_cell_of(person->hash_base.x1);
+	y1 = person_cell_of(person->hash_base.y1);
+	x2 = person_cell_of(person->hash_base.x2);
+	y2 = person_cell_of(person->hash_base.y2);
+	for (i_y = y1; i_y <= y2; ++i_y) for (i_x = x1; i_x <= x2; ++i_x) {
+		bucket = s_person_hash[person_bucket_of(i_x, i_y)];
+		for (i = 0; i < vector_len(bucket); ++i) {
+			if (*(person_t**)vector_get(bucket, i) == person) {
+				vector_remove(bucket, i);
+				break;
+			}
+		}
+	}
+	person->is_hashed = false;
+}
+
+static rect_t
+trigger_bounds(const struct map_trigger* trigger)
+{
+	rect_t bounds;
+	int    tile_w, tile_h;
+
+	tileset_get_size(s_map->tileset, &tile_w, &tile_h);
+	bounds.x1 = trigger->x - tile_w / 2;
+	bounds.y1 = trigger->y - tile_h / 2;
+	bounds.x2 = bounds.x1 + tile_w;
+	bounds.y2 = bounds.y1 + tile_h;
+	return bounds;
+}
+
+static void
+update_chunk(struct map_layer* layer, struct layer_chunk* chunk, int chunk_x, int chunk_y)
+{
+	struct anim_cell* anim_cell;
+	void*             entries;
+	int               frame_index;
+	int               num_vertices;
+	tileset_t*        tileset;
+
+	iter_t iter;
+
+	tileset = s_map->tileset;
+	if (!chunk->is_built || chunk->revision != tileset_revision(tileset))
+		build_chunk(layer, chunk, chunk_x, chunk_y);
+	if (!chunk->is_built)
+		return;
+
+	// patch the texture coordinates of any animated tiles which have changed frames
+	// since the last time the chunk was drawn.  this is skipped entirely if no tile
+	// animations have advanced in the meantime.
+	if (chunk->anim_serial != s_anim_serial) {
+		iter = vector_enum(chunk->anim_cells);
+		while ((anim_cell = iter_next(&iter))) {
+			frame_index = tileset_get_frame(tileset, anim_cell->tile_index);
+			if (frame_index == anim_cell->frame_index)
+				continue;
+			set_tile_uv(&chunk->vertices[anim_cell->vertex_index], tileset_get_uv(tileset, frame_index));
+			anim_cell->frame_index = frame_index;
+			if (chunk->dirty_first < 0 || anim_cell->vertex_index < chunk->dirty_first)
+				chunk->dirty_first = anim_cell->vertex_index;
+			if (anim_cell->vertex_index + 6 > chunk->dirty_last)
+				chunk->dirty_last = anim_cell->vertex_index + 6;
+		}
+		chunk->anim_serial = s_anim_serial;
+	}
+	if (chunk->dirty_first >= 0 && chunk->buffer != NULL) {
+		num_vertices = chunk->dirty_last - chunk->dirty_first;
+		if ((entries = al_lock_vertex_buffer(chunk->buffer, chunk->dirty_first, num_vertices, ALLEGRO_LOCK_WRITEONLY))) {
+			memcpy(entries, &chunk->vertices[chunk->dirty_first], num_vertices * sizeof(ALLEGRO_VERTEX));
+			al_unlock_vertex_buffer(chunk->buffer);
+		}
+		else {
+			// couldn't update the vertex buffer, fall back on drawing from memory
+			al_destroy_vertex_buffer(chunk->buffer);
+			chunk->buffer = NULL;
+		}
+	}
+	chunk->dirty_first = -1;
+	chunk->dirty_last = 0;
 }
 
 static void
@@ -2808,6 +3459,8 @@ update_map_engine(bool in_main_loop)
 	map_h = s_map->height * tile_h;
 
 	tileset_update(s_map->tileset);
+	if (vector_len(tileset_get_changes(s_map->tileset)) > 0)
+		++s_anim_serial;
 
 	for (i = 0; i < PLAYER_MAX; ++i) if (s_players[i].person != NULL)
 		person_get_xy(s_players[i].person, &start_x[i], &start_y[i], false);
@@ -79,14 +79,17 @@
 // type of eaty pig.  they're a relic from the early stages of engine development; while
 // I've pared this list down over time, ideally all of them should disappear.
 extern game_t*   g_game;
+extern uint32_t  g_gc_count;
+extern double    g_gc_time;
 extern double    g_idle_time;
 extern js_ref_t* g_main_object;
 extern screen_t* g_screen;
 extern uint32_t  g_tick_count;
 
-void sphere_abort       (const char* message);
-void sphere_change_game (const char* pathname);
-void sphere_exit        (bool shutting_down);
-void sphere_heartbeat   (bool in_event_loop, int api_version);
-void sphere_restart     (void);
-void sphere_sleep       (double time);
+void   sphere_abort           (const char* message);
+void   sphere_change_game     (const char* pathname);
+double sphere_collect_garbage (double time_left);
+void   sphere_exit            (bool shutting_down);
+void   sphere_heartbeat       (bool in_event_loop, int api_version);
+void   sphere_restart         (void);
+void   sphere_sleep           (double time);
@@ -33,6 +33,8 @@
 #include "minisphere.h"
 #include "module.h"
 
+#include "hashmap.h"
+#include "script.h"
 #include "source_map.h"
 
 struct module_ref
@@ -41,21 +43,32 @@ struct module_ref
 	path_t*       path;
 };
 
+struct resolution
+{
+	path_t*       path;
+	module_type_t type;
+};
+
 static bool js_require (int num_args, bool is_ctor, intptr_t magic);
 
-static void          do_resolve_import (void);
-static module_ref_t* find_module       (const char* specifier, const char* importer, const char* lib_dir_name, bool node_compatible);
-static module_ref_t* load_package_json (const char* filename);
-static void          push_new_require  (const char* module_id);
-static module_type_t type_of_module    (const path_t* path, bool node_compatible);
+static void               clear_resolutions (void);
+static void               do_resolve_import (void);
+static module_ref_t*      find_module       (const char* specifier, const char* importer, const char* lib_dir_name, bool node_compatible);
+static bool               is_relative       (const char* specifier);
+static module_ref_t*      load_package_json (const char* filename);
+static void               push_new_require  (const char* module_id);
+static module_type_t      type_of_module    (const path_t* path, bool node_compatible);
 
-static int  s_next_module_id = 1;
-static bool s_strict_imports;
+static unsigned int       s_fs_version;
+static int                s_next_module_id = 1;
+static hashmap_t*         s_resolutions = NULL;
+static bool               s_strict_imports;
 
 void
 modules_init(bool strict_imports)
 {
 	s_strict_imports = strict_imports;
+	s_resolutions = hashmap_new(sizeof(struct resolution));
 
 	jsal_on_import_module(do_resolve_import);
 
@@ -72,6 +85,16 @@ modules_init(bool strict_imports)
 	jsal_pop(1);
 }
 
+void
+modules_uninit(void)
+{
+	if (s_resolutions == NULL)
+		return;  // modules_init() was never called
+	clear_resolutions();
+	hashmap_free(s_resolutions);
+	s_resolutions = NULL;
+}
+
 bool
 module_eval(const char* specifier, bool node_compatible)
 {
@@ -98,8 +121,13 @@ module_resolve(const char* specifier, const char* importer, bool node_compatible
 		{ true,  "#/runtime" },
 	};
 
-	path_t*       path;
-	module_ref_t* ref = NULL;
+	const char*        dirname = "";
+	path_t*            dir_path = NULL;
+	char*              key;
+	path_t*            path;
+	module_ref_t*      ref = NULL;
+	struct resolution  resolution;
+	struct resolution* cached;
 
 	int i;
 
@@ -109,6 +137,35 @@ module_resolve(const char* specifier, const char* importer, bool node_compatible
 		return NULL;
 	}
 
+	// note: resolving a specifier can take dozens of file system probes, so successful
+	//       resolutions are cached.  only relative specifiers depend on the importer,
+	//       and then only on its directory.  anything written through SphereFS may
+	//       change the outcome, so the cache is thrown out whenever that happens.  files
+	//       can also change outside the engine, so a cached module that no longer
+	//       exists is resolved again, and failures aren't cached at all.
+	if (game_fs_version(g_game) != s_fs_version) {
+		clear_resolutions();
+		s_fs_version = game_fs_version(g_game);
+	}
+	if (is_relative(specifier) && importer != NULL) {
+		dir_path = path_strip(path_new(importer));
+		dirname = path_cstr(dir_path);
+	}
+	key = alloca(strlen(dirname) + strlen(specifier) + 4);
+	sprintf(key, "%d:%s:%s", (int)node_compatible, dirname, specifier);
+	path_free(dir_path);
+	if ((cached = hashmap_get(s_resolutions, key, strlen(key)))) {
+		if (game_file_exists(g_game, path_cstr(cached->path))) {
+			if (!(ref = calloc(1, sizeof(module_ref_t))))
+				return NULL;
+			ref->path = path_dup(cached->path);
+			ref->type = cached->type;
+			return ref;
+		}
+		path_free(cached->path);
+		hashmap_remove(s_resolutions, key, strlen(key));
+	}
+
 	// special case for `/lib/foo.js`. ideally, it would be better to support this at a lower
 	// level, e.g. by codifying it as part of SphereFS. this will do for now, though.
 	path = path_new(specifier);
@@ -125,6 +182,13 @@ module_resolve(const char* specifier, const char* importer, bool node_compatible
 	if (ref == NULL)
 		jsal_push_new_error(JS_URI_ERROR, "Couldn't find JS module '%s'", specifier);
 	path_free(path);
+
+	if (ref != NULL) {
+		resolution.path = path_dup(ref->path);
+		resolution.type = ref->type;
+		if (!hashmap_put(s_resolutions, key, strlen(key), &resolution))
+			path_free(resolution.path);
+	}
 	return ref;
 }
 
@@ -241,7 +305,7 @@ module_exec(module_ref_t* it)
 			strncmp(lstr_cstr(code_string), "#!", 2) == 0 ? "//" : "",  // shebang?
 			lstr_cstr(code_string));
 		lstr_free(code_string);
-		if (!jsal_try_compile(source_map_alias_of(pathname)))
+		if (!script_try_compile(source_map_alias_of(pathname)))
 			goto on_error;
 		jsal_call(0);
 		jsal_push_new_object();
@@ -286,6 +350,21 @@ on_error:
 	return false;
 }
 
+static void
+clear_resolutions(void)
+{
+	struct resolution* resolution;
+
+	iter_t iter;
+
+	if (s_resolutions == NULL)
+		return;
+	iter = hashmap_enum(s_resolutions);
+	while ((resolution = iter_next(&iter)))
+		path_free(resolution->path);
+	hashmap_clear(s_resolutions);
+}
+
 static void
 do_resolve_import(void)
 {
@@ -414,6 +493,13 @@ find_module(const char* specifier, const char* importer, const char* lib_dir_nam
 	return NULL;
 }
 
+static bool
+is_relative(const char* specifier)
+{
+	return strncmp(specifier, "./", 2) == 0
+		|| strncmp(specifier, "../", 3) == 0;
+}
+
 static module_ref_t*
 load_package_json(const char* filename)
 {
@@ -526,7 +612,9 @@ type_of_module(const path_t* path, bool node_compatible)
 		path_append(json_path, "package.json");
 		hop_index = path_num_hops(json_path) - 1;
 		while (hop_index >= 0) {
-			if ((json_text = game_read_file(g_game, path_cstr(json_path), &json_size))) {
+			if (game_file_exists(g_game, path_cstr(json_path))
+				&& (json_text = game_read_file(g_game, path_cstr(json_path), &json_size)))
+			{
 				jsal_push_lstring(json_text, json_size);
 				free(json_text);
 				if (!jsal_try_parse(-1) || !jsal_is_object_coercible(-1)) {
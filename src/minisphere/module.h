@@ -44,6 +44,7 @@ enum module_type
 } module_type_t;
 
 void          modules_init    (bool enable_cjs);
+void          modules_uninit  (void);
 bool          module_eval     (const char* specifier, bool node_compatible);
 module_ref_t* module_resolve  (const char* specifier, const char* importer, bool node_compatible);
 void          module_free     (module_ref_t* it);
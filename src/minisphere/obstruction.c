@@ -33,14 +33,39 @@
 #include "minisphere.h"
 #include "obstruction.h"
 
+// obstruction maps keep their line segments bucketed into a uniform grid so that
+// collision tests only need to look at the segments near the area being tested.
+// each segment is filed under every cell its bounding box touches.  the grid grows
+// as needed to cover new segments, overshooting a bit to keep regrowth rare.
+#define CELL_SIZE 64
+
+struct cell
+{
+	int* lines;
+	int  max_lines;
+	int  num_lines;
+};
+
 struct obsmap
 {
 	unsigned int id;
+	struct cell* cells;
+	int          grid_h;
+	int          grid_w;
+	int          grid_x;
+	int          grid_y;
 	rect_t*      lines;
 	int          max_lines;
 	int          num_lines;
 };
 
+static bool cell_add_line  (struct cell* cell, int line_index);
+static int  cell_index_of  (int coordinate);
+static bool file_line      (obsmap_t* obsmap, int line_index);
+static bool regrow_grid    (obsmap_t* obsmap, rect_t bounds);
+static void get_cell_range (const obsmap_t* obsmap, rect_t bounds, int* out_x1, int* out_y1, int* out_x2, int* out_y2);
+static bool test_line      (const obsmap_t* obsmap, rect_t line, rect_t bounds);
+
 static unsigned int s_next_obsmap_id = 0;
 
 obsmap_t*
@@ -62,9 +87,14 @@ obsmap_new(void)
 void
 obsmap_free(obsmap_t* obsmap)
 {
+	int i;
+
 	if (obsmap == NULL)
 		return;
 	console_log(4, "disposing obstruction map #%u no longer in use", obsmap->id);
+	for (i = 0; i < obsmap->grid_w * obsmap->grid_h; ++i)
+		free(obsmap->cells[i].lines);
+	free(obsmap->cells);
 	free(obsmap->lines);
 	free(obsmap);
 }
@@ -72,6 +102,7 @@ obsmap_free(obsmap_t* obsmap)
 bool
 obsmap_add_line(obsmap_t* obsmap, rect_t line)
 {
+	rect_t bounds;
 	int    new_size;
 	rect_t *line_list;
 
@@ -86,6 +117,25 @@ obsmap_add_line(obsmap_t* obsmap, rect_t line)
 		obsmap->lines = line_list;
 	}
 	obsmap->lines[obsmap->num_lines] = line;
+
+	bounds = line;
+	rect_normalize(&bounds);
+	if (cell_index_of(bounds.x1) < obsmap->grid_x
+		|| cell_index_of(bounds.y1) < obsmap->grid_y
+		|| cell_index_of(bounds.x2) >= obsmap->grid_x + obsmap->grid_w
+		|| cell_index_of(bounds.y2) >= obsmap->grid_y + obsmap->grid_h)
+	{
+		// the new segment lies (at least partly) outside the grid.  the grid is
+		// rebuilt from scratch in that case, which files the new segment too.
+		++obsmap->num_lines;
+		if (!regrow_grid(obsmap, bounds)) {
+			--obsmap->num_lines;
+			return false;
+		}
+		return true;
+	}
+	if (!file_line(obsmap, obsmap->num_lines))
+		return false;
 	++obsmap->num_lines;
 	return true;
 }
@@ -93,13 +143,11 @@ obsmap_add_line(obsmap_t* obsmap, rect_t line)
 bool
 obsmap_test_line(const obsmap_t* obsmap, rect_t line)
 {
-	int i;
+	rect_t bounds;
 
-	for (i = 0; i < obsmap->num_lines; ++i) {
-		if (do_lines_overlap(line, obsmap->lines[i]))
-			return true;
-	}
-	return false;
+	bounds = line;
+	rect_normalize(&bounds);
+	return test_line(obsmap, line, bounds);
 }
 
 bool
@@ -112,3 +160,193 @@ obsmap_test_rect(const obsmap_t* obsmap, rect_t rectangle)
 		|| obsmap_test_line(obsmap, mk_rect(rectangle.x1, rectangle.y2, rectangle.x2, rectangle.y2))
 		|| obsmap_test_line(obsmap, mk_rect(rectangle.x1, rectangle.y1, rectangle.x1, rectangle.y2));
 }
+
+static bool
+cell_add_line(struct cell* cell, int line_index)
+{
+	int  new_size;
+	int* line_list;
+
+	if (cell->num_lines + 1 > cell->max_lines) {
+		new_size = (cell->num_lines + 1) * 2;
+		if (!(line_list = realloc(cell->lines, new_size * sizeof(int))))
+			return false;
+		cell->max_lines = new_size;
+		cell->lines = line_list;
+	}
+	cell->lines[cell->num_lines++] = line_index;
+	return true;
+}
+
+static int
+cell_index_of(int coordinate)
+{
+	// note: this rounds toward negative infinity so that segments with negative
+	//       coordinates land in the correct cell.
+	return coordinate >= 0 ? coordinate / CELL_SIZE
+		: -((-coordinate + CELL_SIZE - 1) / CELL_SIZE);
+}
+
+static bool
+file_line(obsmap_t* obsmap, int line_index)
+{
+	// note: if this fails, any cells the segment was already filed in are rolled back,
+	//       so that the index doesn't linger there and get reused by the next segment.
+
+	rect_t       bounds;
+	struct cell* cell;
+	int          x1, y1, x2, y2;
+
+	int i_x, i_y;
+
+	bounds = obsmap->lines[line_index];
+	rect_normalize(&bounds);
+	get_cell_range(obsmap, bounds, &x1, &y1, &x2, &y2);
+	for (i_y = y1; i_y <= y2; ++i_y) {
+		for (i_x = x1; i_x <= x2; ++i_x) {
+			cell = &obsmap->cells[i_x + i_y * obsmap->grid_w];
+			if (!cell_add_line(cell, line_index))
+				goto on_error;
+		}
+	}
+	return true;
+
+on_error:
+	for (i_y = y1; i_y <= y2; ++i_y) {
+		for (i_x = x1; i_x <= x2; ++i_x) {
+			cell = &obsmap->cells[i_x + i_y * obsmap->grid_w];
+			if (cell->num_lines == 0 || cell->lines[cell->num_lines - 1] != line_index)
+				return false;  // reached the cell where filing failed
+			--cell->num_lines;
+		}
+	}
+	return false;
+}
+
+static void
+get_cell_range(const obsmap_t* obsmap, rect_t bounds, int* out_x1, int* out_y1, int* out_x2, int* out_y2)
+{
+	// note: the range is clamped to the grid and may come out empty (x1 > x2 or y1 > y2)
+	//       if 'bounds' doesn't touch the grid at all.
+	*out_x1 = cell_index_of(bounds.x1) - obsmap->grid_x;
+	*out_y1 = cell_index_of(bounds.y1) - obsmap->grid_y;
+	*out_x2 = cell_index_of(bounds.x2) - obsmap->grid_x;
+	*out_y2 = cell_index_of(bounds.y2) - obsmap->grid_y;
+	if (*out_x1 < 0)
+		*out_x1 = 0;
+	if (*out_y1 < 0)
+		*out_y1 = 0;
+	if (*out_x2 >= obsmap->grid_w)
+		*out_x2 = obsmap->grid_w - 1;
+	if (*out_y2 >= obsmap->grid_h)
+		*out_y2 = obsmap->grid_h - 1;
+}
+
+static bool
+regrow_grid(obsmap_t* obsmap, rect_t bounds)
+{
+	struct cell* cells;
+	int          grid_h;
+	int          grid_w;
+	int          grid_x;
+	int          grid_y;
+	struct cell* old_cells;
+	int          old_h;
+	int          old_w;
+	int          old_x;
+	int          old_x2;
+	int          old_y;
+	int          old_y2;
+	int          x1, y1, x2, y2;
+
+	int i;
+
+	x1 = cell_index_of(bounds.x1);
+	y1 = cell_index_of(bounds.y1);
+	x2 = cell_index_of(bounds.x2);
+	y2 = cell_index_of(bounds.y2);
+	if (obsmap->cells != NULL) {
+		// grow by at least half the existing size in each direction that needs it, so
+		// that loading a map one segment at a time only regrows a handful of times.
+		old_x2 = obsmap->grid_x + obsmap->grid_w - 1;
+		old_y2 = obsmap->grid_y + obsmap->grid_h - 1;
+		if (x1 < obsmap->grid_x && x1 > obsmap->grid_x - obsmap->grid_w / 2)
+			x1 = obsmap->grid_x - obsmap->grid_w / 2;
+		else if (x1 > obsmap->grid_x)
+			x1 = obsmap->grid_x;
+		if (y1 < obsmap->grid_y && y1 > obsmap->grid_y - obsmap->grid_h / 2)
+			y1 = obsmap->grid_y - obsmap->grid_h / 2;
+		else if (y1 > obsmap->grid_y)
+			y1 = obsmap->grid_y;
+		if (x2 > old_x2 && x2 < old_x2 + obsmap->grid_w / 2)
+			x2 = old_x2 + obsmap->grid_w / 2;
+		else if (x2 < old_x2)
+			x2 = old_x2;
+		if (y2 > old_y2 && y2 < old_y2 + obsmap->grid_h / 2)
+			y2 = old_y2 + obsmap->grid_h / 2;
+		else if (y2 < old_y2)
+			y2 = old_y2;
+	}
+	grid_x = x1;
+	grid_y = y1;
+	grid_w = x2 - x1 + 1;
+	grid_h = y2 - y1 + 1;
+	if (grid_w > INT_MAX / grid_h)
+		return false;  // grid would be too big to index
+	if (!(cells = calloc(grid_w * grid_h, sizeof(struct cell))))
+		return false;
+
+	old_cells = obsmap->cells;
+	old_x = obsmap->grid_x;
+	old_y = obsmap->grid_y;
+	old_w = obsmap->grid_w;
+	old_h = obsmap->grid_h;
+	obsmap->cells = cells;
+	obsmap->grid_x = grid_x;
+	obsmap->grid_y = grid_y;
+	obsmap->grid_w = grid_w;
+	obsmap->grid_h = grid_h;
+	for (i = 0; i < obsmap->num_lines; ++i) {
+		if (!file_line(obsmap, i))
+			goto on_error;
+	}
+	for (i = 0; i < old_w * old_h; ++i)
+		free(old_cells[i].lines);
+	free(old_cells);
+	return true;
+
+on_error:
+	for (i = 0; i < grid_w * grid_h; ++i)
+		free(cells[i].lines);
+	free(cells);
+	obsmap->cells = old_cells;
+	obsmap->grid_x = old_x;
+	obsmap->grid_y = old_y;
+	obsmap->grid_w = old_w;
+	obsmap->grid_h = old_h;
+	return false;
+}
+
+static bool
+test_line(const obsmap_t* obsmap, rect_t line, rect_t bounds)
+{
+	const struct cell* cell;
+	int                x1, y1, x2, y2;
+
+	int i, i_x, i_y;
+
+	// a segment can only cross 'line' if their bounding boxes overlap, so only the
+	// cells under the bounding box of 'line' need to be checked.  a segment spanning
+	// several of those cells may get tested more than once, but that's harmless.
+	get_cell_range(obsmap, bounds, &x1, &y1, &x2, &y2);
+	for (i_y = y1; i_y <= y2; ++i_y) {
+		for (i_x = x1; i_x <= x2; ++i_x) {
+			cell = &obsmap->cells[i_x + i_y * obsmap->grid_w];
+			for (i = 0; i < cell->num_lines; ++i) {
+				if (do_lines_overlap(line, obsmap->lines[cell->lines[i]]))
+					return true;
+			}
+		}
+	}
+	return false;
+}
@@ -34,8 +34,23 @@
 #include "package.h"
 
 #include "compress.h"
+#include "hashmap.h"
 #include "vector.h"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// SPK v2 stores each asset as a series of independently compressed chunks, preceded
+// by a chunk table.  this allows random access into large assets without having to
+// unpack them in full.  assets with at least this many chunks are inflated using
+// multiple threads when read in their entirety.
+#define MIN_PARALLEL_CHUNKS 8
+
 struct asset
 {
 	package_t*    package;
@@ -46,19 +61,76 @@ struct asset
 
 struct package
 {
-	unsigned int  refcount;
-	unsigned int  id;
-	path_t*       path;
-	ALLEGRO_FILE* file;
-	vector_t*     index;
+	unsigned int    refcount;
+	unsigned int    id;
+	path_t*         path;
+	hashmap_t*      dir_map;
+	vector_t*       dirs;
+	ALLEGRO_FILE*   file;
+	hashmap_t*      file_map;
+	hashmap_t*      folded_map;
+	vector_t*       index;
+	struct mapping* mapping;
+};
+
+struct mapping
+{
+	const uint8_t* data;
+	size_t         size;
+#if defined(_WIN32)
+	HANDLE         file_handle;
+	HANDLE         map_handle;
+#endif
+};
+
+struct spk_dir
+{
+	char*     path;
+	vector_t* files;
+	vector_t* subdirs;
+};
+
+struct spk_chunk
+{
+	long     offset;
+	uint32_t pack_size;
+	bool     is_stored;
 };
 
 struct spk_entry
 {
-	char   file_path[SPHERE_PATH_MAX];
-	size_t pack_size;
-	size_t file_size;
-	long   offset;
+	char*             file_path;
+	int               chunk_size;
+	struct spk_chunk* chunks;
+	bool              is_stored;
+	int               num_chunks;
+	size_t            pack_size;
+	size_t            file_size;
+	long              offset;
+	int               version;
+};
+
+struct chunk_stream
+{
+	uint8_t*          buffer;
+	int               chunk_index;
+	const uint8_t*    chunk_data;
+	size_t            chunk_length;
+	struct spk_entry* entry;
+	bool              is_eof;
+	bool              has_error;
+	package_t*        package;
+	int64_t           position;
+};
+
+struct inflate_job
+{
+	uint8_t*          buffer;
+	struct spk_entry* entry;
+	bool              failed;
+	int               first_chunk;
+	package_t*        package;
+	int               stride;
 };
 
 #pragma pack(push, 1)
@@ -79,18 +151,81 @@ struct spk_entry_hdr
 	uint32_t file_size;
 	uint32_t compress_size;
 };
+
+struct spk_chunk_hdr
+{
+	uint32_t pack_size;
+	uint8_t  method;
+	uint8_t  reserved[3];
+};
 #pragma pack(pop)
 
+enum spk_method
+{
+	SPK_METHOD_STORE,
+	SPK_METHOD_DEFLATE,
+};
+
+static int             add_dir       (package_t* package, const char* path, size_t length);
+static const void*     borrow_data   (package_t* package, struct spk_entry* entry);
+static bool            build_lookup  (package_t* package);
+static ALLEGRO_FILE*   chunks_fopen  (package_t* package, struct spk_entry* entry);
+static int             find_dir      (const package_t* package, const char* path, size_t length);
+static int             find_entry    (const package_t* package, const char* path, bool match_case);
+static char*           fold_case     (char* buffer, const char* path, size_t length);
+static void            free_lookup   (package_t* package);
+static bool            inflate_chunk (package_t* package, const struct spk_entry* entry, int index, uint8_t* buffer, size_t *out_size);
+static void*           inflate_proc  (ALLEGRO_THREAD* thread, void* udata);
+static void            list_dir_tree (package_t* package, const struct spk_dir* dir, vector_t* list, const char* prefix, bool want_dirs, bool recursive);
+static bool            load_chunks   (package_t* package, struct spk_entry* entry);
+static struct mapping* map_file      (const char* filename);
+static void*           read_data     (package_t* package, struct spk_entry* entry, size_t *out_size);
+static void            unmap_file    (struct mapping* mapping);
+static size_t          unpacked_size (const struct spk_entry* entry, int index);
+
+static void        chunks_fclearerr (ALLEGRO_FILE* file);
+static bool        chunks_fclose    (ALLEGRO_FILE* file);
+static bool        chunks_feof      (ALLEGRO_FILE* file);
+static const char* chunks_ferrmsg   (ALLEGRO_FILE* file);
+static int         chunks_ferror    (ALLEGRO_FILE* file);
+static bool        chunks_fflush    (ALLEGRO_FILE* file);
+static size_t      chunks_fread     (ALLEGRO_FILE* file, void* ptr, size_t size);
+static bool        chunks_fseek     (ALLEGRO_FILE* file, int64_t offset, int whence);
+static off_t       chunks_fsize     (ALLEGRO_FILE* file);
+static int64_t     chunks_ftell     (ALLEGRO_FILE* file);
+static size_t      chunks_fwrite    (ALLEGRO_FILE* file, const void* ptr, size_t size);
+static bool        seek_chunk       (struct chunk_stream* stream, int index);
+
+static const ALLEGRO_FILE_INTERFACE CHUNK_FILE_INTERFACE =
+{
+	NULL,
+	chunks_fclose,
+	chunks_fread,
+	chunks_fwrite,
+	chunks_fflush,
+	chunks_ftell,
+	chunks_fseek,
+	chunks_feof,
+	chunks_ferror,
+	chunks_ferrmsg,
+	chunks_fclearerr,
+	NULL,
+	chunks_fsize,
+};
+
 static unsigned int s_next_package_id = 1;
 
 package_t*
 package_open(const char* path)
 {
+	uint32_t             chunk_size;
+	struct spk_entry*    entry;
 	package_t*           package;
 	struct spk_entry     spk_entry;
 	struct spk_entry_hdr spk_entry_hdr;
 	struct spk_header    spk_hdr;
 
+	iter_t   iter;
 	uint32_t i;
 
 	console_log(2, "opening package #%u '%s'", s_next_package_id, path);
@@ -102,10 +237,16 @@ package_open(const char* path)
 	if (al_fread(package->file, &spk_hdr, sizeof(struct spk_header)) != sizeof(struct spk_header))
 		goto on_error;
 	if (memcmp(spk_hdr.signature, ".spk", 4) != 0) goto on_error;
-	if (spk_hdr.version != 1) goto on_error;
+	if (spk_hdr.version != 1 && spk_hdr.version != 2) goto on_error;
 
 	package->path = path_new(path);
 
+	// map the whole package into memory if we can.  this lets us hand out views of
+	// stored assets without copying them and inflate compressed ones straight out of
+	// the mapping.  if the mapping fails, fall back on reading from the file.
+	if (!(package->mapping = map_file(path)))
+		console_log(2, "couldn't map package #%u, using buffered I/O", s_next_package_id);
+
 	// load the package index
 	console_log(4, "reading package index for package #%u", s_next_package_id);
 	package->index = vector_new(sizeof(struct spk_entry));
@@ -113,13 +254,65 @@ package_open(const char* path)
 	for (i = 0; i < spk_hdr.num_files; ++i) {
 		if (al_fread(package->file, &spk_entry_hdr, sizeof(struct spk_entry_hdr)) != sizeof(struct spk_entry_hdr))
 			goto on_error;
-		if (spk_entry_hdr.version != 1) goto on_error;
+		if (spk_entry_hdr.version != 1 && spk_entry_hdr.version != 2)
+			goto on_error;
+		if (spk_entry_hdr.version > spk_hdr.version)
+			goto on_error;
+
+		// v2 entries have an additional field with the uncompressed size of each
+		// chunk.  the chunk table itself is loaded on demand.
+		chunk_size = 0;
+		if (spk_entry_hdr.version >= 2) {
+			if (al_fread(package->file, &chunk_size, sizeof(uint32_t)) != sizeof(uint32_t))
+				goto on_error;
+			if (chunk_size == 0 || chunk_size > 0x1000000)
+				goto on_error;  // chunks larger than 16 MiB defeat the purpose
+		}
+		spk_entry.version = spk_entry_hdr.version;
 		spk_entry.pack_size = spk_entry_hdr.compress_size;
 		spk_entry.file_size = spk_entry_hdr.file_size;
 		spk_entry.offset = spk_entry_hdr.offset;
-		al_fread(package->file, spk_entry.file_path, spk_entry_hdr.filename_size);
+		spk_entry.is_stored = false;
+		spk_entry.chunk_size = chunk_size;
+		spk_entry.num_chunks = chunk_size > 0
+			? (int)((spk_entry.file_size + chunk_size - 1) / chunk_size)
+			: 0;
+		spk_entry.chunks = NULL;
+		if (package->mapping != NULL
+			&& (spk_entry.offset + spk_entry.pack_size > package->mapping->size
+				|| spk_entry.offset + spk_entry.pack_size < spk_entry.pack_size))
+		{
+			goto on_error;  // asset lies outside of the package
+		}
+		if (!(spk_entry.file_path = malloc(spk_entry_hdr.filename_size + 1)))
+			goto on_error;
+		if (al_fread(package->file, spk_entry.file_path, spk_entry_hdr.filename_size) != spk_entry_hdr.filename_size) {
+			free(spk_entry.file_path);
+			goto on_error;
+		}
 		spk_entry.file_path[spk_entry_hdr.filename_size] = '\0';
-		if (!vector_push(package->index, &spk_entry)) goto on_error;
+		if (!vector_push(package->index, &spk_entry)) {
+			free(spk_entry.file_path);
+			goto on_error;
+		}
+	}
+	if (!build_lookup(package))
+		goto on_error;
+
+	// SPK v1 has no flag for uncompressed entries, but a zlib stream always starts with
+	// a 2-byte header whose value is divisible by 31.  an entry whose packed size matches
+	// its unpacked size and which doesn't start with such a header must be stored as-is.
+	if (package->mapping != NULL) {
+		iter = vector_enum(package->index);
+		while ((entry = iter_next(&iter))) {
+			if (entry->version == 1 && entry->pack_size == entry->file_size
+				&& (entry->pack_size < 2
+					|| (package->mapping->data[entry->offset] & 0x0F) != 8
+					|| (package->mapping->data[entry->offset] << 8 | package->mapping->data[entry->offset + 1]) % 31 != 0))
+			{
+				entry->is_stored = true;
+			}
+		}
 	}
 
 	package->id = s_next_package_id++;
@@ -131,6 +324,15 @@ on_error:
 		path_free(package->path);
 		if (package->file != NULL)
 			al_fclose(package->file);
+		unmap_file(package->mapping);
+		free_lookup(package);
+		if (package->index != NULL) {
+			iter = vector_enum(package->index);
+			while ((entry = iter_next(&iter))) {
+				free(entry->chunks);
+				free(entry->file_path);
+			}
+		}
 		vector_free(package->index);
 		free(package);
 	}
@@ -147,149 +349,81 @@ package_ref(package_t* it)
 void
 package_unref(package_t* it)
 {
+	struct spk_entry* entry;
+
+	iter_t iter;
+
 	if (it == NULL || --it->refcount > 0)
 		return;
 
 	console_log(4, "disposing package #%u no longer in use", it->id);
+	free_lookup(it);
+	iter = vector_enum(it->index);
+	while ((entry = iter_next(&iter))) {
+		free(entry->chunks);
+		free(entry->file_path);
+	}
 	vector_free(it->index);
 	al_fclose(it->file);
+	unmap_file(it->mapping);
+	path_free(it->path);
 	free(it);
 }
 
 bool
 package_dir_exists(const package_t* it, const char* dirname)
 {
-	struct spk_entry* entry;
-	path_t*           path;
-	const char*       pathname;
-
-	iter_t iter;
+	path_t*     path;
+	const char* pathname;
+	bool        retval;
 
+	// SPK doesn't really have directories; each asset is stored with its full path
+	// as its filename.  package_open() works out the directory tree from those, so
+	// a directory exists if any asset was found underneath it.
 	path = path_new_dir(dirname);
 	pathname = path_cstr(path);
-	iter = vector_enum(it->index);
-	while ((entry = iter_next(&iter))) {
-		// SPK doesn't really have directories, so we fake it by checking
-		// if any of the stored filenames begin with the directory path as a
-		// prefix.
-		if (strstr(entry->file_path, pathname) == entry->file_path) {
-			path_free(path);
-			return true;
-		}
-	}
+	retval = find_dir(it, pathname, strlen(pathname)) >= 0;
 	path_free(path);
-	return false;
+	return retval;
 }
 
 bool
 package_file_exists(const package_t* it, const char* filename)
 {
-	struct spk_entry* entry;
-	path_t*           path;
-	const char*       pathname;
-
-	iter_t iter;
+	path_t* path;
+	bool    retval;
 
 	path = path_new(filename);
-	pathname = path_cstr(path);
-	iter = vector_enum(it->index);
-	while ((entry = iter_next(&iter))) {
-		// SPK doesn't really have directories, so we fake it by checking
-		// if any of the stored filenames begin with the directory path as a
-		// prefix.
-		if (strcmp(entry->file_path, pathname) == 0) {
-			path_free(path);
-			return true;
-		}
-	}
+	retval = find_entry(it, path_cstr(path), true) >= 0;
 	path_free(path);
-	return false;
+	return retval;
 }
 
 vector_t*
 package_list_dir(package_t* package, const char* dirname, bool want_dirs, bool recursive)
 {
-	// HERE BE DRAGONS!
-	// this function is kind of a monstrosity because the SPK format doesn't have
-	// any real concept of a directory - each asset is stored with its full path
-	// as its filename.  as such we have to do some ugly parsing and de-duplication,
-	// particularly in the case of directories.
-
-	struct spk_entry* file_info;
-	char*             found_dirname;
-	bool              is_in_set;
-	vector_t*         list;
-	const char*       maybe_dirname;
-	const char*       maybe_filename;
-	const char*       match;
-	path_t*           path;
-
-	iter_t iter, iter2;
-	path_t** item;
+	int       index;
+	vector_t* list;
 
 	list = vector_new(sizeof(path_t*));
-	iter = vector_enum(package->index);
-	while ((file_info = iter_next(&iter))) {
-		if (!want_dirs) {  // list files
-			if (!(match = strstr(file_info->file_path, dirname)))
-				continue;
-			if (match != file_info->file_path)
-				continue;
-			maybe_filename = match + strlen(dirname);
-			if (dirname[strlen(dirname) - 1] != '/') {
-				if (maybe_filename[0] != '/')
-					continue;  // oops, matched a partial file name
-				++maybe_filename;  // account for directory separator
-			}
-			if (strchr(maybe_filename, '/') && !recursive)
-				continue;  // ignore files in subdirectories
-
-			// if we got to this point, we have a valid filename
-			path = path_new(maybe_filename);
-			vector_push(list, &path);
-		}
-		else {  // list directories
-			if (!(match = strstr(file_info->file_path, dirname)))
-				continue;
-			if (match != file_info->file_path)
-				continue;
-			maybe_dirname = match + strlen(dirname);
-			if (dirname[strlen(dirname) - 1] != '/') {
-				if (maybe_dirname[0] != '/')
-					continue;  // oops, matched a partial file name
-				++maybe_dirname;  // account for directory separator
-			}
-			if (!(maybe_filename = strchr(maybe_dirname, '/')))
-				continue;  // ignore files
-			if (strchr(++maybe_filename, '/') && !recursive)
-				continue;  // ignore subdirectories
-
-			// if we got to this point, we have a valid directory name
-			found_dirname = strdup(maybe_dirname);
-			*strchr(found_dirname, '/') = '\0';
-			path = path_new(found_dirname);
-			iter2 = vector_enum(list);
-			is_in_set = false;
-			while ((item = iter_next(&iter2)))
-				is_in_set |= path_is(path, *item) == 0;
-			if (!is_in_set)  // avoid duplicate listings
-				vector_push(list, &path);
-			free(found_dirname);
-		}
-	}
+	if ((index = find_dir(package, dirname, strlen(dirname))) >= 0)
+		list_dir_tree(package, vector_get(package->dirs, index), list, "", want_dirs, recursive);
 	return list;
 }
 
 asset_t*
 asset_fopen(package_t* package, const char* pathname, const char* mode)
 {
-	ALLEGRO_FILE* al_file = NULL;
-	asset_t*      asset = NULL;
-	void*         buffer = NULL;
-	path_t*       cache_path;
-	size_t        file_size;
-	const char*   local_filename;
-	path_t*       local_path;
+	ALLEGRO_FILE*     al_file = NULL;
+	asset_t*          asset = NULL;
+	void*             buffer = NULL;
+	path_t*           cache_path;
+	struct spk_entry* entry;
+	size_t            file_size;
+	int               index;
+	const char*       local_filename;
+	path_t*           local_path;
+	const void*       view;
 
 	console_log(4, "opening '%s' (%s) from package #%u", pathname, mode, package->id);
 
@@ -313,26 +447,44 @@ asset_fopen(package_t* package, const char* pathname, const char* mode)
 		if (!(al_file = al_fopen(local_filename, mode)))
 			goto on_error;
 	}
-	else {
+	else if (strcmp(mode, "r") != 0 && strcmp(mode, "rb") != 0) {
 		if (!(buffer = asset_fslurp(package, pathname, &file_size)) && mode[0] == 'r')
 			goto on_error;
-		if (strcmp(mode, "r") != 0 && strcmp(mode, "rb") != 0) {
-			if (buffer != NULL && mode[0] != 'w') {
-				// if a game requests write access to an existing file,
-				// we extract it. this ensures file operations originating from
-				// inside an SPK are transparent to the game.
-				console_log(4, "extracting #%u:'%s', write access requested", package->id, pathname);
-				if (!(al_file = al_fopen(local_filename, "w")))
-					goto on_error;
-				al_fwrite(al_file, buffer, file_size);
-				al_fclose(al_file);
-			}
-			free(buffer); buffer = NULL;
-			if (!(al_file = al_fopen(local_filename, mode)))
+		if (buffer != NULL && mode[0] != 'w') {
+			// if a game requests write access to an existing file,
+			// we extract it. this ensures file operations originating from
+			// inside an SPK are transparent to the game.
+			console_log(4, "extracting #%u:'%s', write access requested", package->id, pathname);
+			if (!(al_file = al_fopen(local_filename, "w")))
+				goto on_error;
+			al_fwrite(al_file, buffer, file_size);
+			al_fclose(al_file);
+		}
+		free(buffer); buffer = NULL;
+		if (!(al_file = al_fopen(local_filename, mode)))
+			goto on_error;
+	}
+	else {
+		// read-only: access the asset from memory.  stored assets are read directly
+		// out of the package mapping; anything else gets unpacked first.
+		if ((index = find_entry(package, pathname, false)) < 0)
+			goto on_error;
+		entry = vector_get(package->index, index);
+		if (entry->num_chunks > 1) {
+			// a chunked asset with more than one chunk can be streamed, so there's no
+			// need to unpack the whole thing up front.  seeking is cheap too, since
+			// only the chunk being read from needs to be inflated.
+			if (!(al_file = chunks_fopen(package, entry)))
+				goto on_error;
+		}
+		else if ((view = borrow_data(package, entry))) {
+			// note: the memfile is read-only, so casting away const here is safe.
+			if (!(al_file = al_open_memfile((void*)view, entry->file_size, mode)))
 				goto on_error;
 		}
 		else {
-			// read-only: access unpacked file from memory (performance)
+			if (!(buffer = read_data(package, entry, &file_size)))
+				goto on_error;
 			if (!(al_file = al_open_memfile(buffer, file_size, mode)))
 				goto on_error;
 		}
@@ -397,37 +549,23 @@ void*
 asset_fslurp(package_t* package, const char* path, size_t *out_size)
 {
 	struct spk_entry* entry;
-	void*             packdata = NULL;
+	int               index;
 	void*             unpacked = NULL;
 	size_t            unpack_size;
 
-	iter_t iter;
-
 	console_log(3, "unpacking '%s' from package #%u", path, package->id);
 
-	iter = vector_enum(package->index);
-	while ((entry = iter_next(&iter))) {
-		if (strcasecmp(path, entry->file_path) == 0)
-			break;
-	}
-	if (entry == NULL)
-		goto on_error;
-	if (!(packdata = malloc(entry->pack_size)))
-		goto on_error;
-	al_fseek(package->file, entry->offset, ALLEGRO_SEEK_SET);
-	if (al_fread(package->file, packdata, entry->pack_size) < entry->pack_size)
+	if ((index = find_entry(package, path, false)) < 0)
 		goto on_error;
-	if (!(unpacked = z_inflate(packdata, entry->pack_size, entry->file_size, &unpack_size)))
+	entry = vector_get(package->index, index);
+	if (!(unpacked = read_data(package, entry, &unpack_size)))
 		goto on_error;
-	free(packdata);
 
 	*out_size = unpack_size;
 	return unpacked;
 
 on_error:
 	console_log(3, "couldn't unpack '%s' from package #%u", path, package->id);
-	free(packdata);
-	free(unpacked);
 	return NULL;
 }
 
@@ -442,3 +580,745 @@ asset_fwrite(const void* buf, size_t size, size_t count, asset_t* file)
 {
 	return al_fwrite(file->handle, buf, size * count) / size;
 }
+
+static int
+add_dir(package_t* package, const char* path, size_t length)
+{
+	// note: directories are stored without a trailing slash, with the root of the
+	//       package being the empty string.  the parent directory is created first if
+	//       it doesn't exist yet, so that every directory is reachable from the root.
+
+	struct spk_dir  dir;
+	struct spk_dir* dir_ptr;
+	int             index;
+	int             parent_index;
+	size_t          parent_length;
+
+	if ((index = find_dir(package, path, length)) >= 0)
+		return index;
+
+	parent_index = -1;
+	if (length > 0) {
+		parent_length = length;
+		while (parent_length > 0 && path[parent_length - 1] != '/')
+			--parent_length;
+		if (parent_length > 0)
+			--parent_length;  // drop the slash too
+		if ((parent_index = add_dir(package, path, parent_length)) < 0)
+			return -1;
+	}
+
+	if (!(dir.path = malloc(length + 1)))
+		return -1;
+	memcpy(dir.path, path, length);
+	dir.path[length] = '\0';
+	dir.files = vector_new(sizeof(int));
+	dir.subdirs = vector_new(sizeof(int));
+	if (!vector_push(package->dirs, &dir))
+		return -1;
+	index = vector_len(package->dirs) - 1;
+	if (parent_index >= 0) {
+		dir_ptr = vector_get(package->dirs, parent_index);
+		vector_push(dir_ptr->subdirs, &index);
+	}
+	if (!hashmap_put(package->dir_map, dir.path, length, &index))
+		return -1;
+	return index;
+}
+
+static const void*
+borrow_data(package_t* package, struct spk_entry* entry)
+{
+	// note: the returned view points directly into the package mapping and remains
+	//       valid for as long as the package does.  don't free it!
+
+	if (package->mapping == NULL)
+		return NULL;
+	if (entry->version >= 2) {
+		// a chunked asset can only be borrowed if it fits in a single stored chunk,
+		// otherwise its contents aren't contiguous in the package.
+		if (entry->num_chunks != 1 || !load_chunks(package, entry))
+			return NULL;
+		if (!entry->chunks[0].is_stored || entry->chunks[0].pack_size != entry->file_size)
+			return NULL;
+		return package->mapping->data + entry->chunks[0].offset;
+	}
+	if (!entry->is_stored)
+		return NULL;
+	return package->mapping->data + entry->offset;
+}
+
+static bool
+build_lookup(package_t* package)
+{
+	// SPK stores every asset under its full pathname and has no real concept of a
+	// directory.  to avoid scanning the entire index on every lookup, we build hash
+	// tables over the asset names here, along with a directory tree for listings.
+	// asset_fslurp() does case-insensitive lookups, so there's a second table keyed
+	// on the case-folded names.
+
+	struct spk_dir*   dir;
+	int               dir_index;
+	struct spk_entry* entry;
+	char*             folded_path;
+	const char*       last_slash;
+	size_t            length;
+	int               num_entries;
+
+	int i;
+
+	package->dirs = vector_new(sizeof(struct spk_dir));
+	package->dir_map = hashmap_new(sizeof(int));
+	package->file_map = hashmap_new(sizeof(int));
+	package->folded_map = hashmap_new(sizeof(int));
+	if (package->dirs == NULL || package->dir_map == NULL || package->file_map == NULL
+		|| package->folded_map == NULL)
+	{
+		return false;
+	}
+
+	if (add_dir(package, "", 0) < 0)
+		return false;
+	num_entries = vector_len(package->index);
+	for (i = 0; i < num_entries; ++i) {
+		// note: if two assets have the same name, or names differing only in case, the
+		//       one added first wins.  this matches the behavior of the original linear
+		//       search.
+		entry = vector_get(package->index, i);
+		length = strlen(entry->file_path);
+		if (hashmap_get(package->file_map, entry->file_path, length) == NULL) {
+			if (!hashmap_put(package->file_map, entry->file_path, length, &i))
+				return false;
+		}
+		if (!(folded_path = fold_case(malloc(length + 1), entry->file_path, length)))
+			return false;
+		if (hashmap_get(package->folded_map, folded_path, length) == NULL) {
+			if (!hashmap_put(package->folded_map, folded_path, length, &i)) {
+				free(folded_path);
+				return false;
+			}
+		}
+		free(folded_path);
+
+		last_slash = strrchr(entry->file_path, '/');
+		dir_index = add_dir(package, entry->file_path,
+			last_slash != NULL ? last_slash - entry->file_path : 0);
+		if (dir_index < 0)
+			return false;
+		dir = vector_get(package->dirs, dir_index);
+		vector_push(dir->files, &i);
+	}
+	return true;
+}
+
+static ALLEGRO_FILE*
+chunks_fopen(package_t* package, struct spk_entry* entry)
+{
+	ALLEGRO_FILE*        file;
+	struct chunk_stream* stream;
+
+	if (!load_chunks(package, entry))
+		return NULL;
+	if (!(stream = calloc(1, sizeof(struct chunk_stream))))
+		return NULL;
+	if (!(stream->buffer = malloc(entry->chunk_size)))
+		goto on_error;
+	stream->package = package;
+	stream->entry = entry;
+	stream->chunk_index = -1;
+	if (!(file = al_create_file_handle(&CHUNK_FILE_INTERFACE, stream)))
+		goto on_error;
+	return file;
+
+on_error:
+	free(stream->buffer);
+	free(stream);
+	return NULL;
+}
+
+static int
+find_dir(const package_t* package, const char* path, size_t length)
+{
+	int* index_ptr;
+
+	if (package->dir_map == NULL)
+		return -1;
+	if (length > 0 && path[length - 1] == '/')
+		--length;
+	if (length == 1 && path[0] == '.')
+		length = 0;  // "./" is the root of the package
+	if (!(index_ptr = hashmap_get(package->dir_map, path, length)))
+		return -1;
+	return *index_ptr;
+}
+
+static int
+find_entry(const package_t* package, const char* path, bool match_case)
+{
+	char*  folded_path;
+	int*   index_ptr;
+	size_t length;
+
+	length = strlen(path);
+	if (match_case) {
+		index_ptr = hashmap_get(package->file_map, path, length);
+	}
+	else {
+		folded_path = fold_case(alloca(length + 1), path, length);
+		index_ptr = hashmap_get(package->folded_map, folded_path, length);
+	}
+	return index_ptr != NULL ? *index_ptr : -1;
+}
+
+static char*
+fold_case(char* buffer, const char* path, size_t length)
+{
+	// note: only ASCII letters are folded, the same as strcasecmp() in the C locale.
+	//       `buffer` must have room for `length + 1` bytes; if it's NULL, this just
+	//       returns NULL.
+
+	char ch;
+
+	size_t i;
+
+	if (buffer == NULL)
+		return NULL;
+	for (i = 0; i < length; ++i) {
+		ch = path[i];
+		buffer[i] = ch >= 'A' && ch <= 'Z' ? ch + ('a' - 'A') : ch;
+	}
+	buffer[length] = '\0';
+	return buffer;
+}
+
+static void
+free_lookup(package_t* package)
+{
+	struct spk_dir* dir;
+
+	iter_t iter;
+
+	if (package->dirs != NULL) {
+		iter = vector_enum(package->dirs);
+		while ((dir = iter_next(&iter))) {
+			vector_free(dir->files);
+			vector_free(dir->subdirs);
+			free(dir->path);
+		}
+	}
+	vector_free(package->dirs);
+	hashmap_free(package->dir_map);
+	hashmap_free(package->file_map);
+	hashmap_free(package->folded_map);
+}
+
+static bool
+inflate_chunk(package_t* package, const struct spk_entry* entry, int index, uint8_t* buffer, size_t *out_size)
+{
+	// note: when the package is mapped, this doesn't touch any shared state and is
+	//       therefore safe to call from multiple threads at once.
+
+	const struct spk_chunk* chunk;
+	size_t                  expect_size;
+	const uint8_t*          packdata;
+	uint8_t*                packdata_buf = NULL;
+	size_t                  unpack_size;
+
+	chunk = &entry->chunks[index];
+	expect_size = unpacked_size(entry, index);
+	if (package->mapping != NULL) {
+		packdata = package->mapping->data + chunk->offset;
+	}
+	else {
+		if (chunk->is_stored) {
+			packdata_buf = buffer;  // stored chunks can be read straight into the output
+		}
+		else if (!(packdata_buf = malloc(chunk->pack_size))) {
+			return false;
+		}
+		al_fseek(package->file, chunk->offset, ALLEGRO_SEEK_SET);
+		if (al_fread(package->file, packdata_buf, chunk->pack_size) < chunk->pack_size)
+			goto on_error;
+		packdata = packdata_buf;
+	}
+	if (chunk->is_stored) {
+		if (chunk->pack_size != expect_size)
+			goto on_error;
+		if (packdata != buffer)
+			memcpy(buffer, packdata, chunk->pack_size);
+		unpack_size = chunk->pack_size;
+	}
+	else {
+		if (!z_inflate_into(packdata, chunk->pack_size, buffer, expect_size, &unpack_size))
+			goto on_error;
+		if (unpack_size != expect_size)
+			goto on_error;
+	}
+	if (packdata_buf != buffer)
+		free(packdata_buf);
+	*out_size = unpack_size;
+	return true;
+
+on_error:
+	if (packdata_buf != buffer)
+		free(packdata_buf);
+	return false;
+}
+
+static void*
+inflate_proc(ALLEGRO_THREAD* thread, void* udata)
+{
+	struct inflate_job* job;
+	size_t              out_size;
+
+	int i;
+
+	job = udata;
+	for (i = job->first_chunk; i < job->entry->num_chunks; i += job->stride) {
+		if (!inflate_chunk(job->package, job->entry, i,
+			job->buffer + (size_t)i * job->entry->chunk_size, &out_size))
+		{
+			job->failed = true;
+			break;
+		}
+	}
+	return NULL;
+}
+
+static bool
+load_chunks(package_t* package, struct spk_entry* entry)
+{
+	struct spk_chunk*    chunks;
+	struct spk_chunk_hdr chunk_hdr;
+	long                 offset;
+	size_t               table_size;
+
+	int i;
+
+	if (entry->chunks != NULL || entry->num_chunks == 0)
+		return true;
+	table_size = entry->num_chunks * sizeof(struct spk_chunk_hdr);
+	if (table_size > entry->pack_size)
+		return false;
+	if (!(chunks = calloc(entry->num_chunks, sizeof(struct spk_chunk))))
+		return false;
+	if (package->mapping == NULL)
+		al_fseek(package->file, entry->offset, ALLEGRO_SEEK_SET);
+	offset = entry->offset + (long)table_size;
+	for (i = 0; i < entry->num_chunks; ++i) {
+		if (package->mapping != NULL) {
+			memcpy(&chunk_hdr, package->mapping->data + entry->offset
+				+ i * sizeof(struct spk_chunk_hdr), sizeof(struct spk_chunk_hdr));
+		}
+		else if (al_fread(package->file, &chunk_hdr, sizeof(struct spk_chunk_hdr)) != sizeof(struct spk_chunk_hdr)) {
+			goto on_error;
+		}
+		if (chunk_hdr.method != SPK_METHOD_STORE && chunk_hdr.method != SPK_METHOD_DEFLATE)
+			goto on_error;
+		if (chunk_hdr.method == SPK_METHOD_STORE && chunk_hdr.pack_size != unpacked_size(entry, i))
+			goto on_error;  // stored chunks are read in place, so the size must be exact
+		if (offset + chunk_hdr.pack_size > entry->offset + entry->pack_size)
+			goto on_error;
+		chunks[i].offset = offset;
+		chunks[i].pack_size = chunk_hdr.pack_size;
+		chunks[i].is_stored = chunk_hdr.method == SPK_METHOD_STORE;
+		offset += chunk_hdr.pack_size;
+	}
+	entry->chunks = chunks;
+	return true;
+
+on_error:
+	free(chunks);
+	return false;
+}
+
+static struct mapping*
+map_file(const char* filename)
+{
+	struct mapping* mapping;
+
+#if defined(_WIN32)
+	LARGE_INTEGER file_size;
+#else
+	int           fd = -1;
+	struct stat   stats;
+	void*         view;
+#endif
+
+	if (!(mapping = calloc(1, sizeof(struct mapping))))
+		return NULL;
+#if defined(_WIN32)
+	mapping->file_handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (mapping->file_handle == INVALID_HANDLE_VALUE)
+		goto on_error;
+	if (!GetFileSizeEx(mapping->file_handle, &file_size) || file_size.QuadPart <= 0
+		|| (unsigned long long)file_size.QuadPart > SIZE_MAX)
+	{
+		goto on_error;
+	}
+	mapping->size = (size_t)file_size.QuadPart;
+	if (!(mapping->map_handle = CreateFileMappingA(mapping->file_handle, NULL, PAGE_READONLY, 0, 0, NULL)))
+		goto on_error;
+	if (!(mapping->data = MapViewOfFile(mapping->map_handle, FILE_MAP_READ, 0, 0, 0)))
+		goto on_error;
+#else
+	if ((fd = open(filename, O_RDONLY)) < 0)
+		goto on_error;
+	if (fstat(fd, &stats) != 0 || stats.st_size <= 0)
+		goto on_error;
+	mapping->size = (size_t)stats.st_size;
+	if ((view = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		goto on_error;
+	close(fd);
+	mapping->data = view;
+#endif
+	return mapping;
+
+on_error:
+#if defined(_WIN32)
+	if (mapping->map_handle != NULL)
+		CloseHandle(mapping->map_handle);
+	if (mapping->file_handle != INVALID_HANDLE_VALUE && mapping->file_handle != NULL)
+		CloseHandle(mapping->file_handle);
+#else
+	if (fd >= 0)
+		close(fd);
+#endif
+	free(mapping);
+	return NULL;
+}
+
+static void*
+read_data(package_t* package, struct spk_entry* entry, size_t *out_size)
+{
+	// note: like z_inflate(), this always NUL-terminates the returned buffer for
+	//       convenience.  the terminator is not included in the file size.
+
+	uint8_t*           buffer = NULL;
+	size_t             chunk_length;
+	struct inflate_job jobs[8];
+	int                num_threads = 0;
+	const uint8_t*     packdata;
+	uint8_t*           packdata_buf = NULL;
+	ALLEGRO_THREAD*    threads[8];
+	void*              unpacked;
+	size_t             unpack_size;
+
+	int i;
+
+	if (entry->version >= 2) {
+		if (!load_chunks(package, entry))
+			return NULL;
+		if (!(buffer = malloc(entry->file_size + 1)))
+			return NULL;
+		if (package->mapping != NULL && entry->num_chunks >= MIN_PARALLEL_CHUNKS) {
+			// chunks are independent of each other, so we can inflate several of them at
+			// once.  the calling thread takes a share of the work as well.
+			num_threads = al_get_cpu_count();
+			if (num_threads > 8)
+				num_threads = 8;
+			if (num_threads > entry->num_chunks / 2)
+				num_threads = entry->num_chunks / 2;
+			for (i = 0; i < num_threads; ++i) {
+				jobs[i].package = package;
+				jobs[i].entry = entry;
+				jobs[i].buffer = buffer;
+				jobs[i].first_chunk = i;
+				jobs[i].stride = num_threads;
+				jobs[i].failed = false;
+			}
+			for (i = 1; i < num_threads; ++i) {
+				if (!(threads[i] = al_create_thread(inflate_proc, &jobs[i]))) {
+					// couldn't spin up enough threads, fall back on doing it serially
+					while (--i > 0)
+						al_destroy_thread(threads[i]);
+					num_threads = 0;
+					break;
+				}
+			}
+		}
+		if (num_threads > 1) {
+			for (i = 1; i < num_threads; ++i)
+				al_start_thread(threads[i]);
+			inflate_proc(NULL, &jobs[0]);
+			for (i = 1; i < num_threads; ++i) {
+				al_join_thread(threads[i], NULL);
+				al_destroy_thread(threads[i]);
+				if (jobs[i].failed)
+					jobs[0].failed = true;
+			}
+			if (jobs[0].failed)
+				goto on_error;
+		}
+		else {
+			for (i = 0; i < entry->num_chunks; ++i) {
+				if (!inflate_chunk(package, entry, i, buffer + (size_t)i * entry->chunk_size, &chunk_length))
+					goto on_error;
+			}
+		}
+		buffer[entry->file_size] = '\0';
+		*out_size = entry->file_size;
+		return buffer;
+	}
+
+	if (package->mapping != NULL) {
+		packdata = package->mapping->data + entry->offset;
+	}
+	else {
+		if (!(packdata_buf = malloc(entry->pack_size)))
+			goto on_error;
+		al_fseek(package->file, entry->offset, ALLEGRO_SEEK_SET);
+		if (al_fread(package->file, packdata_buf, entry->pack_size) < entry->pack_size)
+			goto on_error;
+		packdata = packdata_buf;
+	}
+	if (entry->is_stored) {
+		if (!(buffer = malloc(entry->file_size + 1)))
+			goto on_error;
+		memcpy(buffer, packdata, entry->file_size);
+		buffer[entry->file_size] = '\0';
+		unpacked = buffer;
+		unpack_size = entry->file_size;
+	}
+	else {
+		if (!(unpacked = z_inflate(packdata, entry->pack_size, entry->file_size, &unpack_size)))
+			goto on_error;
+	}
+	free(packdata_buf);
+	*out_size = unpack_size;
+	return unpacked;
+
+on_error:
+	free(packdata_buf);
+	free(buffer);
+	return NULL;
+}
+
+static void
+unmap_file(struct mapping* mapping)
+{
+	if (mapping == NULL)
+		return;
+#if defined(_WIN32)
+	UnmapViewOfFile(mapping->data);
+	CloseHandle(mapping->map_handle);
+	CloseHandle(mapping->file_handle);
+#else
+	munmap((void*)mapping->data, mapping->size);
+#endif
+	free(mapping);
+}
+
+static size_t
+unpacked_size(const struct spk_entry* entry, int index)
+{
+	size_t size;
+
+	// note: every chunk is full-sized except possibly the last one.
+	size = entry->file_size - (size_t)index * entry->chunk_size;
+	if (size > (size_t)entry->chunk_size)
+		size = entry->chunk_size;
+	return size;
+}
+
+static void
+list_dir_tree(package_t* package, const struct spk_dir* dir, vector_t* list, const char* prefix, bool want_dirs, bool recursive)
+{
+	struct spk_entry*     entry;
+	const char*           name;
+	path_t*               path;
+	char*                 pathname;
+	char*                 subdir_prefix;
+	const struct spk_dir* subdir;
+
+	iter_t iter;
+
+	if (!want_dirs) {
+		iter = vector_enum(dir->files);
+		while (iter_next(&iter)) {
+			entry = vector_get(package->index, *(int*)iter.ptr);
+			name = strrchr(entry->file_path, '/');
+			name = name != NULL ? name + 1 : entry->file_path;
+			pathname = strnewf("%s%s", prefix, name);
+			path = path_new(pathname);
+			vector_push(list, &path);
+			free(pathname);
+		}
+	}
+	iter = vector_enum(dir->subdirs);
+	while (iter_next(&iter)) {
+		subdir = vector_get(package->dirs, *(int*)iter.ptr);
+		name = strrchr(subdir->path, '/');
+		name = name != NULL ? name + 1 : subdir->path;
+		subdir_prefix = strnewf("%s%s/", prefix, name);
+		if (want_dirs) {
+			path = path_new_dir(subdir_prefix);
+			vector_push(list, &path);
+		}
+		if (recursive)
+			list_dir_tree(package, subdir, list, subdir_prefix, want_dirs, recursive);
+		free(subdir_prefix);
+	}
+}
+
+static void
+chunks_fclearerr(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	stream->is_eof = false;
+	stream->has_error = false;
+}
+
+static bool
+chunks_fclose(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	free(stream->buffer);
+	free(stream);
+	return true;
+}
+
+static bool
+chunks_feof(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->is_eof;
+}
+
+static const char*
+chunks_ferrmsg(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->has_error ? "corrupt SPK chunk" : "";
+}
+
+static int
+chunks_ferror(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->has_error ? 1 : 0;
+}
+
+static bool
+chunks_fflush(ALLEGRO_FILE* file)
+{
+	return true;
+}
+
+static size_t
+chunks_fread(ALLEGRO_FILE* file, void* ptr, size_t size)
+{
+	size_t               chunk_offset;
+	size_t               num_bytes;
+	size_t               num_read = 0;
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	while (num_read < size) {
+		if (stream->position >= (int64_t)stream->entry->file_size) {
+			stream->is_eof = true;
+			break;
+		}
+		if (!seek_chunk(stream, (int)(stream->position / stream->entry->chunk_size))) {
+			stream->has_error = true;
+			break;
+		}
+		chunk_offset = stream->position % stream->entry->chunk_size;
+		num_bytes = stream->chunk_length - chunk_offset;
+		if (num_bytes > size - num_read)
+			num_bytes = size - num_read;
+		memcpy((uint8_t*)ptr + num_read, stream->chunk_data + chunk_offset, num_bytes);
+		stream->position += num_bytes;
+		num_read += num_bytes;
+	}
+	return num_read;
+}
+
+static bool
+chunks_fseek(ALLEGRO_FILE* file, int64_t offset, int whence)
+{
+	int64_t              new_position;
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	switch (whence) {
+	case ALLEGRO_SEEK_SET: new_position = offset; break;
+	case ALLEGRO_SEEK_CUR: new_position = stream->position + offset; break;
+	case ALLEGRO_SEEK_END: new_position = (int64_t)stream->entry->file_size + offset; break;
+	default:
+		return false;
+	}
+	if (new_position < 0 || new_position > (int64_t)stream->entry->file_size)
+		return false;
+	stream->position = new_position;
+	stream->is_eof = false;
+	return true;
+}
+
+static off_t
+chunks_fsize(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return (off_t)stream->entry->file_size;
+}
+
+static int64_t
+chunks_ftell(ALLEGRO_FILE* file)
+{
+	struct chunk_stream* stream;
+
+	stream = al_get_file_userdata(file);
+	return stream->position;
+}
+
+static size_t
+chunks_fwrite(ALLEGRO_FILE* file, const void* ptr, size_t size)
+{
+	// note: chunk streams are only ever opened for reading.  asset_fopen() extracts
+	//       the asset to the local cache if write access is requested.
+	return 0;
+}
+
+static bool
+seek_chunk(struct chunk_stream* stream, int index)
+{
+	const struct spk_chunk* chunk;
+	package_t*              package;
+
+	if (index == stream->chunk_index)
+		return true;
+	package = stream->package;
+	chunk = &stream->entry->chunks[index];
+	stream->chunk_index = -1;
+	if (package->mapping != NULL && chunk->is_stored) {
+		// stored chunks in a mapped package can be read in place.  load_chunks() has
+		// already checked the size, but a bad one here means reading out of bounds.
+		if (chunk->pack_size != unpacked_size(stream->entry, index))
+			return false;
+		stream->chunk_data = package->mapping->data + chunk->offset;
+		stream->chunk_length = chunk->pack_size;
+	}
+	else {
+		if (!inflate_chunk(package, stream->entry, index, stream->buffer, &stream->chunk_length))
+			return false;
+		stream->chunk_data = stream->buffer;
+	}
+	if (stream->chunk_length == 0)
+		return false;
+	stream->chunk_index = index;
+	return true;
+}
+
@@ -493,6 +493,7 @@ static bool js_Transform_rotate              (int num_args, bool is_ctor, intptr
 static bool js_Transform_scale               (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Transform_translate           (int num_args, bool is_ctor, intptr_t magic);
 static bool js_new_VertexList                (int num_args, bool is_ctor, intptr_t magic);
+static bool js_VertexList_upload             (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Z_deflate                     (int num_args, bool is_ctor, intptr_t magic);
 static bool js_Z_inflate                     (int num_args, bool is_ctor, intptr_t magic);
 
@@ -990,6 +991,7 @@ pegasus_init(int api_level)
 		api_define_method("Surface", "clear", js_Surface_clear, 0);
 		api_define_method("Texture", "download", js_Texture_download, 0);
 		api_define_method("Texture", "upload", js_Texture_upload, 0);
+		api_define_method("VertexList", "upload", js_VertexList_upload, 0);
 		api_define_const("BlendType", "Add", BLEND_OP_ADD);
 		api_define_const("BlendType", "Subtract", BLEND_OP_SUB);
 		api_define_const("BlendType", "SubtractInverse", BLEND_OP_SUB_INV);
@@ -2658,12 +2660,30 @@ js_Font_wordWrap(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_new_IndexList(int num_args, bool is_ctor, intptr_t magic)
 {
-	ibo_t* ibo;
-	int    index;
-	int    num_entries;
+	size_t          buffer_size;
+	ibo_t*          ibo;
+	int             index;
+	const uint16_t* indices;
+	int             num_entries;
 
 	int i;
 
+	if (s_api_level >= 4 && jsal_is_typed_array(0, JS_UINT16ARRAY)) {
+		// fast path: a Uint16Array is already in the format the GPU wants, so it
+		// can be copied straight into the index buffer.
+		indices = jsal_get_buffer_ptr(0, &buffer_size);
+		num_entries = (int)(buffer_size / sizeof(uint16_t));
+		if (num_entries == 0)
+			jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
+		ibo = ibo_new();
+		if (!ibo_upload_packed(ibo, indices, num_entries)) {
+			ibo_unref(ibo);
+			jsal_error(JS_ERROR, "Couldn't upload IndexList to GPU");
+		}
+		jsal_push_class_obj(PEGASUS_INDEX_LIST, ibo, true);
+		return true;
+	}
+
 	if (!jsal_is_array(0))
 		jsal_error(JS_TYPE_ERROR, "Expected an array as first argument");
 
@@ -5543,13 +5563,31 @@ js_Transform_translate(int num_args, bool is_ctor, intptr_t magic)
 static bool
 js_new_VertexList(int num_args, bool is_ctor, intptr_t magic)
 {
-	int      num_entries;
-	int      stack_idx;
-	vbo_t*   vbo;
-	vertex_t vertex;
+	size_t       buffer_size;
+	const float* data;
+	int          num_entries;
+	int          stack_idx;
+	vbo_t*       vbo;
+	vertex_t     vertex;
 
 	int i;
 
+	if (s_api_level >= 4 && jsal_is_typed_array(0, JS_FLOAT32ARRAY)) {
+		data = jsal_get_buffer_ptr(0, &buffer_size);
+		num_entries = (int)(buffer_size / (VERTEX_PACKED_FLOATS * sizeof(float)));
+		if (buffer_size % (VERTEX_PACKED_FLOATS * sizeof(float)) != 0)
+			jsal_error(JS_RANGE_ERROR, "Packed vertex data must be a multiple of %d floats", VERTEX_PACKED_FLOATS);
+		if (num_entries == 0)
+			jsal_error(JS_RANGE_ERROR, "Empty list is not allowed");
+		vbo = vbo_new();
+		if (!vbo_upload_packed(vbo, data, num_entries)) {
+			vbo_unref(vbo);
+			jsal_error(JS_ERROR, "Couldn't upload VertexList to GPU");
+		}
+		jsal_push_class_obj(PEGASUS_VERTEX_LIST, vbo, true);
+		return true;
+	}
+
 	jsal_require_array(0);
 
 	num_entries = jsal_get_length(0);
@@ -5593,6 +5631,35 @@ js_VertexList_finalize(void* host_ptr)
 	vbo_unref(host_ptr);
 }
 
+static bool
+js_VertexList_upload(int num_args, bool is_ctor, intptr_t magic)
+{
+	size_t       buffer_size;
+	const float* data;
+	int          num_vertices;
+	int          offset = 0;
+	vbo_t*       vbo;
+
+	jsal_push_this();
+	vbo = jsal_require_class_obj(-1, PEGASUS_VERTEX_LIST);
+	if (!jsal_is_typed_array(0, JS_FLOAT32ARRAY))
+		jsal_error(JS_TYPE_ERROR, "Expected a Float32Array as first argument");
+	data = jsal_get_buffer_ptr(0, &buffer_size);
+	if (num_args >= 2)
+		offset = jsal_require_int(1);
+
+	if (buffer_size % (VERTEX_PACKED_FLOATS * sizeof(float)) != 0)
+		jsal_error(JS_RANGE_ERROR, "Packed vertex data must be a multiple of %d floats", VERTEX_PACKED_FLOATS);
+	num_vertices = (int)(buffer_size / (VERTEX_PACKED_FLOATS * sizeof(float)));
+	if (num_vertices == 0)
+		return false;
+	if (offset < 0 || offset + num_vertices > vbo_len(vbo))
+		jsal_error(JS_RANGE_ERROR, "Vertex range [%d,%d) is out of bounds", offset, offset + num_vertices);
+	if (!vbo_update_packed(vbo, offset, data, num_vertices))
+		jsal_error(JS_ERROR, "Couldn't upload vertex data to GPU");
+	return false;
+}
+
 static bool
 js_Z_deflate(int num_args, bool is_ctor, intptr_t magic)
 {
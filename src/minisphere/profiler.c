@@ -83,6 +83,12 @@ profiler_uninit(void)
 	record_obj.function = NULL;
 	vector_push(s_records, &record_obj);
 
+	record_obj.name = strdup("[JS garbage collector]");
+	record_obj.num_hits = g_gc_count;
+	record_obj.total_cost = g_gc_time;
+	record_obj.function = NULL;
+	vector_push(s_records, &record_obj);
+
 	print_results(runtime);
 
 	iter = vector_enum(s_records);
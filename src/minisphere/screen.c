@@ -40,6 +40,7 @@
 
 #include "debugger.h"
 #include "font.h"
+#include "galileo.h"
 #include "image.h"
 
 struct screen
@@ -295,9 +296,10 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 {
 	time_t            datetime;
 	char*             filename;
-	char              fps_text[20];
+	char              fps_text[40];
 	const char*       game_filename;
 	const path_t*     game_root;
+	double            gc_time = 0.0;
 	bool              is_backbuffer_valid;
 	ALLEGRO_STATE     old_state;
 	ALLEGRO_BITMAP*   old_target;
@@ -319,6 +321,8 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	start_time = al_get_time();
 #endif
 
+	galileo_end_frame();
+
 	// update FPS with 1s granularity
 	if (al_get_time() >= it->fps_poll_time) {
 		it->fps_flips = it->num_flips;
@@ -396,6 +400,16 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 			font_draw_text(it->font, x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
 			font_set_mask(it->font, mk_color(255, 255, 255, 255));
 			font_draw_text(it->font, x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+#if defined(MINISPHERE_SPHERUN)
+			// GPU batches vs. draw calls for the last frame, to help with tuning rendering code
+			sprintf(fps_text, "%d/%d draws", galileo_num_batches(), galileo_num_draws());
+			y -= 20;
+			al_draw_filled_rounded_rectangle(x, y, x + 100, y + 16, 4, 4, al_map_rgba(16, 16, 16, 192));
+			font_set_mask(it->font, mk_color(0, 0, 0, 255));
+			font_draw_text(it->font, x + 51, y + 3, TEXT_ALIGN_CENTER, fps_text);
+			font_set_mask(it->font, mk_color(255, 255, 255, 255));
+			font_draw_text(it->font, x + 50, y + 2, TEXT_ALIGN_CENTER, fps_text);
+#endif
 		}
 		al_set_target_bitmap(old_target);
 		al_flip_display();
@@ -413,6 +427,7 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	// that we lag instead of never rendering anything at all.
 	if (framerate > 0) {
 		it->skipping_frame = it->last_flip_time > it->next_frame_time && it->num_skips < it->max_skips;
+		gc_time = sphere_collect_garbage(it->next_frame_time - al_get_time());
 		sphere_sleep(it->next_frame_time - al_get_time());
 		if (it->num_skips >= it->max_skips)  // did we skip too many frames?
 			it->next_frame_time = al_get_time() + 1.0 / framerate;
@@ -420,7 +435,10 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 			it->next_frame_time += 1.0 / framerate;
 	}
 	else {
+		// no frame deadline when unthrottled, so there's no slack to measure.  still give
+		// the GC a slice every frame though, otherwise it will never get any idle time.
 		it->skipping_frame = false;
+		gc_time = sphere_collect_garbage(INFINITY);
 		it->next_frame_time = al_get_time();
 	}
 	++it->num_frames;
@@ -435,7 +453,8 @@ screen_flip(screen_t* it, int framerate, bool need_clear)
 	}
 
 #if defined(MINISPHERE_SPHERUN)
-	g_idle_time += al_get_time() - start_time;
+	// time spent collecting garbage isn't idle time; it's reported separately.
+	g_idle_time += al_get_time() - start_time - gc_time;
 #endif
 }
 
@@ -495,6 +514,7 @@ void
 screen_unskip_frame(screen_t* it)
 {
 	it->skipping_frame = false;
+	galileo_flush();
 	al_clear_to_color(al_map_rgba(0, 0, 0, 255));
 }
 
@@ -34,11 +34,40 @@
 #include "script.h"
 
 #include "api.h"
+#include "hashmap.h"
 #include "jsal.h"
 #include "pegasus.h"
 #include "source_map.h"
+#include "tinydir.h"
 #include "utility.h"
 
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MAX_CACHE_SIZE    (64 * 1048576)
+#define MIN_CACHED_SOURCE 4096
+
+#pragma pack(push, 1)
+struct jsc_header
+{
+	char     signature[4];
+	uint32_t source_size;
+	uint32_t source_hash;
+	uint32_t bytecode_size;
+	uint32_t bytecode_hash;
+};
+#pragma pack(pop)
+
+struct cache_entry
+{
+	char*   filename;
+	time_t  mtime;
+	int64_t size;
+};
+
 struct script
 {
 	unsigned int  refcount;
@@ -48,10 +77,16 @@ struct script
 	js_ref_t*     this_arg;
 };
 
-static bool js_onScriptFinished (int num_args, bool is_ctor, intptr_t magic);
+static path_t* bytecode_path       (const char* source, size_t length);
+static int     compare_entries     (const void* in_a, const void* in_b);
+static bool    js_onScriptFinished (int num_args, bool is_ctor, intptr_t magic);
+static void*   load_bytecode       (const path_t* path, size_t source_size, uint32_t source_hash, size_t *out_size);
+static void    prune_cache         (void);
+static void    save_bytecode       (const path_t* path, const void* bytecode, size_t size, size_t source_size, uint32_t source_hash);
 
-static js_ref_t* s_key_then;
-static int       s_next_script_id = 1;
+static js_ref_t*    s_key_then;
+static int          s_next_script_id = 1;
+static unsigned int s_next_temp_id = 1;
 
 void
 scripts_init(void)
@@ -59,6 +94,7 @@ scripts_init(void)
 	console_log(1, "initializing JS script manager");
 
 	s_key_then = jsal_new_key("then");
+	prune_cache();
 }
 
 void
@@ -92,7 +128,7 @@ script_eval(const char* filename)
 
 	// ready for launch in T-10...9...*munch*
 	jsal_push_lstring_t(source_text);
-	if (!jsal_try_compile(source_name))
+	if (!script_try_compile(source_name))
 		goto on_error;
 	if (!jsal_try_call(0))
 		goto on_error;
@@ -128,7 +164,8 @@ script_new(const lstring_t* source, const char* fmt_name, ...)
 	// compile the source.  JSAL gives us a function back; save its heap pointer so
 	// we can call the script later.
 	jsal_push_lstring_t(source);
-	jsal_compile(lstr_cstr(name));
+	if (!script_try_compile(lstr_cstr(name)))
+		jsal_throw();
 	function = jsal_pop_ref();
 
 	source_map_add_source(lstr_cstr(name), lstr_cstr(source));
@@ -193,6 +230,55 @@ script_unref(script_t* script)
 	free(script);
 }
 
+bool
+script_try_compile(const char* filename)
+{
+	/* [ ... source ] -> [ ... function ] */
+
+	// note: compiled bytecode is cached on disk under the MD5 hash of the source
+	//       text, so editing a script invalidates its entry automatically.  if a cached
+	//       entry can't be used for any reason, the script is compiled from source as
+	//       usual.  small scripts are cheap to parse and games often build them on the
+	//       fly (e.g. SetUpdateScript()), so those aren't worth caching.
+
+	void*       bytecode;
+	size_t      bytecode_size;
+	path_t*     cache_path;
+	const char* source;
+	uint32_t    source_hash;
+	size_t      source_length;
+
+	source = jsal_require_lstring(-1, &source_length);
+	if (source_length < MIN_CACHED_SOURCE)
+		return jsal_try_compile(filename);
+	cache_path = bytecode_path(source, source_length);
+	source_hash = fnv1a(source, source_length);
+	if ((bytecode = load_bytecode(cache_path, source_length, source_hash, &bytecode_size))) {
+		if (jsal_compile_serialized(filename, bytecode, bytecode_size)) {
+			console_log(4, "using cached bytecode for '%s'", filename);
+			free(bytecode);
+			path_free(cache_path);
+			return true;
+		}
+		free(bytecode);
+	}
+
+	// not cached (or the cache entry is stale), serialize the script now.  if that
+	// fails, compile it normally so that any syntax errors get reported.
+	if ((bytecode = jsal_serialize(-1, &bytecode_size))) {
+		console_log(4, "caching bytecode for '%s'", filename);
+		save_bytecode(cache_path, bytecode, bytecode_size, source_length, source_hash);
+		if (jsal_compile_serialized(filename, bytecode, bytecode_size)) {
+			free(bytecode);
+			path_free(cache_path);
+			return true;
+		}
+		free(bytecode);
+	}
+	path_free(cache_path);
+	return jsal_try_compile(filename);
+}
+
 void
 script_run(script_t* script, bool allow_reentry)
 {
@@ -239,6 +325,32 @@ script_run(script_t* script, bool allow_reentry)
 
 }
 
+static path_t*
+bytecode_path(const char* source, size_t length)
+{
+	char    filename[40];
+	path_t* path;
+
+	sprintf(filename, "%s.jsc", md5sum(source, length));
+	path = path_rebase(path_new("miniSphere/.jsCache/"), home_path());
+	path_append_dir(path, SPHERE_VERSION);
+	path_append(path, filename);
+	return path;
+}
+
+static int
+compare_entries(const void* in_a, const void* in_b)
+{
+	const struct cache_entry* entry_a;
+	const struct cache_entry* entry_b;
+
+	entry_a = in_a;
+	entry_b = in_b;
+	return entry_a->mtime < entry_b->mtime ? -1
+		: entry_a->mtime > entry_b->mtime ? 1
+		: 0;
+}
+
 static bool
 js_onScriptFinished(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -249,3 +361,160 @@ js_onScriptFinished(int num_args, bool is_ctor, intptr_t magic)
 	script_unref(script);
 	return false;
 }
+
+static void*
+load_bytecode(const path_t* path, size_t source_size, uint32_t source_hash, size_t *out_size)
+{
+	// note: an entry which doesn't match its header, e.g. because it was cut short or
+	//       belongs to different source text, is deleted so it gets rebuilt.
+
+	void*             bytecode = NULL;
+	ALLEGRO_FILE*     file;
+	int64_t           file_size;
+	struct jsc_header header;
+
+	if (!(file = al_fopen(path_cstr(path), "rb")))
+		return NULL;
+	file_size = al_fsize(file);
+	if (al_fread(file, &header, sizeof(struct jsc_header)) != sizeof(struct jsc_header))
+		goto on_error;
+	if (memcmp(header.signature, ".jsc", 4) != 0
+		|| header.source_size != source_size
+		|| header.source_hash != source_hash
+		|| (int64_t)header.bytecode_size != file_size - (int64_t)sizeof(struct jsc_header))
+	{
+		goto on_error;
+	}
+	if (!(bytecode = malloc(header.bytecode_size))) {
+		al_fclose(file);
+		return NULL;
+	}
+	if (al_fread(file, bytecode, header.bytecode_size) != header.bytecode_size)
+		goto on_error;
+	if (fnv1a(bytecode, header.bytecode_size) != header.bytecode_hash)
+		goto on_error;
+	al_fclose(file);
+	*out_size = header.bytecode_size;
+	return bytecode;
+
+on_error:
+	al_fclose(file);
+	free(bytecode);
+	remove(path_cstr(path));
+	return NULL;
+}
+
+static void
+prune_cache(void)
+{
+	// note: bytecode cached by other versions of the engine can never be used again, so
+	//       it's deleted outright.  the cache for this version is capped at MAX_CACHE_SIZE,
+	//       evicting the oldest entries first.  temporary files left behind by a crash
+	//       are cleaned up too, once they're old enough that nobody can still be writing
+	//       them.
+
+	path_t*             cache_path;
+	tinydir_dir         dir_info;
+	struct cache_entry* entry;
+	vector_t*           entries;
+	tinydir_file        file_info;
+	struct cache_entry  new_entry;
+	tinydir_dir         old_dir_info;
+	tinydir_file        old_file_info;
+	struct stat         stats;
+	int64_t             total_size = 0;
+	path_t*             version_path;
+
+	iter_t iter;
+
+	cache_path = path_rebase(path_new("miniSphere/.jsCache/"), home_path());
+	version_path = path_append_dir(path_dup(cache_path), SPHERE_VERSION);
+	if (tinydir_open(&dir_info, path_cstr(cache_path)) == 0) {
+		while (dir_info.has_next) {
+			tinydir_readfile(&dir_info, &file_info);
+			tinydir_next(&dir_info);
+			if (!file_info.is_dir || file_info.name[0] == '.' || strcmp(file_info.name, SPHERE_VERSION) == 0)
+				continue;
+			console_log(2, "removing stale bytecode cache '%s'", file_info.name);
+			if (tinydir_open(&old_dir_info, file_info.path) == 0) {
+				while (old_dir_info.has_next) {
+					tinydir_readfile(&old_dir_info, &old_file_info);
+					if (old_file_info.is_reg)
+						al_remove_filename(old_file_info.path);
+					tinydir_next(&old_dir_info);
+				}
+				tinydir_close(&old_dir_info);
+			}
+			al_remove_filename(file_info.path);
+		}
+		tinydir_close(&dir_info);
+	}
+
+	entries = vector_new(sizeof(struct cache_entry));
+	if (tinydir_open(&dir_info, path_cstr(version_path)) == 0) {
+		while (dir_info.has_next) {
+			tinydir_readfile(&dir_info, &file_info);
+			tinydir_next(&dir_info);
+			if (!file_info.is_reg || stat(file_info.path, &stats) != 0)
+				continue;
+			if (strcmp(file_info.extension, "tmp") == 0) {
+				if (difftime(time(NULL), stats.st_mtime) > 3600.0)
+					al_remove_filename(file_info.path);
+				continue;
+			}
+			new_entry.filename = strdup(file_info.path);
+			new_entry.mtime = stats.st_mtime;
+			new_entry.size = stats.st_size;
+			vector_push(entries, &new_entry);
+			total_size += new_entry.size;
+		}
+		tinydir_close(&dir_info);
+	}
+	vector_sort(entries, compare_entries);
+	iter = vector_enum(entries);
+	while ((entry = iter_next(&iter))) {
+		if (total_size > MAX_CACHE_SIZE && al_remove_filename(entry->filename))
+			total_size -= entry->size;
+		free(entry->filename);
+	}
+	vector_free(entries);
+	path_free(version_path);
+	path_free(cache_path);
+}
+
+static void
+save_bytecode(const path_t* path, const void* bytecode, size_t size, size_t source_size, uint32_t source_hash)
+{
+	// note: the entry is written under a temporary name and then renamed into place, so
+	//       nobody ever reads a half-written file.
+
+	ALLEGRO_FILE*     file;
+	struct jsc_header header;
+	bool              succeeded;
+	char*             temp_filename;
+
+	memcpy(header.signature, ".jsc", 4);
+	header.source_size = (uint32_t)source_size;
+	header.source_hash = source_hash;
+	header.bytecode_size = (uint32_t)size;
+	header.bytecode_hash = fnv1a(bytecode, size);
+
+	path_mkdir(path);
+	temp_filename = strnewf("%s.%d-%u.tmp", path_cstr(path), (int)getpid(), s_next_temp_id++);
+	if (!(file = al_fopen(temp_filename, "wb"))) {
+		free(temp_filename);
+		return;
+	}
+	succeeded = al_fwrite(file, &header, sizeof(struct jsc_header)) == sizeof(struct jsc_header)
+		&& al_fwrite(file, bytecode, size) == size;
+	succeeded = al_fclose(file) && succeeded;
+
+	// note: rename() won't replace an existing file on Windows.
+	if (succeeded && rename(temp_filename, path_cstr(path)) != 0) {
+		remove(path_cstr(path));
+		succeeded = rename(temp_filename, path_cstr(path)) == 0;
+	}
+	if (!succeeded)
+		remove(temp_filename);
+	free(temp_filename);
+}
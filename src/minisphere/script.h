@@ -44,5 +44,6 @@ script_t* script_new_method   (int stack_index);
 script_t* script_ref          (script_t* script);
 void      script_unref        (script_t* script);
 void      script_run          (script_t* script, bool allow_reentry);
+bool      script_try_compile  (const char* filename);
 
 #endif // SPHERE__SCRIPT_H__INCLUDED
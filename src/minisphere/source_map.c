@@ -34,6 +34,7 @@
 #include "source_map.h"
 
 #include "font.h"
+#include "hashmap.h"
 
 struct alias
 {
@@ -41,10 +42,18 @@ struct alias
 	char* url;
 };
 
+struct file_ref
+{
+	const char* filename;
+	int         file_index;
+	int         map_index;
+};
+
 struct map
 {
 	wraptext_t* filenames;
 	wraptext_t* identifiers;
+	vector_t*   rev_segments;
 	vector_t*   segments;
 	char*       url;
 };
@@ -64,18 +73,24 @@ struct source
 	char* text;
 };
 
-static int compare_segments (const void* a, const void* b);
-static int vlq_decode_next  (const char* start, int* out_array, int max_values);
+static bool     build_file_index     (void);
+static int      compare_rev_segments (const void* a, const void* b);
+static int      compare_segments     (const void* a, const void* b);
+static int      find_map             (const char* url);
+static int      vlq_decode_next      (const char* start, int* out_array, int max_values);
 
-static vector_t* s_aliases;
-static vector_t* s_maps;
-static vector_t* s_sources;
+static vector_t*  s_aliases;
+static hashmap_t* s_file_refs = NULL;
+static hashmap_t* s_map_index;
+static vector_t*  s_maps;
+static vector_t*  s_sources;
 
 void
 source_map_init(void)
 {
 	s_sources = vector_new(sizeof(struct source));
 	s_maps = vector_new(sizeof(struct map));
+	s_map_index = hashmap_new(sizeof(int));
 	s_aliases = vector_new(sizeof(struct alias));
 }
 
@@ -99,10 +114,14 @@ source_map_uninit(void)
 	while ((map = iter_next(&iter))) {
 		wraptext_free(map->filenames);
 		wraptext_free(map->identifiers);
+		vector_free(map->rev_segments);
 		vector_free(map->segments);
 		free(map->url);
 	}
 	vector_free(s_maps);
+	hashmap_free(s_map_index);
+	hashmap_free(s_file_refs);
+	s_file_refs = NULL;
 
 	iter = vector_enum(s_sources);
 	while ((source = iter_next(&iter))) {
@@ -194,6 +213,7 @@ source_map_add_map(const char* url, js_ref_t* content)
 	//       best if all source text is provided first (using `source_map_add_source`).
 
 	const char*    filename;
+	int            index;
 	int            line = 0;
 	struct map     map;
 	int            num_values;
@@ -202,15 +222,9 @@ source_map_add_map(const char* url, js_ref_t* content)
 	int            stack_top;
 	int            values[5];
 	const char*    p_in;
-	struct map*    p_map;
-
-	iter_t iter;
 
-	iter = vector_enum(s_maps);
-	while ((p_map = iter_next(&iter))) {
-		if (strcmp(url, p_map->url) == 0)
-			return true;
-	}
+	if (find_map(url) >= 0)
+		return true;
 
 	stack_top = jsal_get_top();
 
@@ -278,11 +292,26 @@ source_map_add_map(const char* url, js_ref_t* content)
 	}
 	vector_sort(map.segments, compare_segments);
 
-	vector_push(s_maps, &map);
+	if (!vector_push(s_maps, &map))
+		goto on_error;
+	index = vector_len(s_maps) - 1;
+	if (!hashmap_put(s_map_index, url, strlen(url), &index)) {
+		vector_pop(s_maps, 1);
+		goto on_error;
+	}
+
+	// the reverse lookup index is out of date now.  it will be rebuilt the next
+	// time it's needed.
+	hashmap_free(s_file_refs);
+	s_file_refs = NULL;
+
 	jsal_set_top(stack_top);
 	return true;
 
 on_error:
+	wraptext_free(map.filenames);
+	vector_free(map.segments);
+	free(map.url);
 	jsal_set_top(stack_top);
 	return false;
 }
@@ -317,38 +346,41 @@ on_error:
 mapping_t
 source_map_lookup(const char* url, int line, int column)
 {
-	int             file_index = -1;
+	int             hi;
+	int             index;
+	int             lo;
 	struct map*     map;
-	int             mapped_column = column;
-	int             mapped_line = line;
+	int             mid;
 	mapping_t       retval;
 	struct segment* segment;
 
-	iter_t iter;
-
-	iter = vector_enum(s_maps);
-	while ((map = iter_next(&iter))) {
-		if (strcmp(map->url, url) == 0)
-			break;
-	}
-
 	retval.filename = url;
 	retval.line = line;
 	retval.column = column;
-	if (map != NULL) {
-		iter = vector_enum(map->segments);
-		while ((segment = iter_next(&iter))) {
-			if (segment->line > line || (segment->line == line && segment->column > column))
-				break;
-			file_index = segment->file_index;
-			mapped_line = segment->src_line;
-			mapped_column = segment->src_column;
-		}
-		retval.filename = file_index >= 0
-			? wraptext_line(map->filenames, file_index)
-			: NULL;
-		retval.line = mapped_line;
-		retval.column = mapped_column;
+	if ((index = find_map(url)) < 0)
+		return retval;
+	map = vector_get(s_maps, index);
+
+	// find the last segment at or before the given position.  segments are sorted
+	// by generated position, so this can be done with a binary search.
+	lo = 0;
+	hi = vector_len(map->segments);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		segment = vector_get(map->segments, mid);
+		if (segment->line < line || (segment->line == line && segment->column <= column))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0) {
+		segment = vector_get(map->segments, lo - 1);
+		retval.filename = wraptext_line(map->filenames, segment->file_index);
+		retval.line = segment->src_line;
+		retval.column = segment->src_column;
+	}
+	else {
+		retval.filename = NULL;
 	}
 	return retval;
 }
@@ -356,58 +388,124 @@ source_map_lookup(const char* url, int line, int column)
 mapping_t
 source_map_reverse(const char* filename, int line, int column)
 {
-	int             file_index = -1;
-	bool            found_file = false;
-	struct map*     map;
-	int             mapped_column = column;
-	int             mapped_line = line;
-	mapping_t       retval;
-	struct segment* segment;
-
-	iter_t iter;
-	int i;
-
-	iter = vector_enum(s_maps);
-	while ((map = iter_next(&iter))) {
-		for (i = 0; i < wraptext_len(map->filenames); ++i) {
-			if (strcmp(wraptext_line(map->filenames, i), filename) == 0)
-				found_file = true;
-		}
-		if (found_file)
-			break;
-	}
+	struct file_ref* file_ref;
+	int              hi;
+	int              lo;
+	struct map*      map;
+	int              mid;
+	mapping_t        retval;
+	struct segment*  segment;
 
 	retval.filename = filename;
 	retval.line = line;
 	retval.column = column;
-	if (map != NULL) {
-		iter = vector_enum(map->segments);
-		while ((segment = iter_next(&iter))) {
-			if (segment->src_line > line || (segment->src_line == line && segment->src_column > column))
-				break;
-			file_index = segment->file_index;
-			mapped_line = segment->line;
-			mapped_column = segment->column;
+
+	if (s_file_refs == NULL && !build_file_index())
+		return retval;
+	if (!(file_ref = hashmap_get(s_file_refs, filename, strlen(filename))))
+		return retval;
+	map = vector_get(s_maps, file_ref->map_index);
+
+	// the reverse index for a map is only built the first time it's needed.  most
+	// maps are never reverse-mapped at all, since that only happens when setting
+	// breakpoints.
+	if (map->rev_segments == NULL) {
+		if (!(map->rev_segments = vector_dup(map->segments)))
+			return retval;
+		vector_sort(map->rev_segments, compare_rev_segments);
+	}
+
+	retval.filename = map->url;
+	lo = 0;
+	hi = vector_len(map->rev_segments);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		segment = vector_get(map->rev_segments, mid);
+		if (segment->file_index < file_ref->file_index
+			|| (segment->file_index == file_ref->file_index
+				&& (segment->src_line < line || (segment->src_line == line && segment->src_column <= column))))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo > 0) {
+		segment = vector_get(map->rev_segments, lo - 1);
+		if (segment->file_index == file_ref->file_index) {
+			retval.line = segment->line;
+			retval.column = segment->column;
 		}
-		retval.filename = map->url;
-		retval.line = mapped_line;
-		retval.column = mapped_column;
 	}
 	return retval;
 }
 
+static bool
+build_file_index(void)
+{
+	// note: if a file is named by more than one source map, the first one added
+	//       takes precedence.
+
+	struct file_ref file_ref;
+	struct map*     map;
+
+	int i, j;
+
+	if (!(s_file_refs = hashmap_new(sizeof(struct file_ref))))
+		goto on_error;
+	for (i = 0; i < vector_len(s_maps); ++i) {
+		map = vector_get(s_maps, i);
+		for (j = 0; j < wraptext_len(map->filenames); ++j) {
+			file_ref.filename = wraptext_line(map->filenames, j);
+			file_ref.file_index = j;
+			file_ref.map_index = i;
+			if (hashmap_get(s_file_refs, file_ref.filename, strlen(file_ref.filename)) != NULL)
+				continue;
+			if (!hashmap_put(s_file_refs, file_ref.filename, strlen(file_ref.filename), &file_ref))
+				goto on_error;
+		}
+	}
+	return true;
+
+on_error:
+	hashmap_free(s_file_refs);
+	s_file_refs = NULL;
+	return false;
+}
+
 static int
-compare_segments(const void* in_a, const void* in_b)
+compare_rev_segments(const void* in_a, const void* in_b)
 {
 	const struct segment* seg_a = in_a;
 	const struct segment* seg_b = in_b;
 
 	return seg_a->file_index < seg_b->file_index ? -1 : seg_a->file_index > seg_b->file_index ? +1
+		: seg_a->src_line < seg_b->src_line ? -1 : seg_a->src_line > seg_b->src_line ? +1
+		: seg_a->src_column < seg_b->src_column ? -1 : seg_a->src_column > seg_b->src_column ? +1
 		: seg_a->line < seg_b->line ? -1 : seg_a->line > seg_b->line ? +1
 		: seg_a->column < seg_b->column ? -1 : seg_a->column > seg_b->column ? +1
 		: 0;
 }
 
+static int
+compare_segments(const void* in_a, const void* in_b)
+{
+	const struct segment* seg_a = in_a;
+	const struct segment* seg_b = in_b;
+
+	return seg_a->line < seg_b->line ? -1 : seg_a->line > seg_b->line ? +1
+		: seg_a->column < seg_b->column ? -1 : seg_a->column > seg_b->column ? +1
+		: 0;
+}
+
+static int
+find_map(const char* url)
+{
+	int* index;
+
+	if (!(index = hashmap_get(s_map_index, url, strlen(url))))
+		return -1;
+	return *index;
+}
+
 static int
 vlq_decode_next(const char* start, int* values, int max_values)
 {
@@ -36,28 +36,33 @@
 #include "atlas.h"
 #include "image.h"
 #include "obstruction.h"
+#include "vector.h"
 
 struct tileset
 {
 	unsigned int id;
 	atlas_t*     atlas;
 	int          atlas_pitch;
+	vector_t*    changes;
+	unsigned int frame;
 	int          height;
 	int          num_tiles;
+	unsigned int revision;
 	struct tile* tiles;
+	vector_t*    timers;
 	int          width;
 };
 
 struct tile
 {
-	int        delay;
-	int        frames_left;
-	image_t*   image;
-	int        image_index;
-	lstring_t* name;
-	int        next_index;
-	int        num_obs_lines;
-	obsmap_t*  obsmap;
+	int          delay;
+	unsigned int due_frame;
+	image_t*     image;
+	int          image_index;
+	lstring_t*   name;
+	int          next_index;
+	int          num_obs_lines;
+	obsmap_t*    obsmap;
 };
 
 #pragma pack(push, 1)
@@ -89,6 +94,10 @@ struct rts_tile_header
 };
 #pragma pack(pop)
 
+static void pop_timer    (tileset_t* tileset);
+static void push_timer   (tileset_t* tileset, int tile_index);
+static bool timer_before (const tileset_t* tileset, int tile_a, int tile_b);
+
 static unsigned int s_next_tileset_id = 0;
 
 tileset_t*
@@ -155,7 +164,6 @@ tileset_read(file_t* file)
 		tiles[i].next_index = tilehdr.animated ? tilehdr.next_tile : i;
 		tiles[i].delay = tilehdr.animated ? tilehdr.delay : 0;
 		tiles[i].image_index = i;
-		tiles[i].frames_left = tiles[i].delay;
 		if (rts.has_obstructions) {
 			switch (tilehdr.obsmap_type) {
 			case 1:  // pixel-perfect obstruction (no longer supported)
@@ -182,6 +190,19 @@ tileset_read(file_t* file)
 	tileset->height = rts.tile_height;
 	tileset->num_tiles = rts.num_tiles;
 	tileset->tiles = tiles;
+
+	// only animated tiles go into the timer heap, so that tileset_update() doesn't
+	// need to look at the rest of them at all.
+	if (!(tileset->timers = vector_new(sizeof(int))))
+		goto on_error;
+	if (!(tileset->changes = vector_new(sizeof(int))))
+		goto on_error;
+	for (i = 0; i < rts.num_tiles; ++i) {
+		if (tiles[i].delay > 0) {
+			tiles[i].due_frame = tiles[i].delay;
+			push_timer(tileset, i);
+		}
+	}
 	return tileset;
 
 on_error:  // oh no!
@@ -194,9 +215,13 @@ on_error:  // oh no!
 			obsmap_free(tiles[i].obsmap);
 			image_unref(tiles[i].image);
 		}
-		free(tileset->tiles);
+		free(tiles);
 	}
 	atlas_free(atlas);
+	if (tileset != NULL) {
+		vector_free(tileset->timers);
+		vector_free(tileset->changes);
+	}
 	free(tileset);
 	return NULL;
 }
@@ -214,6 +239,8 @@ tileset_free(tileset_t* tileset)
 		obsmap_free(tileset->tiles[i].obsmap);
 	}
 	atlas_free(tileset->atlas);
+	vector_free(tileset->timers);
+	vector_free(tileset->changes);
 	free(tileset->tiles);
 	free(tileset);
 }
@@ -228,6 +255,14 @@ tileset_get_next(const tileset_t* tileset, int tile_index)
 		? next_index : tile_index;
 }
 
+const vector_t*
+tileset_get_changes(const tileset_t* tileset)
+{
+	// note: this is the list of tiles whose current frame changed during the most
+	//       recent call to tileset_update().  the list is replaced on every update.
+	return tileset->changes;
+}
+
 int
 tileset_len(const tileset_t* tileset)
 {
@@ -240,6 +275,14 @@ tileset_get_delay(const tileset_t* tileset, int tile_index)
 	return tileset->tiles[tile_index].delay;
 }
 
+int
+tileset_get_frame(const tileset_t* tileset, int tile_index)
+{
+	// note: this is the index of the tile image currently being shown in place of
+	//       the given tile, which may be different due to animation.
+	return tileset->tiles[tile_index].image_index;
+}
+
 image_t*
 tileset_get_image(const tileset_t* tileset, int tile_index)
 {
@@ -268,16 +311,33 @@ tileset_get_size(const tileset_t* tileset, int* out_w, int* out_h)
 	*out_h = tileset->height;
 }
 
+rect_t
+tileset_get_uv(const tileset_t* tileset, int frame_index)
+{
+	return atlas_xy(tileset->atlas, frame_index);
+}
+
+unsigned int
+tileset_revision(const tileset_t* tileset)
+{
+	// note: the revision number is bumped whenever a tile's animation settings
+	//       change, so that anything that caches which tiles are animated knows
+	//       to refresh.
+	return tileset->revision;
+}
+
 void
 tileset_set_next(tileset_t* tileset, int tile_index, int next_index)
 {
 	tileset->tiles[tile_index].next_index = next_index;
+	++tileset->revision;
 }
 
 void
 tileset_set_delay(tileset_t* tileset, int tile_index, int delay)
 {
 	tileset->tiles[tile_index].delay = delay;
+	++tileset->revision;
 }
 
 void
@@ -310,28 +370,95 @@ tileset_set_name(tileset_t* tileset, int tile_index, const lstring_t* name)
 	return true;
 }
 
+image_t*
+tileset_texture(const tileset_t* tileset)
+{
+	return atlas_image(tileset->atlas);
+}
+
 void
 tileset_update(tileset_t* tileset)
 {
 	struct tile* tile;
-
-	int i;
-
-	for (i = 0; i < tileset->num_tiles; ++i) {
-		tile = &tileset->tiles[i];
-		if (tile->frames_left > 0 && --tile->frames_left == 0) {
-			tile->image_index = tileset_get_next(tileset, tile->image_index);
-			tile->frames_left = tileset_get_delay(tileset, tile->image_index);
+	int          tile_index;
+
+	// note: a tile's delay is looked up again each time it changes frames, so the
+	//       delay set for the new frame determines how long it's shown for.  if it
+	//       lands on a frame with no delay, the animation stops there.
+
+	++tileset->frame;
+	vector_clear(tileset->changes);
+	while (vector_len(tileset->timers) > 0) {
+		tile_index = *(int*)vector_get(tileset->timers, 0);
+		tile = &tileset->tiles[tile_index];
+		if (tile->due_frame != tileset->frame)
+			break;
+		pop_timer(tileset);
+		tile->image_index = tileset_get_next(tileset, tile->image_index);
+		vector_push(tileset->changes, &tile_index);
+		if (tileset_get_delay(tileset, tile->image_index) > 0) {
+			tile->due_frame = tileset->frame + tileset_get_delay(tileset, tile->image_index);
+			push_timer(tileset, tile_index);
 		}
 	}
 }
 
-void
-tileset_draw(const tileset_t* tileset, color_t mask, float x, float y, int tile_index)
+static void
+pop_timer(tileset_t* tileset)
 {
-	if (tile_index < 0)
+	int child;
+	int index = 0;
+	int last_tile;
+	int num_timers;
+
+	num_timers = vector_len(tileset->timers) - 1;
+	last_tile = *(int*)vector_get(tileset->timers, num_timers);
+	vector_pop(tileset->timers, 1);
+	if (num_timers == 0)
 		return;
-	tile_index = tileset->tiles[tile_index].image_index;
-	al_draw_tinted_bitmap(image_bitmap(tileset->tiles[tile_index].image),
-		nativecolor(mask), x, y, 0x0);
+	while ((child = index * 2 + 1) < num_timers) {
+		if (child + 1 < num_timers
+			&& timer_before(tileset, *(int*)vector_get(tileset->timers, child + 1), *(int*)vector_get(tileset->timers, child)))
+		{
+			++child;
+		}
+		if (!timer_before(tileset, *(int*)vector_get(tileset->timers, child), last_tile))
+			break;
+		vector_put(tileset->timers, index, vector_get(tileset->timers, child));
+		index = child;
+	}
+	vector_put(tileset->timers, index, &last_tile);
+}
+
+static void
+push_timer(tileset_t* tileset, int tile_index)
+{
+	int index;
+	int parent;
+
+	index = vector_len(tileset->timers);
+	vector_push(tileset->timers, &tile_index);
+	while (index > 0) {
+		parent = (index - 1) / 2;
+		if (!timer_before(tileset, tile_index, *(int*)vector_get(tileset->timers, parent)))
+			break;
+		vector_put(tileset->timers, index, vector_get(tileset->timers, parent));
+		index = parent;
+	}
+	vector_put(tileset->timers, index, &tile_index);
+}
+
+static bool
+timer_before(const tileset_t* tileset, int tile_a, int tile_b)
+{
+	// note: frame numbers may wrap around, so compare them relative to the current
+	//       frame.  ties are broken by tile index to match the order tiles used to be
+	//       updated in.
+
+	unsigned int due_a;
+	unsigned int due_b;
+
+	due_a = tileset->tiles[tile_a].due_frame - tileset->frame;
+	due_b = tileset->tiles[tile_b].due_frame - tileset->frame;
+	return due_a < due_b || (due_a == due_b && tile_a < tile_b);
 }
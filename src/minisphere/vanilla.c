@@ -551,6 +551,8 @@ static blend_op_t* s_blender_multiply;
 static blend_op_t* s_blender_subtract;
 static font_t*     s_default_font;
 static int         s_frame_rate = 0;
+static js_ref_t*   s_key_x;
+static js_ref_t*   s_key_y;
 static mixer_t*    s_sound_mixer;
 
 void
@@ -564,6 +566,9 @@ vanilla_init(void)
 
 	s_sound_mixer = mixer_new(44100, 16, 2);
 
+	s_key_x = jsal_new_key("x");
+	s_key_y = jsal_new_key("y");
+
 	s_blender_normal = blend_op_new_sym(BLEND_OP_ADD, BLEND_ALPHA, BLEND_INV_ALPHA);
 	s_blender_null = blend_op_new_sym(BLEND_OP_ADD, BLEND_ZERO, BLEND_ZERO);
 	s_blender_add = blend_op_new_sym(BLEND_OP_ADD, BLEND_ONE, BLEND_ONE);
@@ -1245,6 +1250,8 @@ vanilla_uninit()
 	blend_op_unref(s_blender_copy_rgb);
 	blend_op_unref(s_blender_multiply);
 	blend_op_unref(s_blender_subtract);
+	jsal_unref(s_key_x);
+	jsal_unref(s_key_y);
 }
 
 void
@@ -1541,6 +1548,29 @@ apply_blend_mode(image_t* image, enum blend_mode mode)
 	image_set_blend_op(image, op);
 }
 
+static void
+batch_blit(image_t* surface, image_t* image, float x, float y, color_t mask)
+{
+	ALLEGRO_COLOR color;
+	float         height;
+	float         width;
+
+	// note: this is equivalent to al_draw_tinted_bitmap(), but goes through Galileo's
+	//       batcher so that a run of blits from the same image is drawn in one go.
+	color = nativecolor(mask);
+	width = image_width(image);
+	height = image_height(image);
+	ALLEGRO_VERTEX v[] = {
+		{ x, y, 0, 0, 0, color },
+		{ x + width, y, 0, width, 0, color },
+		{ x + width, y + height, 0, width, height, color },
+		{ x, y, 0, 0, 0, color },
+		{ x + width, y + height, 0, width, height, color },
+		{ x, y + height, 0, 0, height, color }
+	};
+	galileo_batch(surface, NULL, image_bitmap(image), v, 6);
+}
+
 static bool
 js_Abort(int num_args, bool is_ctor, intptr_t magic)
 {
@@ -4069,6 +4099,7 @@ js_GradientCircle(int num_args, bool is_ctor, intptr_t magic)
 	vertices[i + 1].y = y - sinf(0.0f) * radius;
 	vertices[i + 1].z = 0.0f;
 	vertices[i + 1].color = nativecolor(outer_color);
+	galileo_reset();
 	al_draw_prim(vertices, NULL, NULL, 0, num_points + 2, ALLEGRO_PRIM_TRIANGLE_FAN);
 	return false;
 }
@@ -4573,20 +4604,20 @@ js_LineIntersects(int num_args, bool is_ctor, intptr_t magic)
 	jsal_require_object(2);
 	jsal_require_object(3);
 
-	jsal_get_prop_string(0, "x");
-	jsal_get_prop_string(0, "y");
+	jsal_get_prop_key(0, s_key_x);
+	jsal_get_prop_key(0, s_key_y);
 	x1 = jsal_require_int(-2);
 	y1 = jsal_require_int(-1);
-	jsal_get_prop_string(1, "x");
-	jsal_get_prop_string(1, "y");
+	jsal_get_prop_key(1, s_key_x);
+	jsal_get_prop_key(1, s_key_y);
 	x2 = jsal_require_int(-2);
 	y2 = jsal_require_int(-1);
-	jsal_get_prop_string(2, "x");
-	jsal_get_prop_string(2, "y");
+	jsal_get_prop_key(2, s_key_x);
+	jsal_get_prop_key(2, s_key_y);
 	x3 = jsal_require_int(-2);
 	y3 = jsal_require_int(-1);
-	jsal_get_prop_string(3, "x");
-	jsal_get_prop_string(3, "y");
+	jsal_get_prop_key(3, s_key_x);
+	jsal_get_prop_key(3, s_key_y);
 	x4 = jsal_require_int(-2);
 	y4 = jsal_require_int(-1);
 	overlapping = do_lines_overlap(mk_rect(x1, y1, x2, y2), mk_rect(x3, y3, x4, y4));
@@ -4618,8 +4649,8 @@ js_LineSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -5003,8 +5034,8 @@ js_PointSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -6520,6 +6551,7 @@ js_Animation_drawFrame(int num_args, bool is_ctor, intptr_t magic)
 	x = jsal_to_int(0);
 	y = jsal_to_int(1);
 
+	galileo_reset();
 	image_draw(animation_frame(anim), x, y);
 	return false;
 #else
@@ -6548,6 +6580,7 @@ js_Animation_drawZoomedFrame(int num_args, bool is_ctor, intptr_t magic)
 		jsal_error(JS_RANGE_ERROR, "zoom must be positive");
 	width = animation_width(anim);
 	height = animation_height(anim);
+	galileo_reset();
 	image_draw_scaled(animation_frame(anim), x, y, width * scale, height * scale);
 	return false;
 #else
@@ -7229,10 +7262,9 @@ js_Image_blit(int num_args, bool is_ctor, intptr_t magic)
 	blend_op = blend_mode == BLEND_NORMAL ? s_blender_normal
 		: blend_mode == BLEND_REPLACE ? s_blender_copy
 		: s_blender_null;
-	galileo_reset();
 	prev_blend_op = blend_op_ref(image_get_blend_op(backbuffer));
 	image_set_blend_op(backbuffer, blend_op);
-	al_draw_bitmap(image_bitmap(image), x, y, 0x0);
+	batch_blit(backbuffer, image, x, y, mk_color(255, 255, 255, 255));
 	image_set_blend_op(backbuffer, prev_blend_op);
 	blend_op_unref(prev_blend_op);
 	return false;
@@ -7260,9 +7292,8 @@ js_Image_blitMask(int num_args, bool is_ctor, intptr_t magic)
 
 	if (screen_skipping_frame(g_screen))
 		return false;
-	galileo_reset();
 	apply_blend_mode(screen_backbuffer(g_screen), blend_mode);
-	al_draw_tinted_bitmap(image_bitmap(image), nativecolor(mask), x, y, 0x0);
+	batch_blit(screen_backbuffer(g_screen), image, x, y, mask);
 	return false;
 }
 
@@ -8429,8 +8460,7 @@ js_Surface_blit(int num_args, bool is_ctor, intptr_t magic)
 
 	if (screen_skipping_frame(g_screen))
 		return false;
-	galileo_reset();
-	al_draw_bitmap(image_bitmap(image), x, y, 0x0);
+	batch_blit(screen_backbuffer(g_screen), image, x, y, mk_color(255, 255, 255, 255));
 	return false;
 }
 
@@ -8450,8 +8480,7 @@ js_Surface_blitMaskSurface(int num_args, bool is_ctor, intptr_t magic)
 	y = trunc(jsal_to_number(2));
 	mask = jsal_require_sphere_color(3);
 
-	image_render_to(image, NULL);
-	al_draw_tinted_bitmap(image_bitmap(src_image), nativecolor(mask), x, y, 0x0);
+	batch_blit(image, src_image, x, y, mask);
 	return false;
 }
 
@@ -8469,8 +8498,7 @@ js_Surface_blitSurface(int num_args, bool is_ctor, intptr_t magic)
 	x = trunc(jsal_to_number(1));
 	y = trunc(jsal_to_number(2));
 
-	image_render_to(image, NULL);
-	al_draw_bitmap(image_bitmap(src_image), x, y, 0x0);
+	batch_blit(image, src_image, x, y, mk_color(255, 255, 255, 255));
 	return false;
 }
 
@@ -8856,8 +8884,8 @@ js_Surface_lineSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -8943,8 +8971,8 @@ js_Surface_pointSeries(int num_args, bool is_ctor, intptr_t magic)
 	vtx_color = nativecolor(color);
 	for (i = 0; i < num_points; ++i) {
 		jsal_get_prop_index(0, i);
-		jsal_get_prop_string(-1, "x");
-		jsal_get_prop_string(-2, "y");
+		jsal_get_prop_key(-1, s_key_x);
+		jsal_get_prop_key(-2, s_key_y);
 		x = trunc(jsal_to_number(-2));
 		y = trunc(jsal_to_number(-1));
 		jsal_pop(3);
@@ -128,3 +128,28 @@ on_error:
 	free(buffer);
 	return NULL;
 }
+
+bool
+z_inflate_into(const void* data, size_t size, void* buffer, size_t buffer_size, size_t *out_output_size)
+{
+	// note: unlike z_inflate(), this inflates into a caller-provided buffer, which
+	//       must be large enough to hold all of the inflated data.  no NUL terminator
+	//       is added.
+
+	int      result;
+	z_stream stream;
+
+	memset(&stream, 0, sizeof(z_stream));
+	stream.next_in = (Bytef*)data;
+	stream.avail_in = (uInt)size;
+	if (inflateInit(&stream) != Z_OK)
+		return false;
+	stream.next_out = buffer;
+	stream.avail_out = (uInt)buffer_size;
+	result = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+	if (result != Z_STREAM_END)
+		return false;
+	*out_output_size = buffer_size - stream.avail_out;
+	return true;
+}
@@ -33,9 +33,11 @@
 #ifndef SPHERE__COMPRESS_H__INCLUDED
 #define SPHERE__COMPRESS_H__INCLUDED
 
+#include <stdbool.h>
 #include <stddef.h>
 
-void* z_deflate (const void* data, size_t size, int level, size_t *out_output_size);
-void* z_inflate (const void* data, size_t size, size_t max_inflate, size_t *out_output_size);
+void* z_deflate      (const void* data, size_t size, int level, size_t *out_output_size);
+void* z_inflate      (const void* data, size_t size, size_t max_inflate, size_t *out_output_size);
+bool  z_inflate_into (const void* data, size_t size, void* buffer, size_t buffer_size, size_t *out_output_size);
 
 #endif // SPHERE__COMPRESS_H__INCLUDED
@@ -0,0 +1,296 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2020, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+// note: this is an open-addressed hash table with linear probing, keyed on arbitrary
+//       byte strings.  values are stored inline in a vector in the order they were
+//       added, and a separate table of slots maps each key to its vector index.  keeping
+//       the values dense means they can be enumerated like any other vector; however,
+//       removing an entry moves the last one into its place and adding one may move all
+//       of them, so don't hold onto value pointers across either.
+
+#include "hashmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct key
+{
+	uint32_t hash;
+	void*    data;
+	size_t   size;
+};
+
+struct hashmap
+{
+	vector_t* keys;
+	int       max_slots;
+	size_t    pitch;
+	int*      slots;
+	vector_t* values;
+};
+
+static int  find_slot    (const hashmap_t* map, uint32_t hash, const void* key, size_t key_size);
+static bool resize_slots (hashmap_t* map, int new_max);
+
+hashmap_t*
+hashmap_new(size_t pitch)
+{
+	hashmap_t* map;
+
+	if (!(map = calloc(1, sizeof(hashmap_t))))
+		return NULL;
+	map->pitch = pitch;
+	if (!(map->keys = vector_new(sizeof(struct key))))
+		goto on_error;
+	if (!(map->values = vector_new(pitch)))
+		goto on_error;
+	if (!resize_slots(map, 16))
+		goto on_error;
+	return map;
+
+on_error:
+	vector_free(map->keys);
+	vector_free(map->values);
+	free(map);
+	return NULL;
+}
+
+void
+hashmap_free(hashmap_t* it)
+{
+	if (it == NULL)
+		return;
+	hashmap_clear(it);
+	vector_free(it->keys);
+	vector_free(it->values);
+	free(it->slots);
+	free(it);
+}
+
+int
+hashmap_len(const hashmap_t* it)
+{
+	return vector_len(it->values);
+}
+
+void
+hashmap_clear(hashmap_t* it)
+{
+	struct key* key;
+
+	iter_t iter;
+	int    i;
+
+	iter = vector_enum(it->keys);
+	while ((key = iter_next(&iter)))
+		free(key->data);
+	vector_clear(it->keys);
+	vector_clear(it->values);
+	for (i = 0; i < it->max_slots; ++i)
+		it->slots[i] = -1;
+}
+
+iter_t
+hashmap_enum(hashmap_t* it)
+{
+	// note: don't add or remove entries while enumerating a hashmap; iter_remove()
+	//       is NOT supported.
+	return vector_enum(it->values);
+}
+
+void*
+hashmap_get(const hashmap_t* it, const void* key, size_t key_size)
+{
+	int index;
+
+	index = it->slots[find_slot(it, fnv1a(key, key_size), key, key_size)];
+	return index >= 0 ? vector_get(it->values, index) : NULL;
+}
+
+void*
+hashmap_put(hashmap_t* it, const void* key, size_t key_size, const void* in_value)
+{
+	// note: if `in_value` is NULL, the value is zero-filled.
+
+	uint32_t   hash;
+	int        index;
+	struct key new_key;
+	int        slot;
+	void*      value;
+
+	hash = fnv1a(key, key_size);
+	slot = find_slot(it, hash, key, key_size);
+	if ((index = it->slots[slot]) < 0) {
+		// keep the load factor at or below 50% so probe chains stay short
+		if ((vector_len(it->keys) + 1) * 2 > it->max_slots) {
+			if (!resize_slots(it, it->max_slots * 2))
+				return NULL;
+			slot = find_slot(it, hash, key, key_size);
+		}
+		new_key.hash = hash;
+		new_key.size = key_size;
+		if (!(new_key.data = malloc(key_size > 0 ? key_size : 1)))
+			return NULL;
+		memcpy(new_key.data, key, key_size);
+		if (!vector_push(it->keys, &new_key)) {
+			free(new_key.data);
+			return NULL;
+		}
+		index = vector_len(it->keys) - 1;
+		if (!vector_resize(it->values, index + 1)) {
+			free(new_key.data);
+			vector_pop(it->keys, 1);
+			return NULL;
+		}
+		it->slots[slot] = index;
+	}
+	value = vector_get(it->values, index);
+	if (in_value != NULL)
+		memcpy(value, in_value, it->pitch);
+	else
+		memset(value, 0, it->pitch);
+	return value;
+}
+
+bool
+hashmap_remove(hashmap_t* it, const void* key, size_t key_size)
+{
+	int         hole;
+	int         home;
+	int         index;
+	int         last_index;
+	struct key* last_key;
+	int         mask;
+	int         slot;
+
+	slot = find_slot(it, fnv1a(key, key_size), key, key_size);
+	if ((index = it->slots[slot]) < 0)
+		return false;
+	free(((struct key*)vector_get(it->keys, index))->data);
+
+	// rather than leaving a tombstone, later entries in the same probe chain are
+	// shifted back to fill the hole.
+	mask = it->max_slots - 1;
+	it->slots[slot] = -1;
+	hole = slot;
+	for (;;) {
+		slot = (slot + 1) & mask;
+		if (it->slots[slot] < 0)
+			break;
+		home = ((struct key*)vector_get(it->keys, it->slots[slot]))->hash & mask;
+		if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+			it->slots[hole] = it->slots[slot];
+			it->slots[slot] = -1;
+			hole = slot;
+		}
+	}
+
+	// move the last entry into the vacated spot to keep the vectors dense
+	last_index = vector_len(it->keys) - 1;
+	if (index != last_index) {
+		last_key = vector_get(it->keys, last_index);
+		slot = last_key->hash & mask;
+		while (it->slots[slot] != last_index)
+			slot = (slot + 1) & mask;
+		it->slots[slot] = index;
+		vector_put(it->keys, index, last_key);
+		vector_put(it->values, index, vector_get(it->values, last_index));
+	}
+	vector_pop(it->keys, 1);
+	vector_pop(it->values, 1);
+	return true;
+}
+
+uint32_t
+fnv1a(const void* data, size_t size)
+{
+	uint32_t       hash = 2166136261U;
+	const uint8_t* p;
+
+	for (p = data; p < (const uint8_t*)data + size; ++p) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static int
+find_slot(const hashmap_t* map, uint32_t hash, const void* key, size_t key_size)
+{
+	// note: this returns either the slot holding `key` or the empty slot where it
+	//       belongs.
+
+	int         index;
+	int         mask;
+	int         slot;
+	struct key* slot_key;
+
+	mask = map->max_slots - 1;
+	slot = hash & mask;
+	while ((index = map->slots[slot]) >= 0) {
+		slot_key = vector_get(map->keys, index);
+		if (slot_key->hash == hash && slot_key->size == key_size
+			&& memcmp(slot_key->data, key, key_size) == 0)
+		{
+			break;
+		}
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+static bool
+resize_slots(hashmap_t* map, int new_max)
+{
+	struct key* key;
+	int*        slots;
+	int         slot;
+
+	iter_t iter;
+	int    i;
+
+	if (!(slots = malloc(new_max * sizeof(int))))
+		return false;
+	for (i = 0; i < new_max; ++i)
+		slots[i] = -1;
+	iter = vector_enum(map->keys);
+	while ((key = iter_next(&iter))) {
+		slot = key->hash & (new_max - 1);
+		while (slots[slot] >= 0)
+			slot = (slot + 1) & (new_max - 1);
+		slots[slot] = iter.index;
+	}
+	free(map->slots);
+	map->slots = slots;
+	map->max_slots = new_max;
+	return true;
+}
@@ -0,0 +1,55 @@
+/**
+ *  miniSphere JavaScript game engine
+ *  Copyright (c) 2015-2020, Fat Cerberus
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are met:
+ *
+ *  * Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ *  * Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  * Neither the name of miniSphere nor the names of its contributors may be
+ *    used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+**/
+
+#ifndef SPHERE__HASHMAP_H__INCLUDED
+#define SPHERE__HASHMAP_H__INCLUDED
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vector.h"
+
+typedef struct hashmap hashmap_t;
+
+hashmap_t* hashmap_new    (size_t pitch);
+void       hashmap_free   (hashmap_t* it);
+int        hashmap_len    (const hashmap_t* it);
+void       hashmap_clear  (hashmap_t* it);
+iter_t     hashmap_enum   (hashmap_t* it);
+void*      hashmap_get    (const hashmap_t* it, const void* key, size_t key_size);
+void*      hashmap_put    (hashmap_t* it, const void* key, size_t key_size, const void* in_value);
+bool       hashmap_remove (hashmap_t* it, const void* key, size_t key_size);
+
+uint32_t   fnv1a          (const void* data, size_t size);
+
+#endif // SPHERE__HASHMAP_H__INCLUDED
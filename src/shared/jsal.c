@@ -52,8 +52,13 @@
 #endif
 
 #include <ChakraCore.h>
+#include "hashmap.h"
 #include "vector.h"
 
+// note: the interned key table is capped so that code which builds property names
+//       on the fly (e.g. from user data) can't grow it without bound.
+#define MAX_INTERNED_KEYS 4096
+
 #if !defined(WIN32)
 #define jsal_setjmp(env)          sigsetjmp(env, false)
 #define jsal_longjmp(env, value)  siglongjmp(env, value)
@@ -120,14 +125,17 @@ static JsErrorCode CHAKRA_CALLBACK on_fetch_dynamic_import     (JsSourceContext
 static JsErrorCode CHAKRA_CALLBACK on_fetch_imported_module    (JsModuleRecord importer, JsValueRef specifier, JsModuleRecord *out_module);
 static void CHAKRA_CALLBACK        on_finalize_host_object     (void* userdata);
 static JsValueRef CHAKRA_CALLBACK  on_js_to_native_call        (JsValueRef callee, JsValueRef argv[], unsigned short argc, JsNativeFunctionInfo* env, void* userdata);
+static bool CHAKRA_CALLBACK        on_load_serialized_source   (JsSourceContext source_context, JsValueRef* out_value, JsParseScriptAttributes* out_attributes);
 static JsErrorCode CHAKRA_CALLBACK on_notify_module_ready      (JsModuleRecord module, JsValueRef exception);
 static void CHAKRA_CALLBACK        on_reject_promise_unhandled (JsValueRef promise, JsValueRef reason, bool handled, void* userdata);
 static void CHAKRA_CALLBACK        on_resolve_reject_promise   (JsValueRef function, void* userdata);
 static void                        decode_debugger_value       (void);
+static bool                        enqueue_job                 (JsValueRef task);
 static const char*                 filename_from_script_id     (unsigned int script_id);
 static JsModuleRecord              get_module_record           (const char* specifier, JsModuleRecord parent, const char* url, bool *out_is_new);
 static js_ref_t*                   get_ref                     (int stack_index);
 static JsValueRef                  get_value                   (int stack_index);
+static JsPropertyIdRef             intern_key                  (const char* name);
 static JsPropertyIdRef             make_property_id            (JsValueRef key_value);
 static js_ref_t*                   make_ref                    (JsRef value, bool weak_ref);
 static JsValueRef                  pop_value                   (void);
@@ -149,13 +157,15 @@ static vector_t*            s_breakpoints;
 static JsValueRef           s_callee_value = JS_INVALID_REFERENCE;
 static jsal_jmpbuf*         s_catch_label = NULL;
 static js_import_callback_t s_import_callback = NULL;
-static js_job_callback_t    s_job_callback = NULL;
+static JsValueRef*          s_jobs = NULL;
+static bool                 s_jobs_enabled = false;
 static JsContextRef         s_js_context;
 static JsValueRef           s_js_false;
 static JsValueRef           s_js_null;
 static JsRuntimeHandle      s_js_runtime = NULL;
 static JsValueRef           s_js_true;
 static JsValueRef           s_js_undefined;
+static hashmap_t*           s_keys = NULL;
 static js_ref_t*            s_key_configurable;
 static js_ref_t*            s_key_done;
 static js_ref_t*            s_key_enumerable;
@@ -165,12 +175,16 @@ static js_ref_t*            s_key_next;
 static js_ref_t*            s_key_set;
 static js_ref_t*            s_key_value;
 static js_ref_t*            s_key_writable;
+static int                  s_max_jobs = 0;
 static vector_t*            s_module_cache;
 static vector_t*            s_module_jobs;
 static JsValueRef           s_newtarget_value = JS_INVALID_REFERENCE;
+static int                  s_next_job = 0;
 static JsSourceContext      s_next_source_context = 1;
+static int                  s_num_jobs = 0;
 static js_reject_callback_t s_reject_callback = NULL;
 static vector_t*            s_rejections;
+static hashmap_t*           s_sources;
 static int                  s_stack_base;
 static JsValueRef           s_stash;
 static JsValueRef           s_this_value = JS_INVALID_REFERENCE;
@@ -215,6 +229,8 @@ jsal_init(void)
 	s_module_cache = vector_new(sizeof(struct module));
 	s_module_jobs = vector_new(sizeof(struct module_job));
 	s_rejections = vector_new(sizeof(struct rejection));
+	s_sources = hashmap_new(sizeof(JsValueRef));
+	s_keys = hashmap_new(sizeof(JsPropertyIdRef));
 
 	vector_reserve(s_value_stack, 128);
 
@@ -267,6 +283,22 @@ jsal_uninit(void)
 		free(module->filename);
 	}
 
+	iter = hashmap_enum(s_sources);
+	while (iter_next(&iter))
+		JsRelease(*(JsValueRef*)iter.ptr, NULL);
+
+	jsal_cancel_jobs();
+	free(s_jobs);
+	s_jobs = NULL;
+	s_max_jobs = 0;
+	s_jobs_enabled = false;
+
+	iter = hashmap_enum(s_keys);
+	while (iter_next(&iter))
+		JsRelease(*(JsPropertyIdRef*)iter.ptr, NULL);
+	hashmap_free(s_keys);
+	s_keys = NULL;
+
 	// clear value stack, releasing all references
 	resize_stack(0);
 
@@ -275,6 +307,7 @@ jsal_uninit(void)
 	vector_free(s_module_jobs);
 	vector_free(s_value_stack);
 	vector_free(s_rejections);
+	hashmap_free(s_sources);
 	JsRelease(s_stash, NULL);
 	JsSetCurrentContext(JS_INVALID_REFERENCE);
 	JsDisposeRuntime(s_js_runtime);
@@ -327,8 +360,6 @@ jsal_update(bool in_event_loop)
 	}
 
 	if (in_event_loop) {
-		JsIdle(NULL);
-		
 		// check for broken promises.  if there are any uncaught rejections, throw the rejection value
 		// as an exception out of the event loop.  this avoids errors in asynchronous code getting eaten
 		// (most likely by the pig).
@@ -373,7 +404,8 @@ bool
 jsal_busy(void)
 {
 	return vector_len(s_module_jobs) > 0
-		|| vector_len(s_rejections) > 0;
+		|| vector_len(s_rejections) > 0
+		|| s_num_jobs > 0;
 }
 
 bool
@@ -385,12 +417,6 @@ jsal_vm_enabled(void)
 	return !disabled;
 }
 
-void
-jsal_on_enqueue_job(js_job_callback_t callback)
-{
-	s_job_callback = callback;
-}
-
 void
 jsal_on_import_module(js_import_callback_t callback)
 {
@@ -438,6 +464,16 @@ jsal_call_method(int num_args)
 	push_value(retval_ref, false);
 }
 
+void
+jsal_cancel_jobs(void)
+{
+	while (s_num_jobs > 0) {
+		JsRelease(s_jobs[s_next_job], NULL);
+		s_next_job = (s_next_job + 1) & (s_max_jobs - 1);
+		--s_num_jobs;
+	}
+}
+
 unsigned int
 jsal_compile(const char* filename)
 {
@@ -455,6 +491,55 @@ jsal_compile(const char* filename)
 	return (unsigned int)s_next_source_context++;
 }
 
+bool
+jsal_compile_serialized(const char* filename, const void* data, size_t size)
+{
+	/* [ ... source ] -> [ ... function ] */
+
+	// note: if the bytecode is stale (e.g. it was serialized by a different build of
+	//       ChakraCore), this returns false and leaves the source on the stack so the
+	//       caller can fall back on jsal_compile().
+
+	JsValueRef      buffer;
+	BYTE*           buffer_ptr;
+	JsSourceContext context;
+	JsValueRef      exception;
+	JsValueRef      function;
+	bool            have_error;
+	JsValueRef      name_string;
+	JsErrorCode     result;
+	JsValueRef      source;
+
+	if (s_break_callback != NULL)
+		return false;  // see note in jsal_serialize()
+	if (JsCreateArrayBuffer((unsigned int)size, &buffer) != JsNoError)
+		return false;
+	JsGetArrayBufferStorage(buffer, &buffer_ptr, NULL);
+	memcpy(buffer_ptr, data, size);
+
+	// ChakraCore may need the original source later on (e.g. for deferred functions or
+	// Function#toString()), so keep it pinned until it's asked for.  it's looked up by
+	// source context cookie in on_load_serialized_source().
+	context = s_next_source_context++;
+	source = get_value(-1);
+	if (!hashmap_put(s_sources, &context, sizeof(JsSourceContext), &source))
+		return false;
+	JsAddRef(source, NULL);
+	JsCreateString(filename, strlen(filename), &name_string);
+	result = JsParseSerialized(buffer, on_load_serialized_source, context, name_string, &function);
+	if (result != JsNoError) {
+		JsHasException(&have_error);
+		if (have_error)
+			JsGetAndClearException(&exception);
+		hashmap_remove(s_sources, &context, sizeof(JsSourceContext));
+		JsRelease(source, NULL);
+		return false;
+	}
+	jsal_pop(1);
+	push_value(function, false);
+	return true;
+}
+
 void
 jsal_construct(int num_args)
 {
@@ -585,9 +670,15 @@ jsal_del_prop_index(int object_index, int name)
 bool
 jsal_del_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_del_prop(object_index);
+	JsValueRef object_ref;
+	JsValueRef result;
+	bool       retval;
+
+	object_ref = get_value(object_index);
+	JsDeleteProperty(object_ref, intern_key(name), true, &result);
+	throw_on_error();
+	JsBooleanToBool(result, &retval);
+	return retval;
 }
 
 int
@@ -599,6 +690,12 @@ jsal_dup(int from_index)
 	return push_value(ref->value, ref->weak_ref);
 }
 
+void
+jsal_enable_jobs(bool enabled)
+{
+	s_jobs_enabled = enabled;
+}
+
 void
 jsal_enable_vm(bool enabled)
 {
@@ -745,8 +842,14 @@ jsal_get_global_string(const char* name)
 {
 	/* [ ... ] -> [ ... value ] */
 
-	jsal_push_string(name);
-	return jsal_get_global();
+	JsValueRef object;
+	JsValueRef value;
+
+	JsGetGlobalObject(&object);
+	JsGetProperty(object, intern_key(name), &value);
+	throw_on_error();
+	push_value(value, true);
+	return value != s_js_undefined;
 }
 
 void*
@@ -892,13 +995,11 @@ jsal_get_prop_string(int object_index, const char* name)
 {
 	/* [ ... ] -> [ ... value ] */
 
-	JsPropertyIdRef key;
-	js_ref_t*       object_ref;
-	JsValueRef      value;
+	js_ref_t*  object_ref;
+	JsValueRef value;
 
 	object_ref = get_ref(object_index);
-	JsCreatePropertyId(name, strlen(name), &key);
-	JsGetProperty(object_ref->value, key, &value);
+	JsGetProperty(object_ref->value, intern_key(name), &value);
 	throw_on_error();
 	push_value(value, object_ref->weak_ref);
 	return value != s_js_undefined;
@@ -968,9 +1069,12 @@ jsal_has_own_prop_index(int object_index, int name)
 bool
 jsal_has_own_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_own_prop(object_index);
+	bool       has_property;
+	JsValueRef object_ref;
+
+	object_ref = get_value(object_index);
+	JsHasOwnProperty(object_ref, intern_key(name), &has_property);
+	return has_property;
 }
 
 bool
@@ -1010,9 +1114,30 @@ jsal_has_prop_key(int object_index, js_ref_t* key)
 bool
 jsal_has_prop_string(int object_index, const char* name)
 {
-	object_index = jsal_normalize_index(object_index);
-	jsal_push_string(name);
-	return jsal_has_prop(object_index);
+	bool       has_property;
+	JsValueRef object_ref;
+
+	object_ref = get_value(object_index);
+	JsHasProperty(object_ref, intern_key(name), &has_property);
+	return has_property;
+}
+
+size_t
+jsal_heap_size(void)
+{
+	size_t size;
+
+	if (JsGetRuntimeMemoryUsage(s_js_runtime, &size) != JsNoError)
+		return 0;
+	return size;
+}
+
+void
+jsal_idle(void)
+{
+	// note: this only does a slice of work (e.g. finishing a concurrent mark or decommitting
+	//       free pages) and returns; the host is expected to call it when it has time to spare.
+	JsIdle(NULL);
 }
 
 void
@@ -1189,6 +1314,32 @@ jsal_is_symbol(int stack_index)
 	return type == JsSymbol;
 }
 
+bool
+jsal_is_typed_array(int stack_index, js_buffer_type_t buffer_type)
+{
+	JsTypedArrayType array_type;
+	JsValueRef       ref;
+	JsValueType      type;
+	JsTypedArrayType wanted_type;
+
+	ref = get_value(stack_index);
+	JsGetValueType(ref, &type);
+	if (type != JsTypedArray || buffer_type == JS_ARRAYBUFFER)
+		return false;
+	wanted_type = buffer_type == JS_UINT8ARRAY ? JsArrayTypeUint8
+		: buffer_type == JS_UINT8ARRAY_CLAMPED ? JsArrayTypeUint8Clamped
+		: buffer_type == JS_UINT16ARRAY ? JsArrayTypeUint16
+		: buffer_type == JS_UINT32ARRAY ? JsArrayTypeUint32
+		: buffer_type == JS_INT8ARRAY ? JsArrayTypeInt8
+		: buffer_type == JS_INT16ARRAY ? JsArrayTypeInt16
+		: buffer_type == JS_INT32ARRAY ? JsArrayTypeInt32
+		: buffer_type == JS_FLOAT32ARRAY ? JsArrayTypeFloat32
+		: buffer_type == JS_FLOAT64ARRAY ? JsArrayTypeFloat64
+		: JsArrayTypeUint8;
+	JsGetTypedArrayInfo(ref, &array_type, NULL, NULL, NULL);
+	return array_type == wanted_type;
+}
+
 bool
 jsal_is_undefined(int stack_index)
 {
@@ -1221,10 +1372,7 @@ jsal_make_buffer(int object_index, js_buffer_type_t buffer_type, void* buffer, s
 js_ref_t*
 jsal_new_key(const char* name)
 {
-	JsPropertyIdRef key;
-
-	JsCreatePropertyId(name, strlen(name), &key);
-	return make_ref(key, false);
+	return make_ref(intern_key(name), false);
 }
 
 bool
@@ -1723,14 +1871,12 @@ jsal_put_prop_string(int object_index, const char* name)
 {
 	/* [ ... value ] -> [ ... ] */
 
-	JsPropertyIdRef key;
-	JsValueRef      object;
-	JsValueRef      value;
+	JsValueRef object;
+	JsValueRef value;
 
 	object = get_value(object_index);
 	value = pop_value();
-	JsCreatePropertyId(name, strlen(name), &key);
-	JsSetProperty(object, key, value, true);
+	JsSetProperty(object, intern_key(name), value, true);
 	throw_on_error();
 }
 
@@ -1949,6 +2095,64 @@ jsal_require_undefined(int at_index)
 	}
 }
 
+void
+jsal_run_jobs(void)
+{
+	// note: the queue is drained to completion, including any jobs queued by the ones
+	//       being run.  if a job throws, the rest of the queue is still run and the first
+	//       error is rethrown afterwards.
+	js_ref_t*  error_ref = NULL;
+	JsValueRef task;
+
+	while (s_num_jobs > 0 && jsal_vm_enabled()) {
+		task = s_jobs[s_next_job];
+		s_next_job = (s_next_job + 1) & (s_max_jobs - 1);
+		--s_num_jobs;
+		push_value(task, false);
+		JsRelease(task, NULL);
+		if (!jsal_try_call(0) && error_ref == NULL)
+			error_ref = jsal_ref(-1);
+		jsal_pop(1);
+	}
+	if (error_ref != NULL) {
+		jsal_push_ref(error_ref);
+		jsal_unref(error_ref);
+		jsal_throw();
+	}
+}
+
+void*
+jsal_serialize(int at_index, size_t *out_size)
+{
+	JsValueRef   buffer;
+	BYTE*        buffer_ptr;
+	unsigned int buffer_size;
+	JsValueRef   exception;
+	bool         have_error;
+	void*        retval;
+
+	// note: ChakraCore can't step through code loaded from serialized bytecode, so
+	//       don't hand any out while the debugger is active.
+	if (s_break_callback != NULL)
+		return NULL;
+
+	if (JsSerialize(get_value(at_index), &buffer, JsParseScriptAttributeNone) != JsNoError) {
+		// note: a syntax error leaves an exception pending; it will be reported properly
+		//       when the caller compiles the source normally.
+		JsHasException(&have_error);
+		if (have_error)
+			JsGetAndClearException(&exception);
+		return NULL;
+	}
+	JsGetArrayBufferStorage(buffer, &buffer_ptr, &buffer_size);
+	if (!(retval = malloc(buffer_size)))
+		return NULL;
+	memcpy(retval, buffer_ptr, buffer_size);
+	if (out_size != NULL)
+		*out_size = buffer_size;
+	return retval;
+}
+
 void
 jsal_set_async_call_flag(bool is_async)
 {
@@ -2596,6 +2800,35 @@ get_value(int stack_index)
 	return ref->value;
 }
 
+static JsPropertyIdRef
+intern_key(const char* name)
+{
+	// note: property names passed in from C are almost always string literals, so
+	//       the property ID for each distinct name is created once and kept pinned
+	//       in a hash table.  this avoids a trip through JsCreatePropertyId() every
+	//       time a hot binding reads or writes a property.
+	JsPropertyIdRef  key;
+	JsPropertyIdRef* key_ptr;
+	size_t           length;
+
+	length = strlen(name);
+	if (s_keys == NULL)
+		goto uninterned;
+	if ((key_ptr = hashmap_get(s_keys, name, length)))
+		return *key_ptr;
+	if (hashmap_len(s_keys) >= MAX_INTERNED_KEYS)
+		goto uninterned;
+	JsCreatePropertyId(name, length, &key);
+	if (!hashmap_put(s_keys, name, length, &key))
+		return key;
+	JsAddRef(key, NULL);
+	return key;
+
+uninterned:
+	JsCreatePropertyId(name, length, &key);
+	return key;
+}
+
 static JsPropertyIdRef
 make_property_id(JsValueRef key)
 {
@@ -2686,6 +2919,33 @@ script_id_from_filename(const char* filename)
 	return script_id;
 }
 
+static bool
+enqueue_job(JsValueRef task)
+{
+	// note: promise continuations are kept in a ring buffer.  async code can queue up
+	//       huge numbers of them, so this needs to be as cheap as possible.
+	JsValueRef* new_jobs;
+	int         new_max;
+
+	int i;
+
+	if (s_num_jobs >= s_max_jobs) {
+		new_max = s_max_jobs > 0 ? s_max_jobs * 2 : 256;
+		if (!(new_jobs = malloc(new_max * sizeof(JsValueRef))))
+			return false;
+		for (i = 0; i < s_num_jobs; ++i)
+			new_jobs[i] = s_jobs[(s_next_job + i) & (s_max_jobs - 1)];
+		free(s_jobs);
+		s_jobs = new_jobs;
+		s_max_jobs = new_max;
+		s_next_job = 0;
+	}
+	JsAddRef(task, NULL);
+	s_jobs[(s_next_job + s_num_jobs) & (s_max_jobs - 1)] = task;
+	++s_num_jobs;
+	return true;
+}
+
 static const char*
 filename_from_script_id(unsigned int script_id)
 {
@@ -3108,6 +3368,22 @@ on_js_to_native_call(JsValueRef callee, JsValueRef argv[], unsigned short argc,
 	return retval;
 }
 
+static bool CHAKRA_CALLBACK
+on_load_serialized_source(JsSourceContext source_context, JsValueRef* out_value, JsParseScriptAttributes* out_attributes)
+{
+	// note: ChakraCore only asks for a given source once and holds on to it from then
+	//       on, so our reference can be dropped here.
+	JsValueRef* source_ptr;
+
+	if (!(source_ptr = hashmap_get(s_sources, &source_context, sizeof(JsSourceContext))))
+		return false;
+	*out_value = *source_ptr;
+	*out_attributes = JsParseScriptAttributeNone;
+	JsRelease(*source_ptr, NULL);
+	hashmap_remove(s_sources, &source_context, sizeof(JsSourceContext));
+	return true;
+}
+
 static JsErrorCode CHAKRA_CALLBACK
 on_notify_module_ready(JsModuleRecord module, JsValueRef exception)
 {
@@ -3160,9 +3436,10 @@ on_resolve_reject_promise(JsValueRef task, void* userdata)
 	push_value(task, true);
 	if (jsal_setjmp(label) == 0) {
 		s_catch_label = &label;
-		if (s_job_callback == NULL)
+		if (!s_jobs_enabled)
 			jsal_error(JS_ERROR, "No async/promise continuation support");
-		s_job_callback();
+		if (!enqueue_job(task))
+			jsal_error(JS_ERROR, "Couldn't queue promise continuation");
 	}
 	else {
 		// if an error gets thrown into C code, 'jsal_throw()' leaves it on top
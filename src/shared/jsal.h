@@ -93,7 +93,6 @@ enum js_error_type
 typedef bool      (* js_function_t)        (int num_args, bool is_ctor, intptr_t magic);
 typedef js_step_t (* js_break_callback_t)  (void);
 typedef void      (* js_finalizer_t)       (void* host_ptr);
-typedef void      (* js_job_callback_t)    (void);
 typedef bool      (* js_reject_callback_t) (void);
 typedef void      (* js_throw_callback_t)  (void);
 typedef void      (* js_import_callback_t) (void);
@@ -103,12 +102,13 @@ void         jsal_uninit                   (void);
 void         jsal_update                   (bool in_event_loop);
 bool         jsal_busy                     (void);
 bool         jsal_vm_enabled               (void);
-void         jsal_on_enqueue_job           (js_job_callback_t callback);
 void         jsal_on_import_module         (js_import_callback_t callback);
 void         jsal_on_reject_promise        (js_reject_callback_t callback);
 void         jsal_call                     (int num_args);
 void         jsal_call_method              (int num_args);
+void         jsal_cancel_jobs              (void);
 unsigned int jsal_compile                  (const char* filename);
+bool         jsal_compile_serialized       (const char* filename, const void* data, size_t size);
 void         jsal_construct                (int num_args);
 void         jsal_def_prop                 (int object_index);
 void         jsal_def_prop_index           (int object_index, int name);
@@ -119,6 +119,7 @@ bool         jsal_del_prop                 (int object_index);
 bool         jsal_del_prop_index           (int object_index, int name);
 bool         jsal_del_prop_string          (int object_index, const char* name);
 int          jsal_dup                      (int from_index);
+void         jsal_enable_jobs              (bool enabled);
 void         jsal_enable_vm                (bool enabled);
 except_t     jsal_error                    (js_error_type_t type, const char* message, ...);
 except_t     jsal_error_va                 (js_error_type_t type, const char* message, va_list ap);
@@ -150,6 +151,8 @@ bool         jsal_has_prop                 (int object_index);
 bool         jsal_has_prop_index           (int object_index, int name);
 bool         jsal_has_prop_key             (int object_index, js_ref_t* key);
 bool         jsal_has_prop_string          (int object_index, const char* name);
+size_t       jsal_heap_size                (void);
+void         jsal_idle                     (void);
 void         jsal_insert                   (int at_index);
 bool         jsal_is_array                 (int stack_index);
 bool         jsal_is_async_call            (void);
@@ -165,6 +168,7 @@ bool         jsal_is_object_coercible      (int stack_index);
 bool         jsal_is_string                (int stack_index);
 bool         jsal_is_subclass_ctor         (void);
 bool         jsal_is_symbol                (int stack_index);
+bool         jsal_is_typed_array           (int stack_index, js_buffer_type_t buffer_type);
 bool         jsal_is_undefined             (int stack_index);
 void         jsal_make_buffer              (int object_index, js_buffer_type_t buffer_type, void* buffer, size_t num_items);
 js_ref_t*    jsal_new_key                  (const char* name);
@@ -226,6 +230,8 @@ const char*  jsal_require_string           (int at_index);
 void         jsal_require_symbol           (int at_index);
 unsigned int jsal_require_uint             (int at_index);
 void         jsal_require_undefined        (int at_index);
+void         jsal_run_jobs                 (void);
+void*        jsal_serialize                (int at_index, size_t *out_size);
 void         jsal_set_async_call_flag      (bool is_async);
 void         jsal_set_finalizer            (int at_index, js_finalizer_t callback);
 void         jsal_set_host_data            (int at_index, void* ptr);